@@ -0,0 +1,112 @@
+// Times DataTransformer on uint8 images against the per-pixel loop that the
+// fused row kernel replaced, with the same crop, mean values and scale.
+// Usage:
+//    transform_time [FLAGS]
+#include <caffe/caffe.hpp>
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#endif  // USE_OPENCV
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/data_transformer.hpp"
+#include "caffe/util/benchmark.hpp"
+
+#ifdef USE_OPENCV
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(size, 256, "Side of the square input image.");
+DEFINE_int32(crop_size, 224, "Side of the center crop, 0 for no crop.");
+DEFINE_int32(channels, 3, "Number of image channels.");
+DEFINE_int32(iterations, 500, "Number of samples to time per path.");
+
+/* The per-pixel transform of an interleaved image before the row kernel. */
+static void PerPixelTransform(const cv::Mat& img, const int h_off,
+    const int w_off, const int height, const int width,
+    const std::vector<float>& mean_values, const float scale, float* dst) {
+  const int channels = img.channels();
+  for (int h = 0; h < height; ++h) {
+    const uchar* ptr = img.ptr<uchar>(h + h_off) + w_off * channels;
+    int img_index = 0;
+    for (int w = 0; w < width; ++w) {
+      for (int c = 0; c < channels; ++c) {
+        const int top_index = (c * height + h) * width + w;
+        const float pixel = static_cast<float>(ptr[img_index++]);
+        dst[top_index] = (pixel - mean_values[c]) * scale;
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("Time the uint8 DataTransformer paths.\n"
+      "Usage:\n"
+      "    transform_time [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  const int crop = FLAGS_crop_size ? FLAGS_crop_size : FLAGS_size;
+  CHECK_LE(crop, FLAGS_size);
+  CHECK_GT(FLAGS_iterations, 0);
+
+  TransformationParameter param;
+  param.set_crop_size(FLAGS_crop_size);
+  param.set_scale(0.017);
+  std::vector<float> mean_values;
+  for (int c = 0; c < FLAGS_channels; ++c) {
+    mean_values.push_back(100 + c);
+    param.add_mean_value(mean_values[c]);
+  }
+  cv::Mat img(FLAGS_size, FLAGS_size, CV_8UC(FLAGS_channels));
+  for (int h = 0; h < img.rows; ++h) {
+    uchar* ptr = img.ptr<uchar>(h);
+    for (int j = 0; j < img.cols * FLAGS_channels; ++j) {
+      ptr[j] = static_cast<uchar>(caffe_rng_rand());
+    }
+  }
+  Datum datum;
+  CVMatToDatum(img, &datum);
+  Blob<float> fused(1, FLAGS_channels, crop, crop);
+  Blob<float> per_pixel(1, FLAGS_channels, crop, crop);
+  // TEST phase: a center crop and no mirroring, as in PerPixelTransform.
+  DataTransformer<float> transformer(param, TEST);
+  transformer.InitRand();
+
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    transformer.Transform(img, &fused);
+  }
+  const double mat_ms = timer.MilliSeconds() / FLAGS_iterations;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    transformer.Transform(datum, &fused);
+  }
+  const double datum_ms = timer.MilliSeconds() / FLAGS_iterations;
+  const int offset = (FLAGS_size - crop) / 2;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    PerPixelTransform(img, offset, offset, crop, crop, mean_values,
+        param.scale(), per_pixel.mutable_cpu_data());
+  }
+  const double per_pixel_ms = timer.MilliSeconds() / FLAGS_iterations;
+
+  float max_diff = 0;
+  for (int j = 0; j < fused.count(); ++j) {
+    max_diff = std::max(max_diff,
+        std::fabs(fused.cpu_data()[j] - per_pixel.cpu_data()[j]));
+  }
+  CHECK_LT(max_diff, 1e-4) << "The paths disagree";
+  LOG(INFO) << FLAGS_size << "x" << FLAGS_size << "x" << FLAGS_channels
+      << " to " << crop << "x" << crop << ", per sample:";
+  LOG(INFO) << "  fused cv::Mat:   " << mat_ms << " ms";
+  LOG(INFO) << "  fused Datum:     " << datum_ms << " ms";
+  LOG(INFO) << "  per-pixel loop:  " << per_pixel_ms << " ms";
+  return 0;
+}
+#else
+int main(int argc, char** argv) {
+  LOG(FATAL) << "This example requires OpenCV; compile with USE_OPENCV.";
+}
+#endif  // USE_OPENCV
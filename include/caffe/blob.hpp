@@ -263,6 +263,33 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to a view of the data_ of Blob other,
+   *        covering this Blob's count elements from offset on.
+   *
+   * Writes to this Blob then land directly in other, so a Layer can gather
+   * or scatter contiguous regions without a copy. A later Reshape that grows
+   * this Blob gives it its own memory again.
+   */
+  void ShareDataView(const Blob& other, int offset);
+  /// @brief Like ShareDataView, for the diff_.
+  void ShareDiffView(const Blob& other, int offset);
+
+  /**
+   * @brief Mark the diff as row-sparse: only the rows (slices along the
+   *        first axis) recorded with touch_diff_row can be nonzero.
+   *
+   * Net::ClearParamDiffs, Net::Update and the solvers then visit only those
+   * rows on the CPU. ShareDiff shares the recorded rows along with the diff.
+   */
+  void set_sparse_diff(bool sparse);
+  bool sparse_diff() const { return diff_rows_.get() != NULL; }
+  /// @brief Record that row of a row-sparse diff may be nonzero.
+  void touch_diff_row(int row);
+  /// @brief The rows recorded since the last clear_diff_rows, each once.
+  const vector<int>& diff_rows() const;
+  /// @brief Forget the recorded rows; the diff itself is left as is.
+  void clear_diff_rows();
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -273,6 +300,13 @@ class Blob {
   vector<int> shape_;
   int count_;
   int capacity_;
+  // Rows of a row-sparse diff in the order first touched, with a flag per
+  // row to keep them unique. NULL for a dense diff.
+  struct DiffRows {
+    vector<int> rows;
+    vector<bool> touched;
+  };
+  shared_ptr<DiffRows> diff_rows_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
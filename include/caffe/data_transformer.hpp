@@ -60,7 +60,17 @@ class DataTransformer {
   void Transform(const cv::Mat& cv_img, Blob<Dtype>* transformed_blob,
                 bool preserve_pixel_vals);
    
-   void Transform(const Datum& datum, Blob<Dtype>* transformed_blob, vector<BoxLabel>* box_labels);
+  /**
+   * @brief Decodes an encoded box Datum, samples a random crop that keeps at
+   * least one box center (TRAIN only), and resizes it straight to the shape of
+   * transformed_blob while normalizing and mirroring it in one pass. The
+   * blob shape sets the sample size, so crop_size is not supported.
+   *
+   * @param box_labels
+   *    The boxes of the crop, relative to the crop.
+   */
+  void Transform(const Datum& datum, Blob<Dtype>* transformed_blob,
+                vector<BoxLabel>* box_labels);
 
 #ifdef USE_OPENCV
   /**
@@ -89,6 +99,21 @@ class DataTransformer {
   void Transform(const cv::Mat& cv_img, Blob<Dtype>* transformed_blob);
 #endif  // USE_OPENCV
 
+  /**
+   * @brief Crops and mirrors like Transform, but keeps the uint8 pixels and
+   * skips mean subtraction and scaling, which are applied when the batch is
+   * consumed (see TransformationParameter.uint8_batch).
+   *
+   * @param datum
+   *    Datum containing uint8 or encoded data to be transformed.
+   * @param transformed_data
+   *    Destination holding the count of InferBlobShape(datum), in CHW order.
+   */
+  void TransformRaw(const Datum& datum, uint8_t* transformed_data);
+#ifdef USE_OPENCV
+  void TransformRaw(const cv::Mat& cv_img, uint8_t* transformed_data);
+#endif  // USE_OPENCV
+
   /**
    * @brief Applies the same transformation defined in the data layer's
    * transform_param block to all the num images in a input_blob.
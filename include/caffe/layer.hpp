@@ -68,7 +68,8 @@ class Layer {
       const vector<Blob<Dtype>*>& top) {
     CheckBlobCounts(bottom, top);
     LayerSetUp(bottom, top);
-    Reshape(bottom, top);
+    reshaped_shapes_.clear();
+    ReshapeIfChanged(bottom, top);
     SetLossWeights(top);
   }
 
@@ -106,6 +107,18 @@ class Layer {
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) = 0;
 
+  /**
+   * @brief Calls Reshape, unless ReshapeOnShapeChangeOnly() is true and the
+   *        bottom and top shapes are still those of the last Reshape done
+   *        through this method.
+   *
+   * SetUp, Forward and Net::Reshape go through it, so a layer that opts in
+   * reshapes once when the input size changes (e.g. with multi-scale
+   * training) instead of on every pass.
+   */
+  void ReshapeIfChanged(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
   /**
    * @brief Given the bottom blobs, compute the top blobs and the loss.
    *
@@ -269,6 +282,13 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether Reshape depends on nothing but the bottom shapes
+   *        and the layer parameters, so that ReshapeIfChanged may skip it
+   *        while the shapes stay the same.
+   */
+  virtual inline bool ReshapeOnShapeChangeOnly() const { return false; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -291,6 +311,18 @@ class Layer {
     param_propagate_down_[param_id] = value;
   }
 
+  /**
+   * @brief Sets whether the layer may turn blobs it connects into views of
+   *        each other's memory instead of copying between them.
+   *
+   * Set by the Net before SetUp. It is only safe when no layer computes one
+   * of this layer's bottoms or tops in place and none of them carries a loss
+   * weight, as either would write through a view into the others' memory.
+   * Views are contiguous byte ranges, so only Concat and Slice along the
+   * batch axis (or with a batch of 1) use them.
+   */
+  virtual inline void set_allow_aliasing(bool allow) {}
+
 
  protected:
   /** The protobuf that stores the layer parameters */
@@ -403,6 +435,9 @@ class Layer {
   }
 
  private:
+  /** The bottom then top shapes of the last ReshapeIfChanged. */
+  vector<vector<int> > reshaped_shapes_;
+
   DISABLE_COPY_AND_ASSIGN(Layer);
 };  // class Layer
 
@@ -413,7 +448,7 @@ template <typename Dtype>
 inline Dtype Layer<Dtype>::Forward(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   Dtype loss = 0;
-  Reshape(bottom, top);
+  ReshapeIfChanged(bottom, top);
   switch (Caffe::mode()) {
   case Caffe::CPU:
     Forward_cpu(bottom, top);
@@ -445,6 +480,33 @@ inline Dtype Layer<Dtype>::Forward(const vector<Blob<Dtype>*>& bottom,
   return loss;
 }
 
+template <typename Dtype>
+void Layer<Dtype>::ReshapeIfChanged(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  if (!ReshapeOnShapeChangeOnly()) {
+    Reshape(bottom, top);
+    return;
+  }
+  bool changed = reshaped_shapes_.size() != bottom.size() + top.size();
+  for (int i = 0; !changed && i < bottom.size(); ++i) {
+    changed = bottom[i]->shape() != reshaped_shapes_[i];
+  }
+  for (int i = 0; !changed && i < top.size(); ++i) {
+    changed = top[i]->shape() != reshaped_shapes_[bottom.size() + i];
+  }
+  if (!changed) {
+    return;
+  }
+  Reshape(bottom, top);
+  reshaped_shapes_.clear();
+  for (int i = 0; i < bottom.size(); ++i) {
+    reshaped_shapes_.push_back(bottom[i]->shape());
+  }
+  for (int i = 0; i < top.size(); ++i) {
+    reshaped_shapes_.push_back(top[i]->shape());
+  }
+}
+
 template <typename Dtype>
 inline void Layer<Dtype>::Backward(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
@@ -47,7 +47,41 @@ class BaseDataLayer : public Layer<Dtype> {
 template <typename Dtype>
 class Batch {
  public:
+  Batch() : read_time_(0), decode_time_(0), trans_time_(0), load_time_(0) {}
+
   Blob<Dtype> data_, label_;
+  // Time spent producing this batch in the prefetch thread, in ms. The
+  // stages a layer does not report stay at zero.
+  double read_time_, decode_time_, trans_time_, load_time_;
+  // The pixels of data_ as uint8 when transform_param.uint8_batch is set.
+  // data_ then only carries the shape and is never allocated.
+  shared_ptr<SyncedMemory> raw_data_;
+  // The outputs past label_ of layers with more than two tops.
+  vector<shared_ptr<Blob<Dtype> > > extra_;
+};
+
+/**
+ * @brief Data pipeline counters of a prefetching data layer, accumulated over
+ * the batches consumed since the last reset. Times are in milliseconds.
+ */
+struct PrefetchStats {
+  PrefetchStats()
+      : batches(0), read_time(0), decode_time(0), trans_time(0), load_time(0),
+        wait_time(0), queue_depth(0) {}
+
+  int batches;
+  // DB or file reads, image decoding and transformation in the prefetch
+  // thread. Encoded Datums are decoded by the transformer, so their decoding
+  // counts as transformation.
+  double read_time;
+  double decode_time;
+  double trans_time;
+  // Whole load_batch calls, including the host to device push.
+  double load_time;
+  // Time Forward was blocked waiting for a batch.
+  double wait_time;
+  // Sum of the number of ready batches found by Forward.
+  int queue_depth;
 };
 
 template <typename Dtype>
@@ -66,9 +100,23 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
+  // Only read and reset from the thread calling Forward.
+  inline const PrefetchStats& prefetch_stats() const { return stats_; }
+  inline void ResetPrefetchStats() { stats_ = PrefetchStats(); }
+  inline int prefetch_count() const { return prefetch_.size(); }
+  // Whether load_batch fills raw_data_ when transform_param.uint8_batch is
+  // set.
+  virtual inline bool SupportsUint8Batch() const { return false; }
+
  protected:
+  // Recycles the current batch and waits for the next one.
+  void NextBatch();
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Returns the uint8 storage of a batch whose data_ has been reshaped. The
+  // storage is allocated once in LayerSetUp, on the main thread, and a batch
+  // may not outgrow the shape set by DataLayerSetUp.
+  uint8_t* mutable_raw_data(Batch<Dtype>* batch);
 
   vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
@@ -76,6 +124,11 @@ class BasePrefetchingDataLayer :
   Batch<Dtype>* prefetch_current_;
 
   Blob<Dtype> transformed_data_;
+  // Batches are uint8 and normalized with batch_mean_ in Forward.
+  bool uint8_batch_;
+  Blob<Dtype> batch_mean_;
+
+  PrefetchStats stats_;
 };
 
 }  // namespace caffe
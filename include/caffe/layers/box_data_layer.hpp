@@ -11,6 +11,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/detection.hpp"
 
 namespace caffe {
 
@@ -29,12 +30,23 @@ class BoxDataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual inline int MaxTopBlobs() const { return 100; }
 
   void transform_label(int count, Dtype* top_label, const vector<BoxLabel>& box_labels, int side);
+  // Writes box_labels in the sparse layout of util/detection.hpp.
+  void transform_sparse_label(int count, Dtype* top_label,
+      const vector<BoxLabel>& box_labels, int side);
 
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
+  int label_size(int side) const;
 
   DataReader reader_;
-  int side_; 
+  int side_;
+  // Multi-scale training: the batch and label shapes and the label side of
+  // every scale, computed once at setup, and the scale being loaded.
+  vector<vector<int> > scale_data_shapes_;
+  vector<vector<int> > scale_label_shapes_;
+  vector<int> scale_sides_;
+  int scale_index_;
+  int scale_batches_;
 };
 
 }  // namespace caffe
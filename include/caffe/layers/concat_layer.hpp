@@ -17,7 +17,7 @@ template <typename Dtype>
 class ConcatLayer : public Layer<Dtype> {
  public:
   explicit ConcatLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), allow_aliasing_(false) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -26,6 +26,14 @@ class ConcatLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Concat"; }
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  /**
+   * When the bottoms are contiguous in the top, they become views of it.
+   * That is only the case along the batch axis, or along any axis with a
+   * batch of 1; channel concats with a larger batch still copy.
+   */
+  virtual inline void set_allow_aliasing(bool allow) {
+    allow_aliasing_ = allow;
+  }
 
  protected:
   /**
@@ -76,10 +84,25 @@ class ConcatLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// Makes the bottoms views of buffer_, which the top shares.
+  void AliasBottoms(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  inline bool data_aliased(const Blob<Dtype>* bottom, int i) const {
+    return i < data_views_.size() && bottom->data() == data_views_[i];
+  }
+  inline bool diff_aliased(const Blob<Dtype>* bottom, int i) const {
+    return i < diff_views_.size() && bottom->diff() == diff_views_[i];
+  }
+
   int count_;
   int num_concats_;
   int concat_input_size_;
   int concat_axis_;
+  bool allow_aliasing_;
+  shared_ptr<Blob<Dtype> > buffer_;
+  vector<int> view_offsets_;
+  vector<shared_ptr<SyncedMemory> > data_views_;
+  vector<shared_ptr<SyncedMemory> > diff_views_;
 };
 
 }  // namespace caffe
@@ -7,6 +7,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/image_cache.hpp"
 
 namespace caffe {
 
@@ -28,11 +29,17 @@ class DenseImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual void ShuffleImages();
   // virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch);
+#ifdef USE_OPENCV
+  cv::Mat ReadImage(const string& filename, const int height,
+      const int width, const bool is_color,
+      const bool nearest_neighbour_interp = false);
+#endif  // USE_OPENCV
 
   vector<std::pair<std::string, std::string> > lines_;
   vector<std::pair<std::string, std::string> > synthlines_;
   int lines_id_;
   Blob<Dtype> transformed_label_;
+  shared_ptr<ImageCache> image_cache_;
 };
 
 }  // namespace caffe
@@ -50,6 +50,7 @@ class DetectionLossLayer : public LossLayer<Dtype> {
   float coord_scale_;
   bool sqrt_;
   bool constriant_;
+  bool sparse_label_;
 
   Blob<Dtype> diff_;
 };
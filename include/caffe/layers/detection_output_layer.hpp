@@ -0,0 +1,67 @@
+#ifndef CAFFE_DETECTION_OUTPUT_LAYER_HPP_
+#define CAFFE_DETECTION_OUTPUT_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/detection.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Decodes a YOLO-style grid output into thresholded, non-maximum
+ * suppressed detections, for deploy nets that have no label input.
+ *
+ * The first top is N x K x 6, K = keep_top_k, with one row
+ * (label, score, x, y, w, h) per detection in descending score order; box
+ * centers and sizes are relative to the image. Unused rows have label -1
+ * and zeros elsewhere. The optional second top holds the number of
+ * detections of each image.
+ */
+template <typename Dtype>
+class DetectionOutputLayer : public Layer<Dtype> {
+ public:
+  explicit DetectionOutputLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "DetectionOutput"; }
+  virtual inline int ExactNumBottomBlobs() const { return 1; }
+  virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline int MaxTopBlobs() const { return 2; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    for (int i = 0; i < propagate_down.size(); ++i) {
+      if (propagate_down[i]) { NOT_IMPLEMENTED; }
+    }
+  }
+
+  int side_;
+  int num_class_;
+  int num_object_;
+  bool sqrt_;
+  bool constriant_;
+  EvalDetectionParameter_ScoreType score_type_;
+  Dtype confidence_threshold_;
+  int keep_top_k_;
+
+  shared_ptr<BoxNms<Dtype> > box_nms_;
+  DetectionBoxes<Dtype> pred_boxes_;
+  DetectionBoxes<Dtype> kept_boxes_;
+  // Kept boxes by descending score.
+  vector<int> order_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DETECTION_OUTPUT_LAYER_HPP_
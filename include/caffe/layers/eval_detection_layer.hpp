@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/detection.hpp"
 
 namespace caffe {
 
@@ -38,8 +39,23 @@ class EvalDetectionLayer : public Layer<Dtype> {
   float threshold_;
   bool sqrt_;
   bool constriant_;
-  int score_type_;
+  bool sparse_label_;
+  EvalDetectionParameter_ScoreType score_type_;
   float nms_;
+  Dtype score_threshold_;
+
+  shared_ptr<BoxNms<Dtype> > box_nms_;
+  DetectionBoxes<Dtype> pred_boxes_;
+  DetectionBoxes<Dtype> kept_boxes_;
+  // Ground truth objects of an image, and their indices grouped by class:
+  // class c owns gt_order_[gt_start_[c], gt_start_[c + 1]).
+  vector<int> gt_label_;
+  vector<bool> gt_difficult_;
+  vector<const Dtype*> gt_box_;
+  vector<int> gt_order_;
+  vector<int> gt_start_;
+  vector<int> gt_end_;
+  vector<bool> gt_matched_;
 };
 
 }  // namespace caffe
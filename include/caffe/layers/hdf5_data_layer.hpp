@@ -17,19 +17,20 @@ namespace caffe {
 /**
  * @brief Provides data to the Net from HDF5 files.
  *
+ * Rows are read window_size at a time in the prefetch thread, so at most one
+ * window of each dataset is held in memory, and data_param.prefetch batches
+ * are kept ready.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class HDF5DataLayer : public Layer<Dtype> {
+class HDF5DataLayer : public BasePrefetchingDataLayer<Dtype> {
  public:
   explicit HDF5DataLayer(const LayerParameter& param)
-      : Layer<Dtype>(param), offset_() {}
+      : BasePrefetchingDataLayer<Dtype>(param), file_id_(-1), offset_() {}
   virtual ~HDF5DataLayer();
-  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  // Data layers have no bottoms, so reshaping is trivial.
-  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {}
 
   virtual inline const char* type() const { return "HDF5Data"; }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
@@ -39,20 +40,24 @@ class HDF5DataLayer : public Layer<Dtype> {
   void Next();
   bool Skip();
 
-  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
-  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
-  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
-  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
+  virtual void load_batch(Batch<Dtype>* batch);
+  // Opens a file and reads its first window.
   virtual void LoadHDF5FileData(const char* filename);
+  // Reads the rows of window current_window_ into hdf_blobs_.
+  void LoadWindow();
+  // The number of rows in a window of the current file.
+  hsize_t WindowSize() const;
 
   std::vector<std::string> hdf_filenames_;
   unsigned int num_files_;
   unsigned int current_file_;
+  hid_t file_id_;
+  hsize_t file_rows_;
+  // The first rows of the windows of the current file, in reading order.
+  std::vector<hsize_t> window_starts_;
+  unsigned int current_window_;
   hsize_t current_row_;
+  // The rows of the current window.
   std::vector<shared_ptr<Blob<Dtype> > > hdf_blobs_;
   std::vector<unsigned int> data_permutation_;
   std::vector<unsigned int> file_permutation_;
@@ -7,8 +7,11 @@
 #include <vector>
 
 #include "caffe/blob.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
 
@@ -18,10 +21,14 @@ namespace caffe {
 /**
  * @brief Write blobs to disk as HDF5 files.
  *
+ * Forward copies the bottoms into one of two buffers and returns while a
+ * background thread appends the other one to the "data" and "label"
+ * datasets, which grow by one batch at a time.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class HDF5OutputLayer : public Layer<Dtype> {
+class HDF5OutputLayer : public Layer<Dtype>, public InternalThread {
  public:
   explicit HDF5OutputLayer(const LayerParameter& param)
       : Layer<Dtype>(param), file_opened_(false) {}
@@ -39,6 +46,9 @@ class HDF5OutputLayer : public Layer<Dtype> {
 
   inline std::string file_name() const { return file_name_; }
 
+  /// @brief Waits until every batch seen by Forward is written to the file.
+  void Flush();
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -48,13 +58,18 @@ class HDF5OutputLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
-  virtual void SaveBlobs();
+  virtual void InternalThreadEntry();
+  // Called on the writer thread.
+  virtual void SaveBlobs(Batch<Dtype>* batch);
+  // Waits for a free buffer shaped like the bottoms.
+  Batch<Dtype>* NextBuffer(const vector<Blob<Dtype>*>& bottom);
 
   bool file_opened_;
   std::string file_name_;
   hid_t file_id_;
-  Blob<Dtype> data_blob_;
-  Blob<Dtype> label_blob_;
+  vector<shared_ptr<Batch<Dtype> > > buffers_;
+  BlockingQueue<Batch<Dtype>*> buffers_free_;
+  BlockingQueue<Batch<Dtype>*> buffers_full_;
 };
 
 }  // namespace caffe
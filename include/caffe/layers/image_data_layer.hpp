@@ -11,6 +11,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/image_cache.hpp"
 
 namespace caffe {
 
@@ -29,6 +30,7 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "ImageData"; }
+  virtual inline bool SupportsUint8Batch() const { return true; }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int ExactNumTopBlobs() const { return 2; }
 
@@ -36,9 +38,14 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
   virtual void load_batch(Batch<Dtype>* batch);
+#ifdef USE_OPENCV
+  cv::Mat ReadImage(const string& filename, const int height,
+      const int width, const bool is_color);
+#endif  // USE_OPENCV
 
   vector<std::pair<std::string, int> > lines_;
   int lines_id_;
+  shared_ptr<ImageCache> image_cache_;
 };
 
 
@@ -56,8 +56,26 @@ class LSTMLayer : public RecurrentLayer<Dtype> {
   virtual void FillUnrolledNet(NetParameter* net_param) const;
   virtual void RecurrentInputBlobNames(vector<string>* names) const;
   virtual void RecurrentOutputBlobNames(vector<string>* names) const;
+  virtual void RecurrentStateBlobNames(int t, vector<string>* names) const;
   virtual void RecurrentInputShapes(vector<BlobShape>* shapes) const;
   virtual void OutputBlobNames(vector<string>* names) const;
+
+  /**
+   * @brief Runs the timesteps directly: the input transforms of all timesteps
+   *        as one GEMM, then for each timestep one GEMM for the recurrent
+   *        contributions to all four gates, followed by the LSTMUnit
+   *        non-linearity.  stream_state_ holds h and c.
+   */
+  virtual void StreamingForward(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual inline bool SupportsStreaming() const { return true; }
+
+  /// @brief Gate inputs of all timesteps, (T x N x 4D), in streaming mode.
+  Blob<Dtype> gates_;
+  /// @brief Static input contribution to the gates, (N x 4D).
+  Blob<Dtype> static_gates_;
+  /// @brief h_{t-1} scaled by the continuation indicators, (N x D).
+  Blob<Dtype> h_conted_;
 };
 
 /**
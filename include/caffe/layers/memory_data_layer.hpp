@@ -14,6 +14,9 @@ namespace caffe {
 /**
  * @brief Provides data to the Net from memory.
  *
+ * The data is either handed over as whole arrays with Reset(), or, when
+ * queue_capacity is set, streamed in by producer threads with Push().
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
@@ -39,6 +42,19 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   void Reset(Dtype* data, Dtype* label, int n);
   void set_batch_size(int new_size);
 
+  /**
+   * @brief Copies n samples and their labels into the queue. Safe to call
+   *        from any number of threads while the net runs.
+   *
+   * Blocks until there is room for all n samples, which must fit in
+   * queue_capacity. Returns false if that takes longer than timeout_ms
+   * (-1 waits forever), in which case nothing is pushed.
+   */
+  bool Push(const Dtype* data, const Dtype* labels, int n,
+      int timeout_ms = -1);
+  /// @brief The number of samples waiting in the queue.
+  int queue_size() const;
+
   int batch_size() { return batch_size_; }
   int channels() { return channels_; }
   int height() { return height_; }
@@ -47,6 +63,7 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  void ForwardFromQueue(const vector<Blob<Dtype>*>& top);
 
   int batch_size_, channels_, height_, width_, size_;
   Dtype* data_;
@@ -56,6 +73,16 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   Blob<Dtype> added_data_;
   Blob<Dtype> added_label_;
   bool has_new_data_;
+
+  // Queue state, guarded by sync_. The samples handed to the tops by the
+  // last Forward stay in the ring until the next Forward releases them.
+  class sync;
+  shared_ptr<sync> sync_;
+  Blob<Dtype> queue_data_;
+  Blob<Dtype> queue_labels_;
+  int queue_head_;
+  int queue_count_;
+  int queue_held_;
 };
 
 }  // namespace caffe
@@ -25,6 +25,7 @@ class NeuronLayer : public Layer<Dtype> {
 
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool ReshapeOnShapeChangeOnly() const { return true; }
 };
 
 }  // namespace caffe
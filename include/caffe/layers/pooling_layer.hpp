@@ -1,6 +1,8 @@
 #ifndef CAFFE_POOLING_LAYER_HPP_
 #define CAFFE_POOLING_LAYER_HPP_
 
+#include <stdint.h>
+
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -9,6 +11,16 @@
 
 namespace caffe {
 
+/// Width of an OFFSET pooling mask: one byte for each of the pooled_count
+/// outputs of a plane, packed into Dtype elements.
+template <typename Dtype>
+inline int PackedMaskWidth(int pooled_count) {
+  return (pooled_count + sizeof(Dtype) - 1) / sizeof(Dtype);
+}
+
+/// Marks an OFFSET mask entry whose window had no maximum.
+const uint8_t kNoMaskOffset = 255;
+
 /**
  * @brief Pools the input image by taking the max, average, etc. within regions.
  *
@@ -33,6 +45,7 @@ class PoolingLayer : public Layer<Dtype> {
     return (this->layer_param_.pooling_param().pool() ==
             PoolingParameter_PoolMethod_MAX) ? 2 : 1;
   }
+  virtual inline bool ReshapeOnShapeChangeOnly() const { return true; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -44,6 +57,20 @@ class PoolingLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// Max pools all N * C planes on the CPU, recording the argmax in mask,
+  /// one of the Pooling*Mask types of pooling_layer.cpp.
+  template <typename Mask>
+  void MaxPoolPlanes_cpu(int planes, const Dtype* bottom_data,
+      Dtype* top_data, const Mask& mask);
+  void AvePoolPlanes_cpu(int planes, const Dtype* bottom_data,
+      Dtype* top_data);
+  /// Pools the outputs [ph_begin, ph_end) x [pw_begin, pw_end) of one plane.
+  template <typename Mask>
+  void MaxPoolWindows(const Dtype* bottom, Dtype* top, const Mask& mask,
+      int ph_begin, int ph_end, int pw_begin, int pw_end);
+  void AvePoolWindows(const Dtype* bottom, Dtype* top,
+      int ph_begin, int ph_end, int pw_begin, int pw_end);
+
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
   int pad_h_, pad_w_;
@@ -51,6 +78,15 @@ class PoolingLayer : public Layer<Dtype> {
   int height_, width_;
   int pooled_height_, pooled_width_;
   bool global_pooling_;
+  // Whether top[1] is a packed OFFSET mask.
+  bool offset_mask_;
+  // CPU fast paths: one unpadded window covering the whole plane, or
+  // unpadded 2x2 / 3x3 windows with stride 2 (stride2_kernel_ is 0 if not).
+  // The first full_pooled_h_ x full_pooled_w_ outputs of the latter have
+  // unclipped windows.
+  bool global_window_;
+  int stride2_kernel_;
+  int full_pooled_h_, full_pooled_w_;
   Blob<Dtype> rand_idx_;
   Blob<int> max_idx_;
 };
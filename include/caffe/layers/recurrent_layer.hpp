@@ -41,6 +41,9 @@ class RecurrentLayer : public Layer<Dtype> {
       this->RecurrentInputBlobNames(&inputs);
       min_bottoms += inputs.size();
     }
+    if (this->layer_param_.recurrent_param().sequence_length_input()) {
+      ++min_bottoms;
+    }
     return min_bottoms;
   }
   virtual inline int MaxBottomBlobs() const { return MinBottomBlobs() + 1; }
@@ -87,6 +90,14 @@ class RecurrentLayer : public Layer<Dtype> {
    */
   virtual void RecurrentOutputBlobNames(vector<string>* names) const = 0;
 
+  /**
+   * @brief Fills names with the names of the recurrent Blob&s holding the
+   *        state after timestep t, in RecurrentInputBlobNames order; t = 0 is
+   *        the initial state.  Needed for length buckets -- the default only
+   *        handles the first and the last timestep.
+   */
+  virtual void RecurrentStateBlobNames(int t, vector<string>* names) const;
+
   /**
    * @brief Fills names with the names of the output blobs, concatenated across
    *        all timesteps.  Should return a name for each top Blob.
@@ -133,6 +144,9 @@ class RecurrentLayer : public Layer<Dtype> {
    *      single batch.  This may require padding and/or truncation for uniform
    *      length.
    *
+   *   -# @f$ (N) @f$ (with <code>recurrent_param.sequence_length_input</code>)
+   *      the number of valid timesteps of each stream, as the last bottom.
+   *
    * @param top output Blob vector (length 1)
    *   -# @f$ (T \times N \times D) @f$
    *      the time-varying output @f$ y @f$, where @f$ D @f$ is
@@ -147,15 +161,62 @@ class RecurrentLayer : public Layer<Dtype> {
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /**
+   * @brief Computes top[0] for all T_ timesteps in streaming mode, starting
+   *        from and updating stream_state_.  Subclasses that support
+   *        <code>recurrent_param.streaming</code> should define this and
+   *        SupportsStreaming -- see LSTMLayer.
+   */
+  virtual void StreamingForward(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    NOT_IMPLEMENTED;
+  }
+  virtual inline bool SupportsStreaming() const { return false; }
+
+  /// @brief Reshapes the state and the tops for streaming mode.
+  void StreamingReshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  /// @brief Creates the unrolled net for T_ timesteps.
+  shared_ptr<Net<Dtype> > CreateUnrolledNet(
+      const vector<Blob<Dtype>*>& bottom) const;
+
+  /**
+   * @brief Makes unrolled_nets_[index] the active unrolled_net_, pointing the
+   *        input, output and recurrent blobs at it.
+   */
+  void SelectUnrolledNet(int index);
+
+  /// @brief Shapes stream_state_ like the recurrent inputs, zeroing new state.
+  void ReshapeStreamState();
+
+  /// @brief Shares this layer's parameters with the layers of net.
+  void ShareUnrolledNetParams(Net<Dtype>* net);
+
   /// @brief A Net to implement the Recurrent functionality.
   shared_ptr<Net<Dtype> > unrolled_net_;
 
+  /**
+   * @brief The unrolled nets, one for each length bucket or a single one
+   *        without buckets.  All of them share this layer's parameters.
+   */
+  vector<shared_ptr<Net<Dtype> > > unrolled_nets_;
+  /// @brief The sorted bucket lengths of unrolled_nets_, if any.
+  vector<int> length_buckets_;
+  /// @brief The index of unrolled_net_ in unrolled_nets_.
+  int unrolled_net_index_;
+  /// @brief Whether the last bottom holds the valid length of each stream.
+  bool length_input_;
+  /// @brief The number of valid timesteps of each stream in the current batch.
+  vector<int> valid_lengths_;
+
   /// @brief The number of independent streams to process simultaneously.
   int N_;
 
   /**
    * @brief The number of timesteps in the layer's input, and the number of
-   *        timesteps over which to backpropagate through time.
+   *        timesteps over which to backpropagate through time.  With length
+   *        buckets, the length of the active bucket instead.
    */
   int T_;
 
@@ -180,6 +241,23 @@ class RecurrentLayer : public Layer<Dtype> {
   Blob<Dtype>* x_input_blob_;
   Blob<Dtype>* x_static_input_blob_;
   Blob<Dtype>* cont_input_blob_;
+
+  /**
+   * @brief Inputs and outputs of the active bucket, when its length differs
+   *        from the number of timesteps in bottom[0].
+   */
+  Blob<Dtype> x_bucket_;
+  Blob<Dtype> cont_bucket_;
+  vector<shared_ptr<Blob<Dtype> > > top_bucket_;
+
+  /// @brief Whether the layer runs in streaming mode, without the unrolled net.
+  bool streaming_;
+  /**
+   * @brief The recurrent state carried across forward calls in streaming mode
+   *        or with length buckets, one blob for each recurrent input, in
+   *        RecurrentInputBlobNames order.
+   */
+  vector<shared_ptr<Blob<Dtype> > > stream_state_;
 };
 
 }  // namespace caffe
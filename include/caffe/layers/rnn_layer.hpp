@@ -38,6 +38,7 @@ class RNNLayer : public RecurrentLayer<Dtype> {
   virtual void FillUnrolledNet(NetParameter* net_param) const;
   virtual void RecurrentInputBlobNames(vector<string>* names) const;
   virtual void RecurrentOutputBlobNames(vector<string>* names) const;
+  virtual void RecurrentStateBlobNames(int t, vector<string>* names) const;
   virtual void RecurrentInputShapes(vector<BlobShape>* shapes) const;
   virtual void OutputBlobNames(vector<string>* names) const;
 };
@@ -0,0 +1,89 @@
+#ifndef CAFFE_SAMPLED_SOFTMAX_LOSS_LAYER_HPP_
+#define CAFFE_SAMPLED_SOFTMAX_LOSS_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/loss_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The softmax loss of an inner product over a very large number of
+ *        classes, trained against a sampled subset of the classes.
+ *
+ * The layer holds the C x D weight (and optional bias) of the InnerProduct
+ * that would otherwise feed SoftmaxWithLoss. In the TRAIN phase each
+ * Forward draws num_sampled negative classes shared by the whole batch, and
+ * the softmax of every example runs over its true class and those samples
+ * only, with logits corrected by the log of each class's expected sample
+ * count [1]. In the TEST phase the full softmax over all C classes is used,
+ * and an optional second top receives the N x C class scores (give it a
+ * loss_weight of 0).
+ *
+ * [1] S. Jean, K. Cho, R. Memisevic and Y. Bengio, "On Using Very Large
+ *     Target Vocabulary for Neural Machine Translation." ACL 2015.
+ */
+template <typename Dtype>
+class SampledSoftmaxLossLayer : public LossLayer<Dtype> {
+ public:
+  explicit SampledSoftmaxLossLayer(const LayerParameter& param)
+      : LossLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "SampledSoftmaxLoss"; }
+  virtual inline int ExactNumTopBlobs() const { return -1; }
+  virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline int MaxTopBlobs() const { return 2; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// Only the TRAIN phase, sampled loss can be backpropagated.
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  /// Draws num_sampled classes into sampled_, with replacement.
+  virtual void SampleClasses();
+  /// log(num_sampled * Q(c)), the expected number of draws of class c.
+  Dtype LogExpectedCount(int c) const;
+  void ForwardFull_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  Dtype get_normalizer(int valid_count, int batch_size) const;
+
+  int M_;
+  int K_;
+  int C_;
+  int num_sampled_;
+  bool bias_term_;
+  bool log_uniform_;
+  bool remove_accidental_hits_;
+  bool has_ignore_label_;
+  int ignore_label_;
+  LossParameter_NormalizationMode normalization_;
+  /// Cumulative unigram weights and their sum, for the UNIGRAM sampler.
+  vector<double> unigram_cdf_;
+  double unigram_total_;
+  /// The classes drawn for the current batch and their log expected counts.
+  vector<int> sampled_;
+  vector<Dtype> sampled_log_count_;
+  /// The weight rows of the sampled classes, S x D.
+  Blob<Dtype> sampled_weight_;
+  /// Logits, then probabilities, of the sampled classes (N x S) and of each
+  /// example's true class (N).
+  Blob<Dtype> sampled_prob_;
+  Blob<Dtype> true_prob_;
+  /// The N x C scores of the TEST phase, if there is no second top.
+  Blob<Dtype> scores_;
+  int valid_count_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_SAMPLED_SOFTMAX_LOSS_LAYER_HPP_
@@ -19,7 +19,7 @@ template <typename Dtype>
 class SliceLayer : public Layer<Dtype> {
  public:
   explicit SliceLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), allow_aliasing_(false) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -28,6 +28,14 @@ class SliceLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Slice"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
+  /**
+   * When the tops are contiguous in the bottom, they become views of it.
+   * That is only the case along the batch axis, or along any axis with a
+   * batch of 1; other slices still copy.
+   */
+  virtual inline void set_allow_aliasing(bool allow) {
+    allow_aliasing_ = allow;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -39,11 +47,24 @@ class SliceLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// Makes the tops views of the bottom.
+  void AliasTops(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  inline bool data_aliased(const Blob<Dtype>* top, int i) const {
+    return i < data_views_.size() && top->data() == data_views_[i];
+  }
+  inline bool diff_aliased(const Blob<Dtype>* top, int i) const {
+    return i < diff_views_.size() && top->diff() == diff_views_[i];
+  }
+
   int count_;
   int num_slices_;
   int slice_size_;
   int slice_axis_;
   vector<int> slice_point_;
+  bool allow_aliasing_;
+  vector<shared_ptr<SyncedMemory> > data_views_;
+  vector<shared_ptr<SyncedMemory> > diff_views_;
 };
 
 }  // namespace caffe
@@ -34,6 +34,14 @@ class SPPLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  // The fused engine pools every pyramid level straight into the top,
+  // without the internal layers and their blobs.
+  void ReshapeFused(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  void ForwardFused_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  void BackwardFused_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<Blob<Dtype>*>& bottom);
   // calculates the kernel and stride dimensions for the pooling layer,
   // returns a correctly configured LayerParameter for a PoolingLayer
   virtual LayerParameter GetPoolingParam(const int pyramid_level,
@@ -46,6 +54,15 @@ class SPPLayer : public Layer<Dtype> {
   int kernel_h_, kernel_w_;
   int pad_h_, pad_w_;
   bool reshaped_first_time_;
+  bool fused_;
+
+  /// Per pyramid level: pooled height and width, kernel height and width,
+  /// pad height and width, and the level's offset within a top row.
+  enum { kPooledH, kPooledW, kKernelH, kKernelW, kPadH, kPadW, kOffset,
+      kLevelParams };
+  Blob<int> levels_;
+  /// the argmax of every top element for max pooling
+  Blob<int> max_idx_;
 
   /// the internal Split layer that feeds the pooling layers
   shared_ptr<SplitLayer<Dtype> > split_layer_;
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/layers/pooling_layer.hpp"
 
 namespace caffe {
 
@@ -33,6 +34,7 @@ class UpsampleLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  inline int MaskIndex(const Dtype* mask, int i) const;
 
   int channels_;
   int height_;
@@ -40,6 +42,12 @@ class UpsampleLayer : public Layer<Dtype> {
   int scale_h_, scale_w_;
   bool pad_out_h_, pad_out_w_;
   int upsample_h_, upsample_w_;
+  // Whether the mask holds packed in-window offsets, and the geometry of
+  // the pooling that wrote them.
+  bool offset_mask_;
+  int mask_kernel_w_;
+  int mask_stride_h_, mask_stride_w_;
+  int mask_pad_h_, mask_pad_w_;
 };
 
 }  // namespace caffe
@@ -31,6 +31,11 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   virtual void ClipGradients();
+  // The ranges [offsets[i], offsets[i] + count) of param_id that the CPU
+  // update visits: each touched row of a row-sparse param (see
+  // Blob::set_sparse_diff), else the whole param. Momentum and other
+  // history of untouched rows is left as is until they are touched again.
+  void DiffRanges(int param_id, vector<int>* offsets, int* count);
   virtual void SnapshotSolverState(const string& model_filename);
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
@@ -107,6 +107,9 @@ class Solver {
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
   void DisplayOutputBlobs(const int net_id);
+  // Logs and resets the pipeline counters of the prefetching data layers.
+  // lapse is the wall time in ms the counters were accumulated over.
+  void DisplayPrefetchStats(const float lapse);
   void UpdateSmoothedLoss(Dtype loss, int start_iter, int average_loss);
 
   SolverParameter param_;
@@ -58,6 +58,12 @@ class SyncedMemory {
  public:
   SyncedMemory();
   explicit SyncedMemory(size_t size);
+  /**
+   * @brief A view of size bytes of parent, starting offset bytes in. The view
+   *        owns no memory: data and synchronization state are the parent's.
+   */
+  SyncedMemory(const shared_ptr<SyncedMemory>& parent, size_t offset,
+      size_t size);
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
@@ -66,8 +72,9 @@ class SyncedMemory {
   void* mutable_cpu_data();
   void* mutable_gpu_data();
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
-  SyncedHead head() { return head_; }
+  SyncedHead head() { return parent_ ? parent_->head() : head_; }
   size_t size() { return size_; }
+  bool is_view() const { return parent_ != NULL; }
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -86,6 +93,8 @@ class SyncedMemory {
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
   int device_;
+  shared_ptr<SyncedMemory> parent_;
+  size_t offset_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
@@ -0,0 +1,161 @@
+#ifndef CAFFE_UTIL_DETECTION_HPP_
+#define CAFFE_UTIL_DETECTION_HPP_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Boxes (center x, center y, width, height in image coordinates) with
+ * a score and a label, stored as a structure of arrays.
+ *
+ * Clear() keeps the capacity, so users that Reserve() the largest number of
+ * boxes they will see do not allocate per image.
+ */
+template <typename Dtype>
+struct DetectionBoxes {
+  void Reserve(int capacity);
+  void Clear();
+  void Push(Dtype x, Dtype y, Dtype w, Dtype h, Dtype score, int label);
+  inline int size() const { return label.size(); }
+
+  vector<Dtype> x;
+  vector<Dtype> y;
+  vector<Dtype> w;
+  vector<Dtype> h;
+  vector<Dtype> score;
+  vector<int> label;
+};
+
+/**
+ * @brief Returns the side of the square grid of an output with input_dim
+ * values per image, so that detection layers follow the input resolution
+ * (e.g. in multi-scale training) instead of a fixed side parameter.
+ */
+int GridSide(int input_dim, int num_class, int num_object);
+
+/**
+ * Sparse detection labels hold the number of objects of an image followed
+ * by a fixed number of (cell, class, difficult, x, y, w, h) entries, instead
+ * of dense difficult, isobj, class and box planes over all cells. Layers
+ * are told the format by their sparse_label parameter.
+ */
+const int kSparseLabelEntry = 7;
+
+/**
+ * @brief Checks label_dim against the declared label format and returns the
+ * number of objects a label can hold: the entries of a sparse label, or the
+ * side x side cells of a dense one.
+ */
+inline int LabelCapacity(int label_dim, int side, bool sparse) {
+  if (sparse) {
+    CHECK_EQ((label_dim - 1) % kSparseLabelEntry, 0)
+        << "A sparse label is an object count followed by entries of "
+        << kSparseLabelEntry << " values";
+    return (label_dim - 1) / kSparseLabelEntry;
+  }
+  // label: difficult, isobj, class_label, coordinates
+  CHECK_EQ(label_dim, side * side * (1 + 1 + 1 + 4))
+      << "Dense label size does not match the grid; set sparse_label for "
+      << "sparse labels";
+  return side * side;
+}
+
+/**
+ * @brief Decodes the side x side x num_object predictors of one image of a
+ * YOLO-style grid output (classes, confidences, then boxes, each stored
+ * plane by plane) into boxes labelled with the most probable class of their
+ * cell. Predictors scoring below score_threshold are dropped. boxes is
+ * cleared first.
+ */
+template <typename Dtype>
+void DecodeGridBoxes(const Dtype* input, int side, int num_class,
+    int num_object, bool use_sqrt, bool constriant,
+    EvalDetectionParameter_ScoreType score_type, Dtype score_threshold,
+    DetectionBoxes<Dtype>* boxes);
+
+/**
+ * @brief IoU of the box (x1, y1, x2, y2) against n boxes given by their
+ * corner and area arrays. The loop has no branches so that it vectorizes.
+ */
+template <typename Dtype>
+void BoxIoUs(Dtype x1, Dtype y1, Dtype x2, Dtype y2, Dtype area,
+    const Dtype* xs1, const Dtype* ys1, const Dtype* xs2, const Dtype* ys2,
+    const Dtype* areas, int n, Dtype* iou);
+
+/**
+ * @brief Greedy non-maximum suppression with a preallocated workspace.
+ *
+ * Candidates are ranked by descending score and only the top_k best are
+ * considered (all of them if top_k < 0). A box is suppressed when its IoU
+ * with a kept, higher scoring box is at least threshold; with per_class only
+ * boxes of the same label suppress each other. A negative threshold disables
+ * suppression. Kept boxes are ordered by label, then by descending score.
+ */
+template <typename Dtype>
+class BoxNms {
+ public:
+  BoxNms(Dtype threshold, bool per_class, int top_k);
+
+  void Reserve(int capacity);
+  void Apply(const DetectionBoxes<Dtype>& boxes, DetectionBoxes<Dtype>* kept);
+
+ protected:
+  void Gather(const DetectionBoxes<Dtype>& boxes, int n);
+  inline bool suppressed(int i) const {
+    return (suppressed_[i / 64] >> (i % 64)) & 1;
+  }
+
+  const Dtype threshold_;
+  const bool per_class_;
+  const int top_k_;
+
+  // Candidate indices, best first.
+  vector<int> order_;
+  // Candidates in rank order, as corners and areas.
+  vector<Dtype> x1_, y1_, x2_, y2_, area_;
+  vector<int> label_;
+  vector<uint64_t> suppressed_;
+  vector<Dtype> iou_;
+  vector<int> keep_;
+};
+
+/**
+ * @brief Accumulates EvalDetectionLayer outputs over a test pass into per
+ * class score histograms and computes VOC-style average precision.
+ *
+ * Each image contributes the non-difficult ground truth count of every class
+ * followed by (label, score, true positive, false positive) rows. Rows are
+ * binned by score, so memory is bounded by num_class x num_bins whatever the
+ * number of images, and detections are ranked to a precision of one bin.
+ */
+template <typename Dtype>
+class DetectionAPAccumulator {
+ public:
+  DetectionAPAccumulator(int num_class, int num_bins,
+      EvalDetectionParameter_APVersion version);
+
+  void Reset();
+  // Merges the outputs of num images of dim values each.
+  void Add(const Dtype* rows, int num, int dim);
+  // AP of a class, or -1 if it has no ground truth.
+  Dtype AP(int c) const;
+  // Mean of the APs of the classes that have ground truth.
+  Dtype MeanAP() const;
+
+ protected:
+  const int num_class_;
+  const int num_bins_;
+  const EvalDetectionParameter_APVersion version_;
+  vector<double> num_gt_;
+  // num_class x num_bins counts, bin 0 holding the lowest scores.
+  vector<double> tp_;
+  vector<double> fp_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DETECTION_HPP_
@@ -1,6 +1,7 @@
 #ifndef CAFFE_UTIL_HDF5_H_
 #define CAFFE_UTIL_HDF5_H_
 
+#include <boost/thread/recursive_mutex.hpp>
 #include <string>
 
 #include "hdf5.h"
@@ -10,6 +11,11 @@
 
 namespace caffe {
 
+// libhdf5 is usually built without its thread-safe option, while the HDF5
+// layers call it from their own threads.  Hold this lock around every HDF5
+// call; it is recursive since e.g. restoring a solver state loads its net.
+boost::recursive_mutex& hdf5_mutex();
+
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
@@ -20,11 +26,26 @@ void hdf5_load_nd_dataset(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob, bool reshape = false);
 
+// Returns the size of the first axis of a dataset.
+hsize_t hdf5_get_num_rows(hid_t file_id, const char* dataset_name_);
+
+// Reads rows [start, start + num) of a dataset, reshaping blob to hold them.
+template <typename Dtype>
+void hdf5_load_nd_dataset_rows(
+    hid_t file_id, const char* dataset_name_, hsize_t start, hsize_t num,
+    Blob<Dtype>* blob);
+
 template <typename Dtype>
 void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
     bool write_diff = false);
 
+// Appends the rows of blob to a dataset with an unlimited first axis,
+// creating it with chunks of one blob if it does not exist yet.
+template <typename Dtype>
+void hdf5_append_nd_dataset(
+    hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob);
+
 int hdf5_load_int(hid_t loc_id, const string& dataset_name);
 void hdf5_save_int(hid_t loc_id, const string& dataset_name, int i);
 string hdf5_load_string(hid_t loc_id, const string& dataset_name);
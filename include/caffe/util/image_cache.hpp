@@ -0,0 +1,100 @@
+#ifndef CAFFE_UTIL_IMAGE_CACHE_HPP_
+#define CAFFE_UTIL_IMAGE_CACHE_HPP_
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A bounded cache of decoded (and optionally pre-resized) uint8
+ * images, so that image list data layers only pay for JPEG/PNG decoding
+ * during the first epoch.
+ *
+ * Pixels are stored in a single arena allocated at construction and divided
+ * into fixed-size blocks; an image occupies as many blocks as it needs, so
+ * the cache never allocates after setup. Layers that refer to the same cache
+ * name (e.g. the copies of a data layer in every solver of a multi-GPU run)
+ * share one instance and one arena through ImageCache::Get().
+ *
+ * Cached images are copied out on lookup, so random crops, mirrors or any
+ * in-place modification of the returned cv::Mat are still applied per
+ * sample and never affect the cached copy.
+ */
+class ImageCache {
+ public:
+  explicit ImageCache(const ImageCacheParameter& param);
+
+  /**
+   * @brief Returns the cache shared by all layers using the same name,
+   * creating it if needed. The cache is released when its last user is.
+   */
+  static shared_ptr<ImageCache> Get(const string& name,
+      const ImageCacheParameter& param);
+
+#ifdef USE_OPENCV
+  /**
+   * @brief Reads an image through the cache. On a miss the image is decoded
+   * with ReadImageToCVMat and inserted; the key includes the requested size,
+   * color mode and interpolation, so the same file can be cached at several
+   * resolutions.
+   */
+  cv::Mat ReadImage(const string& filename, const int height,
+      const int width, const bool is_color,
+      const bool nearest_neighbour_interp = false);
+
+  // Copies the cached image into img. Returns false on a miss.
+  bool Lookup(const string& key, cv::Mat* img);
+  // Stores a copy of img. Returns false if the image could not be cached,
+  // e.g. because it does not fit or the policy does not allow eviction.
+  bool Insert(const string& key, const cv::Mat& img);
+#endif  // USE_OPENCV
+
+  inline size_t capacity() const { return block_size_ * num_blocks_; }
+  size_t size() const;
+  size_t hits() const;
+  size_t misses() const;
+
+ protected:
+  struct Entry {
+    int rows;
+    int cols;
+    int type;
+    size_t bytes;
+    vector<int> blocks;
+    std::list<string>::iterator lru;
+  };
+
+  // Evicts least recently used entries until n blocks are free.
+  // Must be called with the mutex held.
+  bool Reserve(int n);
+  void Evict(const string& key);
+
+  const ImageCacheParameter param_;
+  const size_t block_size_;
+  const int num_blocks_;
+  vector<uint8_t> arena_;
+  vector<int> free_blocks_;
+  map<string, Entry> entries_;
+  // Most recently used entries at the front.
+  std::list<string> lru_;
+  size_t hits_;
+  size_t misses_;
+  bool full_logged_;
+
+  class sync;
+  shared_ptr<sync> sync_;
+
+  static map<const string, boost::weak_ptr<ImageCache> > caches_;
+
+DISABLE_COPY_AND_ASSIGN(ImageCache);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IMAGE_CACHE_HPP_
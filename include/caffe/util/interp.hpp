@@ -4,6 +4,8 @@
 #define CAFFE_UTIL_INTERP_H_
 
 #include <cublas_v2.h>
+#include <vector>
+
 #include "caffe/proto/caffe.pb.h"
 
 namespace caffe {
@@ -33,6 +35,37 @@ void caffe_gpu_interp2_backward(const int channels,
 	  Dtype *data1, const int x1, const int y1, const int height1, const int width1, const int Height1, const int Width1,
     const Dtype *data2, const int x2, const int y2, const int height2, const int width2, const int Height2, const int Width2);
 
+// Source rows, columns and weights of every output row and column of a
+// non-packed bi-linear interpolation. Setup takes the geometry arguments of
+// caffe_cpu_interp2 and is meant to run once per reshape.
+template <typename Dtype>
+struct Interp2Tables {
+  void Setup(const int x1, const int y1, const int height1, const int width1, const int Height1, const int Width1,
+      const int x2, const int y2, const int height2, const int width2, const int Height2, const int Width2);
+
+  int size1, size2;
+  // Offset of the first output pixel in data2.
+  int offset2;
+  int height2, width2, Width2;
+  // Offsets of the two source rows in a data1 plane, and their weights.
+  std::vector<int> row0, row1;
+  std::vector<Dtype> h0lambda, h1lambda;
+  // The two source columns, and their weights.
+  std::vector<int> col0, col1;
+  std::vector<Dtype> w0lambda, w1lambda;
+};
+
+// Same as the non-packed caffe_cpu_interp2 and caffe_cpu_interp2_backward,
+// walking each channel row by row with the precomputed tables. Channels are
+// independent, so both directions run in parallel over them with OpenMP.
+template <typename Dtype>
+void caffe_cpu_interp2(const int channels, const Interp2Tables<Dtype>& tables,
+    const Dtype *data1, Dtype *data2);
+
+template <typename Dtype>
+void caffe_cpu_interp2_backward(const int channels, const Interp2Tables<Dtype>& tables,
+    Dtype *data1, const Dtype *data2);
+
 // Create Gaussian pyramid of an image. Assume output space is pre-allocated.
 // IN : [channels height width]
 template <typename Dtype, bool packed>
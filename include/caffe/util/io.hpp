@@ -140,6 +140,8 @@ cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color,
     const bool nearest_neighbour_interp);
     
+// Resizes to height x width when both are set. JPEGs are then decoded at
+// reduced resolution when the target is at least 2x smaller.
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color);
 
@@ -149,6 +151,14 @@ cv::Mat ReadImageToCVMat(const string& filename,
 bool ReadBoxDataToDatum(const std::string& filename, const std::string& annoname,
     const std::map<std::string, int>& label_map, const int height, const int width, 
     const bool is_color, const std::string & encoding, Datum* datum);
+
+// Resizes to height x width when both are set, otherwise shrinks the image so
+// that its longer side is at most max_side (if set), keeping the aspect ratio.
+// Box coordinates are relative to the image, so resizing leaves them valid.
+bool ReadBoxDataToDatum(const std::string& filename,
+    const std::string& annoname, const std::map<std::string, int>& label_map,
+    const int height, const int width, const int max_side,
+    const bool is_color, const std::string& encoding, Datum* datum);
     
 cv::Mat ReadImageToCVMat(const string& filename,
     const bool is_color);
@@ -157,6 +167,14 @@ cv::Mat ReadImageToCVMat(const string& filename);
 
 cv::Mat DecodeDatumToCVMatNative(const Datum& datum);
 cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color);
+// Decode for callers that crop or resize the image right after and need at
+// least min_height x min_width pixels: JPEGs are decoded at 1/2, 1/4 or 1/8
+// of their stored resolution when that still covers the minimum size. The
+// result is not resized.
+cv::Mat DecodeDatumToCVMatNative(const Datum& datum, const int min_height,
+    const int min_width);
+cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color,
+    const int min_height, const int min_width);
 
 void CVMatToDatum(const cv::Mat& cv_img, Datum* datum);
 #endif  // USE_OPENCV
@@ -91,7 +91,7 @@ void Blob<Dtype>::set_cpu_data(Dtype* data) {
   CHECK(data);
   // Make sure CPU and GPU sizes remain equal
   size_t size = count_ * sizeof(Dtype);
-  if (data_->size() != size) {
+  if (data_->size() != size || data_->is_view()) {
     data_.reset(new SyncedMemory(size));
     diff_.reset(new SyncedMemory(size));
   }
@@ -109,7 +109,7 @@ void Blob<Dtype>::set_gpu_data(Dtype* data) {
   CHECK(data);
   // Make sure CPU and GPU sizes remain equal
   size_t size = count_ * sizeof(Dtype);
-  if (data_->size() != size) {
+  if (data_->size() != size || data_->is_view()) {
     data_.reset(new SyncedMemory(size));
     diff_.reset(new SyncedMemory(size));
   }
@@ -162,6 +162,67 @@ template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
   diff_ = other.diff();
+  diff_rows_ = other.diff_rows_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_sparse_diff(bool sparse) {
+  if (!sparse) {
+    diff_rows_.reset();
+  } else if (!diff_rows_) {
+    CHECK_GT(num_axes(), 0) << "Row-sparse diffs need at least one axis.";
+    diff_rows_.reset(new DiffRows());
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::touch_diff_row(int row) {
+  CHECK(diff_rows_) << "The diff is not row-sparse.";
+  DCHECK_GE(row, 0);
+  DCHECK_LT(row, shape(0));
+  vector<bool>& touched = diff_rows_->touched;
+  if (row >= static_cast<int>(touched.size())) {
+    touched.resize(shape(0), false);
+  }
+  if (!touched[row]) {
+    touched[row] = true;
+    diff_rows_->rows.push_back(row);
+  }
+}
+
+template <typename Dtype>
+const vector<int>& Blob<Dtype>::diff_rows() const {
+  CHECK(diff_rows_) << "The diff is not row-sparse.";
+  return diff_rows_->rows;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::clear_diff_rows() {
+  CHECK(diff_rows_) << "The diff is not row-sparse.";
+  vector<int>& rows = diff_rows_->rows;
+  for (int i = 0; i < rows.size(); ++i) {
+    diff_rows_->touched[rows[i]] = false;
+  }
+  rows.clear();
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDataView(const Blob& other, int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  data_.reset(new SyncedMemory(other.data(), offset * sizeof(Dtype),
+      count_ * sizeof(Dtype)));
+  // Growing past the view must not run into the rest of other.
+  capacity_ = count_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDiffView(const Blob& other, int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  diff_.reset(new SyncedMemory(other.diff(), offset * sizeof(Dtype),
+      count_ * sizeof(Dtype)));
+  capacity_ = count_;
 }
 
 // The "update" method is used for parameter blobs in a Net, which are stored
@@ -13,6 +13,56 @@
 
 namespace caffe {
 
+// Widens one row of a channel from uint8, subtracts the mean (a row of the
+// mean blob, or a constant when mean is NULL), scales it and stores it
+// forward or mirrored. src is read with a stride, so interleaved (HWC)
+// images are transposed to CHW on the fly. Each case has its own branch-free
+// loop so that the compiler can vectorize it.
+template <typename Dtype>
+static void TransformRow(const uint8_t* src, const int stride,
+    const int width, const Dtype* mean, const Dtype mean_value,
+    const Dtype scale, const bool mirror, Dtype* dst) {
+  if (mirror) {
+    Dtype* dst_end = dst + width - 1;
+    if (mean) {
+      for (int w = 0; w < width; ++w) {
+        dst_end[-w] = (static_cast<Dtype>(src[w * stride]) - mean[w]) * scale;
+      }
+    } else {
+      for (int w = 0; w < width; ++w) {
+        dst_end[-w] = (static_cast<Dtype>(src[w * stride]) - mean_value) *
+            scale;
+      }
+    }
+  } else {
+    if (mean) {
+      for (int w = 0; w < width; ++w) {
+        dst[w] = (static_cast<Dtype>(src[w * stride]) - mean[w]) * scale;
+      }
+    } else {
+      for (int w = 0; w < width; ++w) {
+        dst[w] = (static_cast<Dtype>(src[w * stride]) - mean_value) * scale;
+      }
+    }
+  }
+}
+
+// Copies one row of a channel forward or mirrored, with the same strided
+// access as TransformRow but without normalization.
+static void CopyRow(const uint8_t* src, const int stride, const int width,
+    const bool mirror, uint8_t* dst) {
+  if (mirror) {
+    uint8_t* dst_end = dst + width - 1;
+    for (int w = 0; w < width; ++w) {
+      dst_end[-w] = src[w * stride];
+    }
+  } else {
+    for (int w = 0; w < width; ++w) {
+      dst[w] = src[w * stride];
+    }
+  }
+}
+
 template<typename Dtype>
 DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
     Phase phase)
@@ -94,6 +144,21 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
     }
   }
 
+  if (has_uint8) {
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(data.data());
+    for (int c = 0; c < datum_channels; ++c) {
+      const Dtype mean_value = has_mean_values ? mean_values_[c] : Dtype(0);
+      for (int h = 0; h < height; ++h) {
+        const int data_index =
+            (c * datum_height + h_off + h) * datum_width + w_off;
+        TransformRow(src + data_index, 1, width,
+            has_mean_file ? mean + data_index : NULL, mean_value, scale,
+            do_mirror, transformed_data + (c * height + h) * width);
+      }
+    }
+    return;
+  }
+
   Dtype datum_element;
   int top_index, data_index;
   for (int c = 0; c < datum_channels; ++c) {
@@ -147,6 +212,23 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
     ori_labels.push_back(box_label);
   }
 
+  // The box crop is resized to the blob; a crop_size window on top of it
+  // would cut boxes without adjusting their labels.
+  CHECK_EQ(param_.crop_size(), 0)
+      << "crop_size is not supported for box data, samples are resized";
+  const int channels = transformed_blob->channels();
+  const int height = transformed_blob->height();
+  const int width = transformed_blob->width();
+  // The sample is resized to the blob, so the image only needs enough pixels
+  // for the smallest crop (71% of each side minus one, see below) to cover
+  // it. Rounded up, with a pixel to spare for the float crop scale.
+  int min_height = height;
+  int min_width = width;
+  if (phase_ == TRAIN) {
+    min_height = ((height + 2) * 100 + 70) / 71;
+    min_width = ((width + 2) * 100 + 70) / 71;
+  }
+
   // If datum is encoded, decoded and transform the cv::image.
   CHECK(datum.encoded()) << "For box data, datum must be encoded";
   CHECK(!(param_.force_color() && param_.force_gray()))
@@ -154,29 +236,31 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   cv::Mat cv_img;
   if (param_.force_color() || param_.force_gray()) {
   // If force_color then decode in color otherwise decode in gray.
-    cv_img = DecodeDatumToCVMat(datum, param_.force_color());
+    cv_img = DecodeDatumToCVMat(datum, param_.force_color(), min_height,
+        min_width);
   } else {
-    cv_img = DecodeDatumToCVMatNative(datum);
-  }
-
-  if (phase_ == TEST) {
-    *box_labels = ori_labels;
-    Transform(cv_img, transformed_blob);
-    return;
+    cv_img = DecodeDatumToCVMatNative(datum, min_height, min_width);
   }
+  CHECK(cv_img.data) << "Could not decode box datum";
+  CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
 
-  int img_width = cv_img.cols;
-  int img_height = cv_img.rows;
+  // Box labels are relative to the image, so a reduced decode leaves them
+  // valid.
+  const int img_channels = cv_img.channels();
+  const int img_width = cv_img.cols;
+  const int img_height = cv_img.rows;
+  CHECK_EQ(channels, img_channels);
 
-  cv::Mat cv_rand_img;
-  // bool mirror = Rand(2);
-  bool mirror = 0;
-  while (box_labels->size() == 0) {
+  // Sample a crop of 71% to 100% of the image that keeps at least one box
+  // center. Crops that miss every box are retried a bounded number of times
+  // before falling back to the whole image, which keeps all boxes.
+  const int kMaxTrials = 50;
+  cv::Rect roi(0, 0, img_width, img_height);
+  box_labels->clear();
+  for (int trial = 0; phase_ == TRAIN && trial < kMaxTrials; ++trial) {
     float rand_scale = (1. - Rand(30) / 100.);
     int rand_w = static_cast<int>(img_width * rand_scale) - 1;
     int rand_h = static_cast<int>(img_height * rand_scale) - 1;
-    // LOG(INFO) << "rand_w: " << rand_w << " rand_h: " << rand_h;
-    // LOG(INFO) << "img_width: " << img_width << " img_height: " << img_height;
     int rand_x = Rand(img_width - rand_w);
     int rand_y = Rand(img_height - rand_h);
     for (int i = 0; i < ori_labels.size(); ++i) {
@@ -197,35 +281,58 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
       box_label.box_[1] = float(ori_y - rand_y) / float(rand_h);
       box_label.box_[2] = float(ori_w) / float(rand_w);
       box_label.box_[3] = float(ori_h) / float(rand_h);
-      // int xmin = std::max(ori_x - ori_w / 2, rand_x);
-      // int ymin = std::max(ori_y - ori_h / 2, rand_y);
-      // int xmax = std::min(ori_x + ori_w / 2, rand_x + rand_w);
-      // int ymax = std::min(ori_y + ori_h / 2, rand_y + rand_h);
-      // if (xmin > xmax || ymin > ymax) {
-      //   continue;
-      // }
-      // box_label.box_[0] = float(xmin + (xmax - xmin) / 2) / float(rand_w);
-      // box_label.box_[1] = float(ymin + (ymax - ymin) / 2) / float(rand_h);
-      // box_label.box_[2] = float(xmax - xmin) / float(rand_w);
-      // box_label.box_[3] = float(ymax - ymin) / float(rand_h);
-      if (mirror) {
-        box_label.box_[0] = std::max(0., 1. - box_label.box_[0]);
-        box_label.box_[1] = std::max(0., 1. - box_label.box_[1]);
-      }
       box_labels->push_back(box_label);
     }
     if (box_labels->size() > 0) {
-      cv::Rect roi(rand_x, rand_y, rand_w, rand_h); 
-      cv_rand_img = cv_img(roi);
-      if (mirror) {
-        cv::flip(cv_rand_img, cv_rand_img, 1); // horizen flip
+      roi = cv::Rect(rand_x, rand_y, rand_w, rand_h);
+      break;
+    }
+  }
+  if (box_labels->size() == 0) {
+    *box_labels = ori_labels;
+  }
+
+  // Resize the crop straight to the network input, then normalize and
+  // mirror it into the blob in a single pass.
+  cv::Mat cv_sample = cv_img(roi);
+  if (roi.width != width || roi.height != height) {
+    cv::resize(cv_sample, cv_sample, cv::Size(width, height));
+  }
+  const bool do_mirror = param_.mirror() && Rand(2);
+  if (do_mirror) {
+    for (int i = 0; i < box_labels->size(); ++i) {
+      (*box_labels)[i].box_[0] = 1. - (*box_labels)[i].box_[0];
+    }
+  }
+  const Dtype scale = param_.scale();
+  const Dtype* mean = NULL;
+  if (param_.has_mean_file()) {
+    CHECK_EQ(channels, data_mean_.channels());
+    CHECK_EQ(height, data_mean_.height());
+    CHECK_EQ(width, data_mean_.width());
+    mean = data_mean_.cpu_data();
+  }
+  if (mean_values_.size() > 0) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == channels) <<
+     "Specify either 1 mean_value or as many as channels: " << channels;
+    if (channels > 1 && mean_values_.size() == 1) {
+      // Replicate the mean_value for simplicity
+      for (int c = 1; c < channels; ++c) {
+        mean_values_.push_back(mean_values_[0]);
       }
     }
   }
-  cv::resize(cv_rand_img, cv_rand_img, cv::Size(img_width, img_height));
-  // Transform the cv::image into blob.
-  Transform(cv_rand_img, transformed_blob);
-  return;
+  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
+  for (int h = 0; h < height; ++h) {
+    const uchar* ptr = cv_sample.ptr<uchar>(h);
+    for (int c = 0; c < channels; ++c) {
+      const Dtype mean_value = mean_values_.size() > 0 ?
+          mean_values_[c] : Dtype(0);
+      TransformRow(ptr + c, channels, width,
+          mean ? mean + (c * height + h) * width : NULL, mean_value, scale,
+          do_mirror, transformed_data + (c * height + h) * width);
+    }
+  }
 }
 
 template<typename Dtype>
@@ -395,32 +502,15 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
   CHECK(cv_cropped_img.data);
 
   Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  int top_index;
   for (int h = 0; h < height; ++h) {
     const uchar* ptr = cv_cropped_img.ptr<uchar>(h);
-    int img_index = 0;
-    for (int w = 0; w < width; ++w) {
-      for (int c = 0; c < img_channels; ++c) {
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        // int top_index = (c * height + h) * width + w;
-        Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
-        if (has_mean_file && !preserve_pixel_vals) {
-          int mean_index = (c * img_height + h_off + h) * img_width + w_off + w;
-          transformed_data[top_index] =
-            (pixel - mean[mean_index]) * scale;
-        } else {
-          if (has_mean_values && !preserve_pixel_vals) {
-            transformed_data[top_index] =
-              (pixel - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = pixel * scale;
-          }
-        }
-      }
+    for (int c = 0; c < img_channels; ++c) {
+      const Dtype mean_value = (has_mean_values && !preserve_pixel_vals) ?
+          mean_values_[c] : Dtype(0);
+      TransformRow(ptr + c, img_channels, width,
+          mean ? mean + (c * img_height + h_off + h) * img_width + w_off : NULL,
+          mean_value, scale, do_mirror,
+          transformed_data + (c * height + h) * width);
     }
   }
 }
@@ -428,57 +518,89 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
                                        Blob<Dtype>* transformed_blob) {
+  Transform(cv_img, transformed_blob, false);
+}
+#endif  // USE_OPENCV
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformRaw(const Datum& datum,
+                                          uint8_t* transformed_data) {
+  if (datum.encoded()) {
+#ifdef USE_OPENCV
+    CHECK(!(param_.force_color() && param_.force_gray()))
+        << "cannot set both force_color and force_gray";
+    cv::Mat cv_img;
+    if (param_.force_color() || param_.force_gray()) {
+    // If force_color then decode in color otherwise decode in gray.
+      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
+    } else {
+      cv_img = DecodeDatumToCVMatNative(datum);
+    }
+    return TransformRaw(cv_img, transformed_data);
+#else
+    LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
+#endif  // USE_OPENCV
+  }
+  const string& data = datum.data();
+  const int datum_channels = datum.channels();
+  const int datum_height = datum.height();
+  const int datum_width = datum.width();
   const int crop_size = param_.crop_size();
-  const int img_channels = cv_img.channels();
-  const int img_height = cv_img.rows;
-  const int img_width = cv_img.cols;
+  const bool do_mirror = param_.mirror() && Rand(2);
 
-  // Check dimensions.
-  const int channels = transformed_blob->channels();
-  const int height = transformed_blob->height();
-  const int width = transformed_blob->width();
-  const int num = transformed_blob->num();
+  CHECK_GT(data.size(), 0) << "uint8 batches need uint8 Datum data";
+  CHECK_GT(datum_channels, 0);
+  CHECK_GE(datum_height, crop_size);
+  CHECK_GE(datum_width, crop_size);
 
-  CHECK_EQ(channels, img_channels);
-  CHECK_LE(height, img_height);
-  CHECK_LE(width, img_width);
-  CHECK_GE(num, 1);
+  int height = datum_height;
+  int width = datum_width;
+  int h_off = 0;
+  int w_off = 0;
+  if (crop_size) {
+    height = crop_size;
+    width = crop_size;
+    // We only do random crop when we do training.
+    if (phase_ == TRAIN) {
+      h_off = Rand(datum_height - crop_size + 1);
+      w_off = Rand(datum_width - crop_size + 1);
+    } else {
+      h_off = (datum_height - crop_size) / 2;
+      w_off = (datum_width - crop_size) / 2;
+    }
+  }
 
-  CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
+  const uint8_t* src = reinterpret_cast<const uint8_t*>(data.data());
+  for (int c = 0; c < datum_channels; ++c) {
+    for (int h = 0; h < height; ++h) {
+      CopyRow(src + (c * datum_height + h_off + h) * datum_width + w_off, 1,
+          width, do_mirror, transformed_data + (c * height + h) * width);
+    }
+  }
+}
 
-  const Dtype scale = param_.scale();
+#ifdef USE_OPENCV
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformRaw(const cv::Mat& cv_img,
+                                          uint8_t* transformed_data) {
+  const int img_channels = cv_img.channels();
+  const int img_height = cv_img.rows;
+  const int img_width = cv_img.cols;
+  const int crop_size = param_.crop_size();
   const bool do_mirror = param_.mirror() && Rand(2);
-  const bool has_mean_file = param_.has_mean_file();
-  const bool has_mean_values = mean_values_.size() > 0;
 
+  CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
   CHECK_GT(img_channels, 0);
   CHECK_GE(img_height, crop_size);
   CHECK_GE(img_width, crop_size);
 
-  Dtype* mean = NULL;
-  if (has_mean_file) {
-    CHECK_EQ(img_channels, data_mean_.channels());
-    CHECK_EQ(img_height, data_mean_.height());
-    CHECK_EQ(img_width, data_mean_.width());
-    mean = data_mean_.mutable_cpu_data();
-  }
-  if (has_mean_values) {
-    CHECK(mean_values_.size() == 1 || mean_values_.size() == img_channels) <<
-     "Specify either 1 mean_value or as many as channels: " << img_channels;
-    if (img_channels > 1 && mean_values_.size() == 1) {
-      // Replicate the mean_value for simplicity
-      for (int c = 1; c < img_channels; ++c) {
-        mean_values_.push_back(mean_values_[0]);
-      }
-    }
-  }
-
+  int height = img_height;
+  int width = img_width;
   int h_off = 0;
   int w_off = 0;
-  cv::Mat cv_cropped_img = cv_img;
   if (crop_size) {
-    CHECK_EQ(crop_size, height);
-    CHECK_EQ(crop_size, width);
+    height = crop_size;
+    width = crop_size;
     // We only do random crop when we do training.
     if (phase_ == TRAIN) {
       h_off = Rand(img_height - crop_size + 1);
@@ -487,42 +609,13 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
       h_off = (img_height - crop_size) / 2;
       w_off = (img_width - crop_size) / 2;
     }
-    cv::Rect roi(w_off, h_off, crop_size, crop_size);
-    cv_cropped_img = cv_img(roi);
-  } else {
-    CHECK_EQ(img_height, height);
-    CHECK_EQ(img_width, width);
   }
 
-  CHECK(cv_cropped_img.data);
-
-  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  int top_index;
   for (int h = 0; h < height; ++h) {
-    const uchar* ptr = cv_cropped_img.ptr<uchar>(h);
-    int img_index = 0;
-    for (int w = 0; w < width; ++w) {
-      for (int c = 0; c < img_channels; ++c) {
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        // int top_index = (c * height + h) * width + w;
-        Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
-        if (has_mean_file) {
-          int mean_index = (c * img_height + h_off + h) * img_width + w_off + w;
-          transformed_data[top_index] =
-            (pixel - mean[mean_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (pixel - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = pixel * scale;
-          }
-        }
-      }
+    const uchar* ptr = cv_img.ptr<uchar>(h_off + h) + w_off * img_channels;
+    for (int c = 0; c < img_channels; ++c) {
+      CopyRow(ptr + c, img_channels, width, do_mirror,
+          transformed_data + (c * height + h) * width);
     }
   }
 }
@@ -7,6 +7,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
@@ -38,7 +39,8 @@ BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
       prefetch_(param.data_param().prefetch()),
-      prefetch_free_(), prefetch_full_(), prefetch_current_() {
+      prefetch_free_(), prefetch_full_(), prefetch_current_(),
+      uint8_batch_(param.transform_param().uint8_batch()) {
   for (int i = 0; i < prefetch_.size(); ++i) {
     prefetch_[i].reset(new Batch<Dtype>());
     prefetch_free_.push(prefetch_[i].get());
@@ -49,26 +51,58 @@ template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   BaseDataLayer<Dtype>::LayerSetUp(bottom, top);
+  if (uint8_batch_) {
+    CHECK(SupportsUint8Batch())
+        << this->type() << " layer does not support uint8_batch";
+    CHECK(!this->transform_param_.has_mean_file())
+        << "uint8_batch only supports mean_value";
+    const int channels = top[0]->shape(1);
+    const int num_means = this->transform_param_.mean_value_size();
+    CHECK(num_means <= 1 || num_means == channels) <<
+        "Specify either 1 mean_value or as many as channels: " << channels;
+    batch_mean_.Reshape(vector<int>(1, channels));
+    Dtype* mean = batch_mean_.mutable_cpu_data();
+    for (int c = 0; c < channels; ++c) {
+      mean[c] = num_means == 0 ? Dtype(0) :
+          this->transform_param_.mean_value(num_means == 1 ? 0 : c);
+    }
+  }
 
   // Before starting the prefetch thread, we make cpu_data and gpu_data
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
   for (int i = 0; i < prefetch_.size(); ++i) {
-    prefetch_[i]->data_.mutable_cpu_data();
+    if (uint8_batch_) {
+      prefetch_[i]->raw_data_.reset(
+          new SyncedMemory(prefetch_[i]->data_.count()));
+      prefetch_[i]->raw_data_->mutable_cpu_data();
+    } else {
+      prefetch_[i]->data_.mutable_cpu_data();
+    }
     if (this->output_labels_) {
         prefetch_[i]->label_.mutable_cpu_data();
       
     }
-    
+    for (int j = 0; j < prefetch_[i]->extra_.size(); ++j) {
+      prefetch_[i]->extra_[j]->mutable_cpu_data();
+    }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
     for (int i = 0; i < prefetch_.size(); ++i) {
-      prefetch_[i]->data_.mutable_gpu_data();
+      if (uint8_batch_) {
+        prefetch_[i]->raw_data_->mutable_gpu_data();
+        batch_mean_.gpu_data();
+      } else {
+        prefetch_[i]->data_.mutable_gpu_data();
+      }
       if (this->output_labels_) {
           prefetch_[i]->label_.mutable_gpu_data();
       }
+      for (int j = 0; j < prefetch_[i]->extra_.size(); ++j) {
+        prefetch_[i]->extra_[j]->mutable_gpu_data();
+      }
     }
   }
 #endif
@@ -88,18 +122,31 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 
   try {
+    CPUTimer timer;
     while (!must_stop()) {
       Batch<Dtype>* batch = prefetch_free_.pop();
+      timer.Start();
+      batch->read_time_ = 0;
+      batch->decode_time_ = 0;
+      batch->trans_time_ = 0;
       load_batch(batch);
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
-        batch->data_.data().get()->async_gpu_push(stream);
+        if (uint8_batch_) {
+          batch->raw_data_->async_gpu_push(stream);
+        } else {
+          batch->data_.data().get()->async_gpu_push(stream);
+        }
         if (this->output_labels_) {
           batch->label_.data().get()->async_gpu_push(stream);
         }
+        for (int i = 0; i < batch->extra_.size(); ++i) {
+          batch->extra_[i]->data().get()->async_gpu_push(stream);
+        }
         CUDA_CHECK(cudaStreamSynchronize(stream));
       }
 #endif
+      batch->load_time_ = timer.MicroSeconds() / 1000;
       prefetch_full_.push(batch);
     }
   } catch (boost::thread_interrupted&) {
@@ -113,20 +160,69 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 }
 
 template <typename Dtype>
-void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
-    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+uint8_t* BasePrefetchingDataLayer<Dtype>::mutable_raw_data(
+    Batch<Dtype>* batch) {
+  CHECK_LE(batch->data_.count(), batch->raw_data_->size())
+      << "uint8_batch needs batches of a fixed shape; set crop_size or "
+      << "resize the inputs to a common size";
+  return static_cast<uint8_t*>(batch->raw_data_->mutable_cpu_data());
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::NextBatch() {
   if (prefetch_current_) {
     prefetch_free_.push(prefetch_current_);
   }
+  stats_.queue_depth += prefetch_full_.size();
+  CPUTimer timer;
+  timer.Start();
   prefetch_current_ = prefetch_full_.pop("Waiting for data");
+  stats_.wait_time += timer.MicroSeconds() / 1000;
+  // The batch was handed over by the queue, so its timings are complete.
+  stats_.batches++;
+  stats_.read_time += prefetch_current_->read_time_;
+  stats_.decode_time += prefetch_current_->decode_time_;
+  stats_.trans_time += prefetch_current_->trans_time_;
+  stats_.load_time += prefetch_current_->load_time_;
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  NextBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(prefetch_current_->data_);
-  top[0]->set_cpu_data(prefetch_current_->data_.mutable_cpu_data());
+  if (uint8_batch_) {
+    // Normalize the uint8 batch into top.
+    const uint8_t* raw_data =
+        static_cast<const uint8_t*>(prefetch_current_->raw_data_->cpu_data());
+    const Dtype* mean = batch_mean_.cpu_data();
+    const Dtype scale = this->transform_param_.scale();
+    const int channels = top[0]->shape(1);
+    const int spatial_dim = top[0]->count(2);
+    Dtype* top_data = top[0]->mutable_cpu_data();
+    for (int n = 0; n < top[0]->shape(0); ++n) {
+      for (int c = 0; c < channels; ++c) {
+        for (int i = 0; i < spatial_dim; ++i) {
+          top_data[i] = (static_cast<Dtype>(raw_data[i]) - mean[c]) * scale;
+        }
+        raw_data += spatial_dim;
+        top_data += spatial_dim;
+      }
+    }
+  } else {
+    top[0]->set_cpu_data(prefetch_current_->data_.mutable_cpu_data());
+  }
   if (this->output_labels_) {
         top[1]->ReshapeLike(prefetch_current_->label_);
         top[1]->set_cpu_data(prefetch_current_->label_.mutable_cpu_data());
     
   }
+  for (int i = 0; i < prefetch_current_->extra_.size(); ++i) {
+    Blob<Dtype>* extra = prefetch_current_->extra_[i].get();
+    top[2 + i]->ReshapeLike(*extra);
+    top[2 + i]->set_cpu_data(extra->mutable_cpu_data());
+  }
 }
 
 #ifdef CPU_ONLY
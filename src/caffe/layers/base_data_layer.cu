@@ -4,22 +4,46 @@
 
 namespace caffe {
 
+template <typename Dtype>
+__global__ void NormalizeBatch(const int n, const uint8_t* raw_data,
+    const int channels, const int spatial_dim, const Dtype* mean,
+    const Dtype scale, Dtype* top_data) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const int c = (index / spatial_dim) % channels;
+    top_data[index] = (static_cast<Dtype>(raw_data[index]) - mean[c]) * scale;
+  }
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_gpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  if (prefetch_current_) {
-    prefetch_free_.push(prefetch_current_);
-  }
-  prefetch_current_ = prefetch_full_.pop("Waiting for data");
+  NextBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(prefetch_current_->data_);
-  top[0]->set_gpu_data(prefetch_current_->data_.mutable_gpu_data());
+  if (uint8_batch_) {
+    // Normalize the uint8 batch into top.
+    const int count = top[0]->count();
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    NormalizeBatch<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+        count,
+        static_cast<const uint8_t*>(prefetch_current_->raw_data_->gpu_data()),
+        top[0]->shape(1), top[0]->count(2), batch_mean_.gpu_data(),
+        Dtype(this->transform_param_.scale()), top[0]->mutable_gpu_data());
+    CUDA_POST_KERNEL_CHECK;
+  } else {
+    top[0]->set_gpu_data(prefetch_current_->data_.mutable_gpu_data());
+  }
   if (this->output_labels_) {
         // Reshape to loaded labels.
         top[1]->ReshapeLike(prefetch_current_->label_);
         top[1]->set_gpu_data(prefetch_current_->label_.mutable_gpu_data());
        
   }
+  for (int i = 0; i < prefetch_current_->extra_.size(); ++i) {
+    Blob<Dtype>* extra = prefetch_current_->extra_[i].get();
+    top[2 + i]->ReshapeLike(*extra);
+    top[2 + i]->set_gpu_data(extra->mutable_gpu_data());
+  }
 }
 INSTANTIATE_LAYER_GPU_FORWARD(BasePrefetchingDataLayer);
 
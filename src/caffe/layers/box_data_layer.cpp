@@ -8,13 +8,14 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/box_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
 BoxDataLayer<Dtype>::BoxDataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
-    reader_(param) {
+    reader_(param), scale_index_(0), scale_batches_(0) {
 }
 
 template <typename Dtype>
@@ -33,6 +34,43 @@ void BoxDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
+  side_ = param.side();
+  if (param.sparse_label()) {
+    CHECK_GT(param.max_objects(), 0) << "Sparse labels need max_objects";
+  }
+  if (param.scales_size() > 0 && this->phase_ == TRAIN) {
+    CHECK(!this->layer_param_.transform_param().has_mean_file())
+        << "Multi-scale box data needs mean_value instead of mean_file";
+    CHECK_GT(param.scale_interval(), 0);
+    int max_scale = 0;
+    for (int i = 0; i < param.scales_size(); ++i) {
+      const int scale = param.scales(i);
+      CHECK_EQ(scale % param.scale_stride(), 0)
+          << "Scales must be multiples of scale_stride";
+      vector<int> data_shape(top_shape);
+      data_shape[0] = batch_size;
+      data_shape[2] = scale;
+      data_shape[3] = scale;
+      scale_data_shapes_.push_back(data_shape);
+      const int side = scale / param.scale_stride();
+      vector<int> label_shape(1, batch_size);
+      label_shape.push_back(label_size(side));
+      scale_label_shapes_.push_back(label_shape);
+      scale_sides_.push_back(side);
+      if (scale > max_scale) {
+        max_scale = scale;
+        scale_index_ = i;
+      }
+    }
+    // Set everything up for the largest scale, so that the prefetch buffers
+    // and the activations of the net never grow when the scale changes.
+    top_shape = scale_data_shapes_[scale_index_];
+    top_shape[0] = 1;
+    side_ = scale_sides_[scale_index_];
+    LOG(INFO) << "Multi-scale training over " << param.scales_size()
+        << " sizes up to " << max_scale << ", switching every "
+        << param.scale_interval() << " batches";
+  }
   this->transformed_data_.Reshape(top_shape);
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
@@ -45,10 +83,8 @@ void BoxDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       << top[0]->width();
   // label
   if (this->output_labels_) {
-    side_ = param.side();
     vector<int> label_shape(1, batch_size);
-    int label_size = side_ * side_ * (1 + 1 + 1 + 4);
-    label_shape.push_back(label_size);
+    label_shape.push_back(label_size(side_));
     top[1]->Reshape(label_shape);
     for (int j = 0; j < this->prefetch_.size(); ++j) {
         this->prefetch_[j]->label_.Reshape(label_shape);
@@ -68,16 +104,34 @@ void BoxDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CHECK(batch->data_.count());
   CHECK(this->transformed_data_.count());
 
-  // Reshape according to the first datum of each batch
-  // on single input batches allows for inputs of varying dimension.
-  const int batch_size = this->layer_param_.data_param().batch_size();
-  Datum& datum = *(reader_.full().peek());
-  // Use data_transformer to infer the expected blob shape from datum.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
-  this->transformed_data_.Reshape(top_shape);
-  // Reshape batch according to the batch_size.
-  top_shape[0] = batch_size;
-  batch->data_.Reshape(top_shape);
+  const DataParameter& param = this->layer_param_.data_param();
+  const int batch_size = param.batch_size();
+  int side = side_;
+  if (scale_data_shapes_.size() > 0) {
+    // Draw a new scale every scale_interval batches. The buffers were set up
+    // for the largest scale, so none of these reshapes allocates.
+    if (scale_batches_++ % param.scale_interval() == 0) {
+      scale_index_ = caffe_rng_rand() % scale_data_shapes_.size();
+      const vector<int>& shape = scale_data_shapes_[scale_index_];
+      this->transformed_data_.Reshape(1, shape[1], shape[2], shape[3]);
+    }
+    batch->data_.Reshape(scale_data_shapes_[scale_index_]);
+    if (this->output_labels_) {
+      batch->label_.Reshape(scale_label_shapes_[scale_index_]);
+    }
+    side = scale_sides_[scale_index_];
+  } else if (!this->output_labels_) {
+    // Labeled samples are resized to the shape set up from the first datum.
+    // Otherwise reshape according to the first datum of each batch
+    // on single input batches allows for inputs of varying dimension.
+    Datum& datum = *(reader_.full().peek());
+    // Use data_transformer to infer the expected blob shape from datum.
+    vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
+    this->transformed_data_.Reshape(top_shape);
+    // Reshape batch according to the batch_size.
+    top_shape[0] = batch_size;
+    batch->data_.Reshape(top_shape);
+  }
 
   Dtype* top_data = batch->data_.mutable_cpu_data();
   Dtype* top_label;
@@ -103,7 +157,12 @@ void BoxDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       // transform label
       int label_offset = batch->label_.offset(item_id);
       int count  = batch->label_.count(1);
-      transform_label(count, top_label + label_offset, box_labels, side_);
+      if (param.sparse_label()) {
+        transform_sparse_label(count, top_label + label_offset, box_labels,
+            side);
+      } else {
+        transform_label(count, top_label + label_offset, box_labels, side);
+      }
         
     } else {
       this->data_transformer_->Transform(datum, &(this->transformed_data_));
@@ -117,6 +176,8 @@ void BoxDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  batch->read_time_ = read_time / 1000;
+  batch->trans_time_ = trans_time / 1000;
 }
 
 template<typename Dtype>
@@ -161,6 +222,57 @@ void BoxDataLayer<Dtype>::transform_label(int count, Dtype* top_label,
   }
 }
 
+template<typename Dtype>
+int BoxDataLayer<Dtype>::label_size(int side) const {
+  const DataParameter& param = this->layer_param_.data_param();
+  if (param.sparse_label()) {
+    return 1 + param.max_objects() * kSparseLabelEntry;
+  }
+  return side * side * (1 + 1 + 1 + 4);
+}
+
+template<typename Dtype>
+void BoxDataLayer<Dtype>::transform_sparse_label(int count, Dtype* top_label,
+    const vector<BoxLabel>& box_labels, int side) {
+  const int max_objects = LabelCapacity(count, side, true);
+  caffe_set(count, Dtype(0), top_label);
+  int num_entries = 0;
+  for (int i = 0; i < box_labels.size(); ++i) {
+    float difficult = box_labels[i].difficult_;
+    if (difficult != 0. && difficult != 1.) {
+      LOG(WARNING) << "Difficult must be 0 or 1";
+    }
+    float class_label = box_labels[i].class_label_;
+    CHECK_GE(class_label, 0) << "class_label must >= 0";
+    int x_index = floor(box_labels[i].box_[0] * side);
+    int y_index = floor(box_labels[i].box_[1] * side);
+    x_index = std::min(x_index, side - 1);
+    y_index = std::min(y_index, side - 1);
+    const int cell = side * y_index + x_index;
+    // Like the dense label, a cell keeps the last of its boxes.
+    int e = 0;
+    while (e < num_entries && top_label[1 + e * kSparseLabelEntry] != cell) {
+      ++e;
+    }
+    if (e == num_entries) {
+      if (num_entries == max_objects) {
+        LOG_FIRST_N(WARNING, 10) << "Dropping a box past max_objects ("
+            << max_objects << ")";
+        continue;
+      }
+      ++num_entries;
+    }
+    Dtype* entry = top_label + 1 + e * kSparseLabelEntry;
+    entry[0] = cell;
+    entry[1] = class_label;
+    entry[2] = difficult;
+    for (int j = 0; j < 4; ++j) {
+      entry[3 + j] = box_labels[i].box_[j];
+    }
+  }
+  top_label[0] = num_entries;
+}
+
 INSTANTIATE_CLASS(BoxDataLayer);
 REGISTER_LAYER_CLASS(BoxData);
 
@@ -50,6 +50,59 @@ void ConcatLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (bottom.size() == 1) {
     top[0]->ShareData(*bottom[0]);
     top[0]->ShareDiff(*bottom[0]);
+  } else if (allow_aliasing_ && num_concats_ == 1) {
+    AliasBottoms(bottom, top);
+  } else if (buffer_) {
+    // Bottoms may still be views of buffer_, so the top must stop sharing it
+    // before anything is copied into the top.
+    Blob<Dtype> own(top_shape);
+    top[0]->ShareData(own);
+    top[0]->ShareDiff(own);
+    buffer_.reset();
+    data_views_.clear();
+    diff_views_.clear();
+  }
+}
+
+template <typename Dtype>
+void ConcatLayer<Dtype>::AliasBottoms(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  vector<int> offsets(bottom.size(), 0);
+  for (int i = 1; i < bottom.size(); ++i) {
+    offsets[i] = offsets[i - 1] + bottom[i - 1]->count();
+  }
+  // Views into a buffer with another layout may still hold the bottoms'
+  // data, so a new layout gets a new buffer rather than reusing the old one.
+  if (!buffer_ || buffer_->shape() != top[0]->shape() ||
+      offsets != view_offsets_) {
+    buffer_.reset(new Blob<Dtype>(top[0]->shape()));
+    view_offsets_ = offsets;
+    data_views_.assign(bottom.size(), shared_ptr<SyncedMemory>());
+    diff_views_.assign(bottom.size(), shared_ptr<SyncedMemory>());
+  }
+  top[0]->ShareData(*buffer_);
+  top[0]->ShareDiff(*buffer_);
+  for (int i = 0; i < bottom.size(); ++i) {
+    // Memory that other blobs share, e.g. through a Split or Reshape, is
+    // left alone and copied in Forward instead.
+    if (!data_aliased(bottom[i], i) && bottom[i]->data().use_count() == 1) {
+      shared_ptr<SyncedMemory> old = bottom[i]->data();
+      bottom[i]->ShareDataView(*buffer_, offsets[i]);
+      if (old->head() == SyncedMemory::HEAD_AT_GPU) {
+        caffe_copy(bottom[i]->count(), static_cast<const Dtype*>(
+            old->gpu_data()), bottom[i]->mutable_gpu_data());
+      } else if (old->head() != SyncedMemory::UNINITIALIZED) {
+        caffe_copy(bottom[i]->count(), static_cast<const Dtype*>(
+            old->cpu_data()), bottom[i]->mutable_cpu_data());
+      }
+      data_views_[i] = bottom[i]->data();
+    }
+    // The bottom diffs are only ever written by Backward, so there is
+    // nothing to keep.
+    if (!diff_aliased(bottom[i], i) && bottom[i]->diff().use_count() == 1) {
+      bottom[i]->ShareDiffView(*buffer_, offsets[i]);
+      diff_views_[i] = bottom[i]->diff();
+    }
   }
 }
 
@@ -61,8 +114,12 @@ void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
   for (int i = 0; i < bottom.size(); ++i) {
-    const Dtype* bottom_data = bottom[i]->cpu_data();
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
+    if (data_aliased(bottom[i], i)) {
+      offset_concat_axis += bottom_concat_axis;
+      continue;
+    }
+    const Dtype* bottom_data = bottom[i]->cpu_data();
     for (int n = 0; n < num_concats_; ++n) {
       caffe_copy(bottom_concat_axis * concat_input_size_,
           bottom_data + n * bottom_concat_axis * concat_input_size_,
@@ -82,7 +139,7 @@ void ConcatLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const int top_concat_axis = top[0]->shape(concat_axis_);
   for (int i = 0; i < bottom.size(); ++i) {
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
-    if (propagate_down[i]) {
+    if (propagate_down[i] && !diff_aliased(bottom[i], i)) {
       Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
       for (int n = 0; n < num_concats_; ++n) {
         caffe_copy(bottom_concat_axis * concat_input_size_, top_diff +
@@ -112,9 +112,14 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     // Apply data transformations (mirror, scale, crop...)
     timer.Start();
     int offset = batch->data_.offset(item_id);
-    Dtype* top_data = batch->data_.mutable_cpu_data();
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
+    if (this->uint8_batch_) {
+      this->data_transformer_->TransformRaw(datum,
+          this->mutable_raw_data(batch) + offset);
+    } else {
+      Dtype* top_data = batch->data_.mutable_cpu_data();
+      this->transformed_data_.set_cpu_data(top_data + offset);
+      this->data_transformer_->Transform(datum, &(this->transformed_data_));
+    }
     // Copy label.
     if (this->output_labels_) {
       Dtype* top_label = batch->label_.mutable_cpu_data();
@@ -128,6 +133,8 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  batch->read_time_ = read_time / 1000;
+  batch->trans_time_ = trans_time / 1000;
 }
 
 INSTANTIATE_CLASS(DataLayer);
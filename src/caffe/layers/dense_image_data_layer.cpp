@@ -69,6 +69,12 @@ void DenseImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bott
     prefetch_rng_.reset(new Caffe::RNG(prefetch_rng_seed));
     ShuffleImages();
   }
+  const ImageCacheParameter& cache_param =
+      this->layer_param_.dense_image_data_param().cache_param();
+  if (cache_param.capacity_mb() > 0) {
+    image_cache_ = ImageCache::Get(cache_param.has_name() ?
+        cache_param.name() : source, cache_param);
+  }
   LOG(INFO) << "A total of " << lines_.size() << " real examples.";
   LOG(INFO) << "A total of " << synthlines_.size() << " synthetic examples.";
 
@@ -151,6 +157,18 @@ void DenseImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bott
       << top[0]->width();
 }
 
+template <typename Dtype>
+cv::Mat DenseImageDataLayer<Dtype>::ReadImage(const string& filename,
+    const int height, const int width, const bool is_color,
+    const bool nearest_neighbour_interp) {
+  if (image_cache_) {
+    return image_cache_->ReadImage(filename, height, width, is_color,
+        nearest_neighbour_interp);
+  }
+  return ReadImageToCVMat(filename, height, width, is_color,
+      nearest_neighbour_interp);
+}
+
 template <typename Dtype>
 void DenseImageDataLayer<Dtype>::ShuffleImages() {
   caffe::rng_t* prefetch_rng =
@@ -189,7 +207,7 @@ void DenseImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
 
   // Reshape on single input batches for inputs of varying dimension.
   if (batch_size == 1 && crop_size == 0 && new_height == 0 && new_width == 0 && crop_height == 0 && crop_width == 0) {
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
+    cv::Mat cv_img = ReadImage(root_folder + lines_[lines_id_].first,
         0, 0, is_color);
     //this->prefetch_data_.Reshape(1, cv_img.channels(),
     //    cv_img.rows, cv_img.cols);
@@ -230,19 +248,19 @@ void DenseImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
 
     if (item_id<batch_limit && synthlines_.size()!=0)
     {
-       cv_img = ReadImageToCVMat(root_folder + synthlines_[lines_id_].first,
+       cv_img = ReadImage(root_folder + synthlines_[lines_id_].first,
            new_height, new_width, is_color);
        CHECK(cv_img.data) << "Could not load " << synthlines_[lines_id_].first;
-       cv_lab = ReadImageToCVMat(root_folder + synthlines_[lines_id_].second,
+       cv_lab = ReadImage(root_folder + synthlines_[lines_id_].second,
            (float)new_height/scale, (float)new_width/scale, false, true);
        CHECK(cv_lab.data) << "Could not load " << synthlines_[lines_id_].second;
        //printf("%s %s\n", synthlines_[lines_id_].first.c_str(), synthlines_[lines_id_].second.c_str() );
     }
     else{
-      cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
+      cv_img = ReadImage(root_folder + lines_[lines_id_].first,
          new_height, new_width, is_color);
      CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-     cv_lab = ReadImageToCVMat(root_folder + lines_[lines_id_].second,
+     cv_lab = ReadImage(root_folder + lines_[lines_id_].second,
          (float)new_height/scale, (float)new_width/scale, false, true);
      CHECK(cv_lab.data) << "Could not load " << lines_[lines_id_].second;
      //printf("%s %s\n", lines_[lines_id_].first.c_str(), lines_[lines_id_].second.c_str() );
@@ -315,6 +333,9 @@ void DenseImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  // Images are read and decoded in one call.
+  batch->decode_time_ = read_time / 1000;
+  batch->trans_time_ = trans_time / 1000;
 }
 
 INSTANTIATE_CLASS(DenseImageDataLayer);
@@ -4,6 +4,7 @@
 #include <cmath>
 
 #include "caffe/layers/detection_loss_layer.hpp"
+#include "caffe/util/detection.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -38,7 +39,6 @@ void DetectionLossLayer<Dtype>::LayerSetUp(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   LossLayer<Dtype>::LayerSetUp(bottom, top);
   DetectionLossParameter param = this->layer_param_.detection_loss_param();
-  side_ = param.side();
   num_class_ = param.num_class();
   num_object_ = param.num_object();
   sqrt_ = param.sqrt();
@@ -47,151 +47,203 @@ void DetectionLossLayer<Dtype>::LayerSetUp(
   noobject_scale_ = param.noobject_scale();
   class_scale_ = param.class_scale();
   coord_scale_ = param.coord_scale();
-  
-  int input_count = bottom[0]->count(1);
-  int label_count = bottom[1]->count(1);
-  // outputs: classes, iou, coordinates
-  int tmp_input_count = side_ * side_ * (num_class_ + (1 + 4) * num_object_);
-  // label: isobj, class_label, coordinates
-  int tmp_label_count = side_ * side_ * (1 + 1 + 1 + 4);
-  CHECK_EQ(input_count, tmp_input_count);
-  CHECK_EQ(label_count, tmp_label_count);
+  sparse_label_ = param.sparse_label();
 }
 
 template <typename Dtype>
 void DetectionLossLayer<Dtype>::Reshape(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   LossLayer<Dtype>::Reshape(bottom, top);
+  side_ = GridSide(bottom[0]->count(1), num_class_, num_object_);
+  LabelCapacity(bottom[1]->count(1), side_, sparse_label_);
   diff_.ReshapeLike(*bottom[0]);
 }
 
+// IoU of a predicted box (x, y, w, h) with a ground truth box, without
+// going through vectors so that it can be used in the per-cell loop.
+template <typename Dtype>
+static inline Dtype BoxIoU(Dtype x, Dtype y, Dtype w, Dtype h,
+    const Dtype* truth) {
+  const Dtype iw = Overlap(x, w, truth[0], truth[2]);
+  const Dtype ih = Overlap(y, h, truth[1], truth[3]);
+  if (iw < 0 || ih < 0) return 0;
+  const Dtype inter_area = iw * ih;
+  return inter_area / (w * h + truth[2] * truth[3] - inter_area);
+}
+
 template <typename Dtype>
 void DetectionLossLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   const Dtype* input_data = bottom[0]->cpu_data();
   const Dtype* label_data = bottom[1]->cpu_data();
   Dtype* diff = diff_.mutable_cpu_data();
-  Dtype loss(0.0), class_loss(0.0), noobj_loss(0.0), obj_loss(0.0), coord_loss(0.0), area_loss(0.0);
-  Dtype avg_iou(0.0), avg_obj(0.0), avg_cls(0.0), avg_pos_cls(0.0), avg_no_obj(0.0);
-  Dtype obj_count(0);
-  int locations = pow(side_, 2);
-  caffe_set(diff_.count(), Dtype(0.), diff);
-  for (int i = 0; i < bottom[0]->num(); ++i) {
-    int index = i * bottom[0]->count(1);
-    int true_index = i * bottom[1]->count(1);
-    for (int j = 0; j < locations; ++j) {
-      for (int k = 0; k < num_object_; ++k) {
-        int p_index = index + num_class_ * locations + k * locations + j;
-        noobj_loss += noobject_scale_ * pow(input_data[p_index] - 0, 2);
-        diff[p_index] = noobject_scale_ * (input_data[p_index] - 0);
-        avg_no_obj += input_data[p_index];
-      }
-      bool isobj = label_data[true_index + locations + j];
-      if (!isobj) {
-        continue;
+  const int num = bottom[0]->num();
+  const int input_dim = bottom[0]->count(1);
+  const int label_dim = bottom[1]->count(1);
+  const bool sparse = sparse_label_;
+  const int locations = side_ * side_;
+  const int side = side_;
+  const int num_class = num_class_;
+  const int num_object = num_object_;
+  const bool use_sqrt = sqrt_;
+  const bool constriant = constriant_;
+  const Dtype object_scale = object_scale_;
+  const Dtype noobject_scale = noobject_scale_;
+  const Dtype class_scale = class_scale_;
+  const Dtype coord_scale = coord_scale_;
+  Dtype class_loss(0.0), noobj_loss(0.0), obj_loss(0.0), coord_loss(0.0),
+      area_loss(0.0);
+  Dtype avg_iou(0.0), avg_obj(0.0), avg_cls(0.0), avg_pos_cls(0.0),
+      avg_no_obj(0.0);
+  int obj_count = 0;
+  // Images are independent: each one writes its own slice of diff_ and
+  // contributes partial sums that are reduced at the end.
+#ifdef _OPENMP
+  #pragma omp parallel for reduction(+: class_loss, noobj_loss, obj_loss, \
+      coord_loss, area_loss, avg_iou, avg_obj, avg_cls, avg_pos_cls, \
+      avg_no_obj, obj_count)
+#endif
+  for (int i = 0; i < num; ++i) {
+    const Dtype* input = input_data + i * input_dim;
+    const Dtype* label = label_data + i * label_dim;
+    Dtype* image_diff = diff + i * input_dim;
+    const Dtype* conf = input + num_class * locations;
+    Dtype* conf_diff = image_diff + num_class * locations;
+    const Dtype* boxes = conf + num_object * locations;
+    Dtype* boxes_diff = conf_diff + num_object * locations;
+    caffe_set(num_class * locations, Dtype(0), image_diff);
+    caffe_set(num_object * 4 * locations, Dtype(0), boxes_diff);
+    // Train every predictor towards no object first; the responsible ones
+    // are corrected below. This runs over the contiguous confidence block.
+    for (int p = 0; p < num_object * locations; ++p) {
+      conf_diff[p] = noobject_scale * conf[p];
+      noobj_loss += noobject_scale * conf[p] * conf[p];
+      avg_no_obj += conf[p];
+    }
+    // Sparse labels list the objects, dense ones are scanned cell by cell.
+    const int num_entries =
+        sparse ? static_cast<int>(label[0]) : locations;
+    if (sparse) {
+      CHECK_LE(1 + num_entries * kSparseLabelEntry, label_dim)
+          << "More objects than sparse label entries";
+    }
+    for (int e = 0; e < num_entries; ++e) {
+      int j;
+      int cls;
+      const Dtype* true_box;
+      if (sparse) {
+        const Dtype* entry = label + 1 + e * kSparseLabelEntry;
+        j = static_cast<int>(entry[0]);
+        cls = static_cast<int>(entry[1]);
+        true_box = entry + 3;
+        CHECK_LT(j, locations) << "Label cell outside of the grid";
+      } else {
+        if (!label[locations + e]) {
+          continue;
+        }
+        j = e;
+        cls = static_cast<int>(label[locations * 2 + j]);
+        true_box = label + locations * 3 + j * 4;
       }
-      obj_count += 1;
-      int label = static_cast<int>(label_data[true_index + locations * 2 + j]);
-      CHECK_GE(label, 0) << "label start at 0";
-      CHECK_LT(label, num_class_) << "label must below num_class";
-      for (int c = 0; c < num_class_; ++c) {
-        int class_index = index + c * locations + j;
-        Dtype target = Dtype(c == label);
-        avg_cls += input_data[class_index];
-        if (c == label)
-          avg_pos_cls += input_data[class_index]; 
-        class_loss += class_scale_ * pow(input_data[class_index] - target, 2);
-        diff[class_index] = class_scale_ * (input_data[class_index] - target);
+      ++obj_count;
+      CHECK_GE(cls, 0) << "label start at 0";
+      CHECK_LT(cls, num_class) << "label must below num_class";
+      for (int c = 0; c < num_class; ++c) {
+        const int class_index = c * locations + j;
+        const Dtype value = input[class_index];
+        const Dtype delta = value - Dtype(c == cls);
+        avg_cls += value;
+        if (c == cls) {
+          avg_pos_cls += value;
+        }
+        class_loss += class_scale * delta * delta;
+        image_diff[class_index] = class_scale * delta;
       }
-      const Dtype* true_box_pt = label_data + true_index + locations * 3 + j * 4;
-      vector<Dtype> true_box(true_box_pt, true_box_pt + 4);
-      const Dtype* box_pt = input_data + index + (num_class_+num_object_)*locations + j;
-      Dtype best_iou = 0.;
-      Dtype best_rmse = 20.;
+      Dtype best_iou = 0;
+      // Squared distance, i.e. an rmse of 20.
+      Dtype best_dist = 400;
       int best_index = 0;
-      for (int k = 0; k < num_object_; ++k) {
-        vector<Dtype> box;
-        box.push_back(*(box_pt + (k * 4 + 0) * locations));
-        box.push_back(*(box_pt + (k * 4 + 1) * locations));
-        box.push_back(*(box_pt + (k * 4 + 2) * locations));
-        box.push_back(*(box_pt + (k * 4 + 3) * locations));
-        if (constriant_) {
-          box[0] = (j % side_ + box[0]) / side_;
-          box[1] = (j / side_ + box[1]) / side_;
+      for (int k = 0; k < num_object; ++k) {
+        const Dtype* box = boxes + k * 4 * locations + j;
+        Dtype x = box[0];
+        Dtype y = box[locations];
+        Dtype w = box[2 * locations];
+        Dtype h = box[3 * locations];
+        if (constriant) {
+          x = (j % side + x) / side;
+          y = (j / side + y) / side;
         }
-        if (sqrt_) {
-          box[2] = pow(box[2], 2);
-          box[3] = pow(box[3], 2);
+        if (use_sqrt) {
+          w = w * w;
+          h = h * h;
         }
-        Dtype iou = Calc_iou(box, true_box);
-        Dtype rmse = Calc_rmse(box, true_box);
+        const Dtype iou = BoxIoU(x, y, w, h, true_box);
         if (best_iou > 0 || iou > 0) {
           if (iou > best_iou) {
             best_iou = iou;
             best_index = k;
           }
         } else {
-          if (rmse < best_rmse) {
-            best_rmse = rmse;
+          const Dtype dx = x - true_box[0];
+          const Dtype dy = y - true_box[1];
+          const Dtype dw = w - true_box[2];
+          const Dtype dh = h - true_box[3];
+          const Dtype dist = dx * dx + dy * dy + dw * dw + dh * dh;
+          if (dist < best_dist) {
+            best_dist = dist;
             best_index = k;
           }
         }
       }
-
-      CHECK_GE(best_index, 0) << "best_index must >= 0";
       avg_iou += best_iou;
-      int p_index = index + num_class_ * locations + best_index * locations + j;
-      noobj_loss -= noobject_scale_ * pow(input_data[p_index], 2);
-      obj_loss += object_scale_ * pow(input_data[p_index] - 1., 2);
-      avg_no_obj -= input_data[p_index];
-      avg_obj += input_data[p_index];
+      const int p_index = best_index * locations + j;
+      const Dtype best_conf = conf[p_index];
+      noobj_loss -= noobject_scale * best_conf * best_conf;
+      obj_loss += object_scale * (best_conf - 1) * (best_conf - 1);
+      avg_no_obj -= best_conf;
+      avg_obj += best_conf;
       // rescore
-      diff[p_index] = object_scale_ * (input_data[p_index] - best_iou);
-      int box_index = index + (num_class_ + num_object_ + best_index * 4) * locations + j;
-      vector<Dtype> best_box;
-      best_box.push_back(input_data[box_index + 0 * locations]);
-      best_box.push_back(input_data[box_index + 1 * locations]);
-      best_box.push_back(input_data[box_index + 2 * locations]);
-      best_box.push_back(input_data[box_index + 3 * locations]);
-
-
-      if (constriant_) {
-        true_box[0] = true_box[0] * side_ - Dtype(j % side_);
-        true_box[1] = true_box[1] * side_ - Dtype(j / side_);
-      }
+      conf_diff[p_index] = object_scale * (best_conf - best_iou);
 
-      if (sqrt_) {
-        true_box[2] = sqrt(true_box[2]);
-        true_box[3] = sqrt(true_box[3]);
+      Dtype target[4] = {true_box[0], true_box[1], true_box[2], true_box[3]};
+      if (constriant) {
+        target[0] = target[0] * side - Dtype(j % side);
+        target[1] = target[1] * side - Dtype(j / side);
       }
-
+      if (use_sqrt) {
+        target[2] = sqrt(target[2]);
+        target[3] = sqrt(target[3]);
+      }
+      const int box_index = best_index * 4 * locations + j;
+      Dtype delta[4];
       for (int o = 0; o < 4; ++o) {
-        diff[box_index + o * locations] = coord_scale_ * (best_box[o] - true_box[o]);
+        delta[o] = boxes[box_index + o * locations] - target[o];
+        boxes_diff[box_index + o * locations] = coord_scale * delta[o];
       }
-
-      coord_loss += coord_scale_ * pow(best_box[0] - true_box[0], 2);
-      coord_loss += coord_scale_ * pow(best_box[1] - true_box[1], 2);
-      area_loss += coord_scale_ * pow(best_box[2] - true_box[2], 2);
-      area_loss += coord_scale_ * pow(best_box[3] - true_box[3], 2);
+      coord_loss += coord_scale * (delta[0] * delta[0] + delta[1] * delta[1]);
+      area_loss += coord_scale * (delta[2] * delta[2] + delta[3] * delta[3]);
     }
   }
-  class_loss /= obj_count;
-  coord_loss /= obj_count;
-  area_loss /= obj_count;
-  obj_loss /= obj_count;
-  noobj_loss /= (locations * num_object_ * bottom[0]->num() - obj_count);
-
-  avg_iou /= obj_count;
-  avg_obj /= obj_count;
-  avg_no_obj /= (locations * num_object_ * bottom[0]->num() - obj_count);
-  avg_cls /= obj_count;
-  avg_pos_cls /= obj_count;
-
-  loss = class_loss + coord_loss + area_loss + obj_loss + noobj_loss;
-  obj_count /= bottom[0]->num();
+  // A batch without any object only has a no-object loss.
+  if (obj_count > 0) {
+    class_loss /= obj_count;
+    coord_loss /= obj_count;
+    area_loss /= obj_count;
+    obj_loss /= obj_count;
+    avg_iou /= obj_count;
+    avg_obj /= obj_count;
+    avg_cls /= obj_count;
+    avg_pos_cls /= obj_count;
+  }
+  const int noobj_count = locations * num_object * num - obj_count;
+  if (noobj_count > 0) {
+    noobj_loss /= noobj_count;
+    avg_no_obj /= noobj_count;
+  }
+
+  Dtype loss = class_loss + coord_loss + area_loss + obj_loss + noobj_loss;
   top[0]->mutable_cpu_data()[0] = loss;
 
-  // LOG(INFO) << "average objects: " << obj_count;
   LOG(INFO) << "loss: " << loss << " class_loss: " << class_loss << " obj_loss: " 
         << obj_loss << " noobj_loss: " << noobj_loss << " coord_loss: " << coord_loss
         << " area_loss: " << area_loss;
@@ -218,9 +270,16 @@ void DetectionLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
 }
 
-#ifdef CPU_ONLY
-STUB_GPU(DetectionLossLayer);
-#endif
+// Used by EvalDetectionLayer.
+template float Overlap(float x1, float w1, float x2, float w2);
+template double Overlap(double x1, double w1, double x2, double w2);
+template float Calc_iou(const vector<float>& box, const vector<float>& truth);
+template double Calc_iou(const vector<double>& box,
+    const vector<double>& truth);
+template float Calc_rmse(const vector<float>& box,
+    const vector<float>& truth);
+template double Calc_rmse(const vector<double>& box,
+    const vector<double>& truth);
 
 INSTANTIATE_CLASS(DetectionLossLayer);
 REGISTER_LAYER_CLASS(DetectionLoss);
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/detection_output_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Orders kept boxes by descending score, ties by position.
+template <typename Dtype>
+class KeptScoreGreater {
+ public:
+  explicit KeptScoreGreater(const Dtype* score) : score_(score) {}
+  inline bool operator()(int a, int b) const {
+    return score_[a] > score_[b] || (score_[a] == score_[b] && a < b);
+  }
+
+ private:
+  const Dtype* score_;
+};
+
+template <typename Dtype>
+void DetectionOutputLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const DetectionOutputParameter& param =
+      this->layer_param_.detection_output_param();
+  num_class_ = param.num_class();
+  num_object_ = param.num_object();
+  sqrt_ = param.sqrt();
+  constriant_ = param.constriant();
+  score_type_ = param.score_type();
+  confidence_threshold_ = param.confidence_threshold();
+  keep_top_k_ = param.keep_top_k();
+  CHECK_GT(keep_top_k_, 0) << "keep_top_k must be positive";
+  box_nms_.reset(new BoxNms<Dtype>(param.nms_threshold(),
+      param.per_class_nms(), param.has_top_k() ? param.top_k() : -1));
+}
+
+template <typename Dtype>
+void DetectionOutputLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  side_ = GridSide(bottom[0]->count(1), num_class_, num_object_);
+  const int num_boxes = side_ * side_ * num_object_;
+  box_nms_->Reserve(num_boxes);
+  pred_boxes_.Reserve(num_boxes);
+  kept_boxes_.Reserve(num_boxes);
+  order_.reserve(num_boxes);
+  vector<int> top_shape(3, 6);
+  top_shape[0] = bottom[0]->num();
+  top_shape[1] = keep_top_k_;
+  top[0]->Reshape(top_shape);
+  if (top.size() > 1) {
+    top_shape.resize(1);
+    top[1]->Reshape(top_shape);
+  }
+}
+
+template <typename Dtype>
+void DetectionOutputLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* input_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  caffe_set(top[0]->count(), Dtype(0), top_data);
+  for (int i = 0; i < bottom[0]->num(); ++i) {
+    DecodeGridBoxes(input_data + i * bottom[0]->count(1), side_,
+        num_class_, num_object_, sqrt_, constriant_, score_type_,
+        confidence_threshold_, &pred_boxes_);
+    box_nms_->Apply(pred_boxes_, &kept_boxes_);
+    const int count = std::min(kept_boxes_.size(), keep_top_k_);
+    order_.resize(kept_boxes_.size());
+    for (int k = 0; k < order_.size(); ++k) {
+      order_[k] = k;
+    }
+    if (count > 0) {
+      std::partial_sort(order_.begin(), order_.begin() + count, order_.end(),
+          KeptScoreGreater<Dtype>(&kept_boxes_.score[0]));
+    }
+    Dtype* detection = top_data + i * top[0]->count(1);
+    for (int k = 0; k < keep_top_k_; ++k, detection += 6) {
+      if (k >= count) {
+        detection[0] = -1;
+        continue;
+      }
+      const int b = order_[k];
+      detection[0] = kept_boxes_.label[b];
+      detection[1] = kept_boxes_.score[b];
+      detection[2] = kept_boxes_.x[b];
+      detection[3] = kept_boxes_.y[b];
+      detection[4] = kept_boxes_.w[b];
+      detection[5] = kept_boxes_.h[b];
+    }
+    if (top.size() > 1) {
+      top[1]->mutable_cpu_data()[i] = count;
+    }
+  }
+}
+
+INSTANTIATE_CLASS(DetectionOutputLayer);
+REGISTER_LAYER_CLASS(DetectionOutput);
+
+}  // namespace caffe
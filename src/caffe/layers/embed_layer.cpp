@@ -42,6 +42,8 @@ void EmbedLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       bias_filler->Fill(this->blobs_[1].get());
     }
   }  // parameter initialization
+  this->blobs_[0]->set_sparse_diff(
+      this->layer_param_.embed_param().sparse_gradient());
   this->param_propagate_down_.resize(this->blobs_.size(), true);
 }
 
@@ -90,7 +92,9 @@ void EmbedLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const Dtype* top_diff = top[0]->cpu_diff();
     const Dtype* bottom_data = bottom[0]->cpu_data();
     // Gradient with respect to weight
-    Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+    Blob<Dtype>* weight = this->blobs_[0].get();
+    Dtype* weight_diff = weight->mutable_cpu_diff();
+    const bool sparse = weight->sparse_diff();
     int index;
     for (int n = 0; n < M_; ++n) {
       index = static_cast<int>(bottom_data[n]);
@@ -99,6 +103,9 @@ void EmbedLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       DCHECK_EQ(static_cast<Dtype>(index), bottom_data[n])
           << "non-integer input";
       caffe_axpy(N_, Dtype(1), top_diff + n * N_, weight_diff + index * N_);
+      if (sparse) {
+        weight->touch_diff_row(index);
+      }
     }
   }
   if (bias_term_ && this->param_propagate_down_[1]) {
@@ -1,11 +1,9 @@
 /*
 TODO:
-- load file in a separate thread ("prefetch")
 - can be smarter about the memcpy call instead of doing it row-by-row
   :: use util functions caffe_copy, and Blob->offset()
-  :: don't forget to update hdf5_daa_layer.cu accordingly
-- add ability to shuffle filenames if flag is set
 */
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -15,62 +13,106 @@ TODO:
 #include "stdint.h"
 
 #include "caffe/layers/hdf5_data_layer.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/hdf5.hpp"
 
 namespace caffe {
 
+// The blob of a batch that feeds top[i].
 template <typename Dtype>
-HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() { }
+static Blob<Dtype>* batch_top(Batch<Dtype>* batch, int i) {
+  if (i == 0) { return &batch->data_; }
+  if (i == 1) { return &batch->label_; }
+  return batch->extra_[i - 2].get();
+}
+
+template <typename Dtype>
+HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() {
+  this->StopInternalThread();
+  if (file_id_ >= 0) {
+    boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
+    H5Fclose(file_id_);
+  }
+}
+
+template <typename Dtype>
+hsize_t HDF5DataLayer<Dtype>::WindowSize() const {
+  const HDF5DataParameter& param = this->layer_param_.hdf5_data_param();
+  const hsize_t window_size = param.has_window_size() ?
+      param.window_size() : 4 * param.batch_size();
+  return window_size > 0 ? std::min(window_size, file_rows_) : file_rows_;
+}
 
-// Load data and label from HDF5 filename into the class property blobs.
+// Open an HDF5 file and load the first window of its data into the class
+// property blobs.
 template <typename Dtype>
 void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
   DLOG(INFO) << "Loading HDF5 file: " << filename;
-  hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
-  if (file_id < 0) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
+  if (file_id_ >= 0) {
+    herr_t status = H5Fclose(file_id_);
+    CHECK_GE(status, 0) << "Failed to close HDF5 file";
+  }
+  file_id_ = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (file_id_ < 0) {
     LOG(FATAL) << "Failed opening HDF5 file: " << filename;
   }
 
   int top_size = this->layer_param_.top_size();
   hdf_blobs_.resize(top_size);
-
-  const int MIN_DATA_DIM = 1;
-  const int MAX_DATA_DIM = INT_MAX;
-
+  // MinTopBlobs==1 guarantees at least one top blob
+  file_rows_ = hdf5_get_num_rows(file_id_, this->layer_param_.top(0).c_str());
+  CHECK_GT(file_rows_, 0) << "No rows in HDF5 file: " << filename;
   for (int i = 0; i < top_size; ++i) {
-    hdf_blobs_[i] = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
-    // Allow reshape here, as we are loading data not params
-    hdf5_load_nd_dataset(file_id, this->layer_param_.top(i).c_str(),
-        MIN_DATA_DIM, MAX_DATA_DIM, hdf_blobs_[i].get(), true);
+    if (!hdf_blobs_[i]) {
+      hdf_blobs_[i].reset(new Blob<Dtype>());
+    }
+    CHECK_EQ(hdf5_get_num_rows(file_id_, this->layer_param_.top(i).c_str()),
+        file_rows_);
   }
 
-  herr_t status = H5Fclose(file_id);
-  CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
+  const HDF5DataParameter& param = this->layer_param_.hdf5_data_param();
+  const hsize_t window_size = WindowSize();
+  window_starts_.clear();
+  for (hsize_t start = 0; start < file_rows_; start += window_size) {
+    window_starts_.push_back(start);
+  }
+  if (param.shuffle()) {
+    std::random_shuffle(window_starts_.begin(), window_starts_.end());
+  }
+  current_window_ = 0;
+  LoadWindow();
+}
 
-  // MinTopBlobs==1 guarantees at least one top blob
-  CHECK_GE(hdf_blobs_[0]->num_axes(), 1) << "Input must have at least 1 axis.";
-  const int num = hdf_blobs_[0]->shape(0);
-  for (int i = 1; i < top_size; ++i) {
-    CHECK_EQ(hdf_blobs_[i]->shape(0), num);
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::LoadWindow() {
+  const HDF5DataParameter& param = this->layer_param_.hdf5_data_param();
+  const hsize_t start = window_starts_[current_window_];
+  const hsize_t rows = std::min(WindowSize(), file_rows_ - start);
+  {
+    boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
+    for (int i = 0; i < hdf_blobs_.size(); ++i) {
+      hdf5_load_nd_dataset_rows(file_id_, this->layer_param_.top(i).c_str(),
+          start, rows, hdf_blobs_[i].get());
+    }
   }
   // Default to identity permutation.
   data_permutation_.clear();
-  data_permutation_.resize(hdf_blobs_[0]->shape(0));
-  for (int i = 0; i < hdf_blobs_[0]->shape(0); i++)
+  data_permutation_.resize(rows);
+  for (int i = 0; i < rows; i++)
     data_permutation_[i] = i;
 
   // Shuffle if needed.
-  if (this->layer_param_.hdf5_data_param().shuffle()) {
+  if (param.shuffle()) {
     std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
-    DLOG(INFO) << "Successfully loaded " << hdf_blobs_[0]->shape(0)
-               << " rows (shuffled)";
+    DLOG(INFO) << "Successfully loaded " << rows << " rows (shuffled)";
   } else {
-    DLOG(INFO) << "Successfully loaded " << hdf_blobs_[0]->shape(0) << " rows";
+    DLOG(INFO) << "Successfully loaded " << rows << " rows";
   }
 }
 
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+void HDF5DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   // Refuse transformation parameters since HDF5 is totally generic.
   CHECK(!this->layer_param_.has_transform_param()) <<
@@ -114,14 +156,20 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Reshape blobs.
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
   const int top_size = this->layer_param_.top_size();
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->extra_.resize(std::max(top_size - 2, 0));
+    for (int j = 0; j < this->prefetch_[i]->extra_.size(); ++j) {
+      this->prefetch_[i]->extra_[j].reset(new Blob<Dtype>());
+    }
+  }
   vector<int> top_shape;
   for (int i = 0; i < top_size; ++i) {
-    top_shape.resize(hdf_blobs_[i]->num_axes());
+    top_shape = hdf_blobs_[i]->shape();
     top_shape[0] = batch_size;
-    for (int j = 1; j < top_shape.size(); ++j) {
-      top_shape[j] = hdf_blobs_[i]->shape(j);
-    }
     top[i]->Reshape(top_shape);
+    for (int j = 0; j < this->prefetch_.size(); ++j) {
+      batch_top(this->prefetch_[j].get(), i)->Reshape(top_shape);
+    }
   }
 }
 
@@ -138,48 +186,60 @@ bool HDF5DataLayer<Dtype>::Skip() {
 template<typename Dtype>
 void HDF5DataLayer<Dtype>::Next() {
   if (++current_row_ == hdf_blobs_[0]->shape(0)) {
-    if (num_files_ > 1) {
-      ++current_file_;
-      if (current_file_ == num_files_) {
-        current_file_ = 0;
-        if (this->layer_param_.hdf5_data_param().shuffle()) {
-          std::random_shuffle(file_permutation_.begin(),
-                              file_permutation_.end());
+    current_row_ = 0;
+    if (++current_window_ == window_starts_.size()) {
+      current_window_ = 0;
+      if (num_files_ > 1) {
+        ++current_file_;
+        if (current_file_ == num_files_) {
+          current_file_ = 0;
+          if (this->layer_param_.hdf5_data_param().shuffle()) {
+            std::random_shuffle(file_permutation_.begin(),
+                                file_permutation_.end());
+          }
+          DLOG(INFO) << "Looping around to first file.";
         }
-        DLOG(INFO) << "Looping around to first file.";
+        LoadHDF5FileData(
+          hdf_filenames_[file_permutation_[current_file_]].c_str());
+        offset_++;
+        return;
       }
-      LoadHDF5FileData(
-        hdf_filenames_[file_permutation_[current_file_]].c_str());
+      if (this->layer_param_.hdf5_data_param().shuffle())
+        std::random_shuffle(window_starts_.begin(), window_starts_.end());
     }
-    current_row_ = 0;
-    if (this->layer_param_.hdf5_data_param().shuffle())
+    // A file read in a single window stays in memory.
+    if (window_starts_.size() > 1) {
+      LoadWindow();
+    } else if (this->layer_param_.hdf5_data_param().shuffle()) {
       std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
+    }
   }
   offset_++;
 }
 
+// This function is called on prefetch thread
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {
+void HDF5DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  CPUTimer timer;
+  timer.Start();
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
+  const int top_size = this->layer_param_.top_size();
   for (int i = 0; i < batch_size; ++i) {
     while (Skip()) {
       Next();
     }
-    for (int j = 0; j < this->layer_param_.top_size(); ++j) {
-      int data_dim = top[j]->count() / top[j]->shape(0);
+    for (int j = 0; j < top_size; ++j) {
+      Blob<Dtype>* top = batch_top(batch, j);
+      int data_dim = top->count() / top->shape(0);
       caffe_copy(data_dim,
           &hdf_blobs_[j]->cpu_data()[data_permutation_[current_row_]
-            * data_dim], &top[j]->mutable_cpu_data()[i * data_dim]);
+            * data_dim], &top->mutable_cpu_data()[i * data_dim]);
     }
     Next();
   }
+  batch->read_time_ = timer.MicroSeconds() / 1000;
 }
 
-#ifdef CPU_ONLY
-STUB_GPU_FORWARD(HDF5DataLayer, Forward);
-#endif
-
 INSTANTIATE_CLASS(HDF5DataLayer);
 REGISTER_LAYER_CLASS(HDF5Data);
 
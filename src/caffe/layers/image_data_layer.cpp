@@ -48,6 +48,13 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
   CHECK(!lines_.empty()) << "File is empty";
 
+  const ImageCacheParameter& cache_param =
+      this->layer_param_.image_data_param().cache_param();
+  if (cache_param.capacity_mb() > 0) {
+    image_cache_ = ImageCache::Get(cache_param.has_name() ?
+        cache_param.name() : source, cache_param);
+  }
+
   if (this->layer_param_.image_data_param().shuffle()) {
     // randomly shuffle data
     LOG(INFO) << "Shuffling data";
@@ -98,6 +105,15 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+cv::Mat ImageDataLayer<Dtype>::ReadImage(const string& filename,
+    const int height, const int width, const bool is_color) {
+  if (image_cache_) {
+    return image_cache_->ReadImage(filename, height, width, is_color);
+  }
+  return ReadImageToCVMat(filename, height, width, is_color);
+}
+
 template <typename Dtype>
 void ImageDataLayer<Dtype>::ShuffleImages() {
   caffe::rng_t* prefetch_rng =
@@ -124,7 +140,7 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
 
   // Reshape according to the first image of each batch
   // on single input batches allows for inputs of varying dimension.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
+  cv::Mat cv_img = ReadImage(root_folder + lines_[lines_id_].first,
       new_height, new_width, is_color);
   CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
   // Use data_transformer to infer the expected blob shape from a cv_img.
@@ -134,7 +150,13 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   top_shape[0] = batch_size;
   batch->data_.Reshape(top_shape);
 
-  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
+  Dtype* prefetch_data = NULL;
+  uint8_t* prefetch_raw_data = NULL;
+  if (this->uint8_batch_) {
+    prefetch_raw_data = this->mutable_raw_data(batch);
+  } else {
+    prefetch_data = batch->data_.mutable_cpu_data();
+  }
   Dtype* prefetch_label = batch->label_.mutable_cpu_data();
 
   // datum scales
@@ -143,15 +165,20 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     // get a blob
     timer.Start();
     CHECK_GT(lines_size, lines_id_);
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
+    cv::Mat cv_img = ReadImage(root_folder + lines_[lines_id_].first,
         new_height, new_width, is_color);
     CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
     read_time += timer.MicroSeconds();
     timer.Start();
     // Apply transformations (mirror, crop...) to the image
     int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
+    if (this->uint8_batch_) {
+      this->data_transformer_->TransformRaw(cv_img,
+          prefetch_raw_data + offset);
+    } else {
+      this->transformed_data_.set_cpu_data(prefetch_data + offset);
+      this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
+    }
     trans_time += timer.MicroSeconds();
 
     prefetch_label[item_id] = lines_[lines_id_].second;
@@ -170,6 +197,9 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  // Images are read and decoded in one call.
+  batch->decode_time_ = read_time / 1000;
+  batch->trans_time_ = trans_time / 1000;
 }
 
 INSTANTIATE_CLASS(ImageDataLayer);
@@ -60,14 +60,15 @@ void InterpLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   CHECK_GT(height_out_, 0) << "height should be positive";
   CHECK_GT(width_out_, 0) << "width should be positive";
   top[0]->Reshape(num_, channels_, height_out_, width_out_);
+  tables_.Setup(- pad_beg_, - pad_beg_, height_in_eff_, width_in_eff_, height_in_, width_in_,
+    0, 0, height_out_, width_out_, height_out_, width_out_);
 }
 
 template <typename Dtype>
 void InterpLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  caffe_cpu_interp2<Dtype,false>(num_ * channels_,
-    bottom[0]->cpu_data(), - pad_beg_, - pad_beg_, height_in_eff_, width_in_eff_, height_in_, width_in_,
-    top[0]->mutable_cpu_data(), 0, 0, height_out_, width_out_, height_out_, width_out_);
+  caffe_cpu_interp2(num_ * channels_, tables_,
+    bottom[0]->cpu_data(), top[0]->mutable_cpu_data());
 }
 
 template <typename Dtype>
@@ -75,9 +76,8 @@ void InterpLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (!propagate_down[0]) { return; }
   caffe_set(bottom[0]->count(), Dtype(0), bottom[0]->mutable_cpu_diff());
-  caffe_cpu_interp2_backward<Dtype,false>(num_ * channels_,
-    bottom[0]->mutable_cpu_diff(), - pad_beg_, - pad_beg_, height_in_eff_, width_in_eff_, height_in_, width_in_,
-    top[0]->cpu_diff(), 0, 0, height_out_, width_out_, height_out_, width_out_);
+  caffe_cpu_interp2_backward(num_ * channels_, tables_,
+    bottom[0]->mutable_cpu_diff(), top[0]->cpu_diff());
 }
 
 #ifndef CPU_ONLY
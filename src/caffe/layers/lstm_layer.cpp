@@ -1,3 +1,4 @@
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -24,6 +25,18 @@ void LSTMLayer<Dtype>::RecurrentOutputBlobNames(vector<string>* names) const {
   (*names)[1] = "c_T";
 }
 
+template <typename Dtype>
+void LSTMLayer<Dtype>::RecurrentStateBlobNames(int t,
+    vector<string>* names) const {
+  if (t == 0) {
+    RecurrentInputBlobNames(names);
+    return;
+  }
+  names->resize(2);
+  (*names)[0] = "h_" + format_int(t);
+  (*names)[1] = "c_" + format_int(t);
+}
+
 template <typename Dtype>
 void LSTMLayer<Dtype>::RecurrentInputShapes(vector<BlobShape>* shapes) const {
   const int num_output = this->layer_param_.recurrent_param().num_output();
@@ -238,6 +251,80 @@ void LSTMLayer<Dtype>::FillUnrolledNet(NetParameter* net_param) const {
   net_param->add_layer()->CopyFrom(output_concat_layer);
 }
 
+template <typename Dtype>
+inline Dtype streaming_sigmoid(Dtype x) {
+  return 1. / (1. + exp(-x));
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::StreamingForward(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const int T = this->T_;
+  const int N = this->N_;
+  const int hidden_dim = this->layer_param_.recurrent_param().num_output();
+  const int gate_dim = 4 * hidden_dim;
+  const int x_dim = bottom[0]->count(2);
+  // The parameters, in the order the unrolled net creates them.
+  const Blob<Dtype>& W_xc = *this->blobs_[0];
+  const Blob<Dtype>& b_c = *this->blobs_[1];
+  const Blob<Dtype>& W_hc = *this->blobs_[this->static_input_ ? 3 : 2];
+  CHECK_EQ(x_dim, W_xc.count(1)) << "input dimension changed";
+  CHECK_EQ(hidden_dim, W_hc.count(1));
+
+  // W_xc * x + b_c for all timesteps at once, plus W_xc_static * x_static.
+  gates_.Reshape(T, N, gate_dim, 1);
+  Dtype* gates = gates_.mutable_cpu_data();
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, T * N, gate_dim, x_dim,
+      Dtype(1), bottom[0]->cpu_data(), W_xc.cpu_data(), Dtype(0), gates);
+  for (int r = 0; r < T * N; ++r) {
+    caffe_axpy<Dtype>(gate_dim, Dtype(1), b_c.cpu_data(), gates + r * gate_dim);
+  }
+  if (this->static_input_) {
+    const Blob<Dtype>& W_xc_static = *this->blobs_[2];
+    static_gates_.Reshape(N, gate_dim, 1, 1);
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, gate_dim,
+        bottom[2]->count(1), Dtype(1), bottom[2]->cpu_data(),
+        W_xc_static.cpu_data(), Dtype(0), static_gates_.mutable_cpu_data());
+    for (int t = 0; t < T; ++t) {
+      caffe_axpy<Dtype>(N * gate_dim, Dtype(1), static_gates_.cpu_data(),
+          gates + t * N * gate_dim);
+    }
+  }
+
+  h_conted_.Reshape(N, hidden_dim, 1, 1);
+  Dtype* h_conted = h_conted_.mutable_cpu_data();
+  Dtype* h = this->stream_state_[0]->mutable_cpu_data();
+  Dtype* c = this->stream_state_[1]->mutable_cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  for (int t = 0; t < T; ++t) {
+    const Dtype* cont = bottom[1]->cpu_data() + t * N;
+    Dtype* gate_input = gates + t * N * gate_dim;
+    // gate_input_t += W_hc * (cont_t * h_{t-1})
+    for (int n = 0; n < N; ++n) {
+      caffe_cpu_scale(hidden_dim, cont[n], h + n * hidden_dim,
+          h_conted + n * hidden_dim);
+    }
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, gate_dim, hidden_dim,
+        Dtype(1), h_conted, W_hc.cpu_data(), Dtype(1), gate_input);
+    // The LSTMUnit non-linearity, updating the state in place.
+    for (int n = 0; n < N; ++n) {
+      const Dtype* X = gate_input + n * gate_dim;
+      Dtype* C = c + n * hidden_dim;
+      Dtype* H = h + n * hidden_dim;
+      for (int d = 0; d < hidden_dim; ++d) {
+        const Dtype i = streaming_sigmoid(X[d]);
+        const Dtype f = (cont[n] == 0) ? 0 :
+            (cont[n] * streaming_sigmoid(X[1 * hidden_dim + d]));
+        const Dtype o = streaming_sigmoid(X[2 * hidden_dim + d]);
+        const Dtype g = 2. * streaming_sigmoid(2. * X[3 * hidden_dim + d]) - 1.;
+        C[d] = f * C[d] + i * g;
+        H[d] = o * (2. * streaming_sigmoid(2. * C[d]) - 1.);
+      }
+    }
+    caffe_copy(N * hidden_dim, h, top_data + t * N * hidden_dim);
+  }
+}
+
 INSTANTIATE_CLASS(LSTMLayer);
 REGISTER_LAYER_CLASS(LSTM);
 
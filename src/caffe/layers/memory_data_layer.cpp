@@ -2,12 +2,55 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/memory_data_layer.hpp"
 
 namespace caffe {
 
+template <typename Dtype>
+class MemoryDataLayer<Dtype>::sync {
+ public:
+  mutable boost::mutex mutex_;
+  boost::condition_variable not_empty_;
+  boost::condition_variable not_full_;
+};
+
+class QueueHasSamples {
+ public:
+  QueueHasSamples(const int* count, int n) : count_(count), n_(n) {}
+  bool operator()() const { return *count_ >= n_; }
+
+ private:
+  const int* count_;
+  int n_;
+};
+
+class QueueHasRoom {
+ public:
+  QueueHasRoom(const int* count, int capacity, int n)
+      : count_(count), capacity_(capacity), n_(n) {}
+  bool operator()() const { return *count_ + n_ <= capacity_; }
+
+ private:
+  const int* count_;
+  int capacity_, n_;
+};
+
+// Waits on condition until ready() or the timeout runs out. Returns ready().
+template <typename Predicate>
+static bool wait_for(boost::condition_variable* condition,
+    boost::mutex::scoped_lock* lock, int timeout_ms, Predicate ready) {
+  if (timeout_ms < 0) {
+    condition->wait(*lock, ready);
+    return true;
+  }
+  return condition->timed_wait(*lock,
+      boost::posix_time::milliseconds(timeout_ms), ready);
+}
+
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
      const vector<Blob<Dtype>*>& top) {
@@ -28,6 +71,17 @@ void MemoryDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   labels_ = NULL;
   added_data_.cpu_data();
   added_label_.cpu_data();
+  const int capacity = this->layer_param_.memory_data_param().queue_capacity();
+  if (capacity > 0) {
+    CHECK_GE(capacity, batch_size_)
+        << "queue_capacity must hold at least one batch";
+    sync_.reset(new sync());
+    queue_data_.Reshape(capacity, channels_, height_, width_);
+    queue_labels_.Reshape(capacity, 1, 1, 1);
+    queue_head_ = 0;
+    queue_count_ = 0;
+    queue_held_ = 0;
+  }
 }
 
 template <typename Dtype>
@@ -83,6 +137,7 @@ template <typename Dtype>
 void MemoryDataLayer<Dtype>::Reset(Dtype* data, Dtype* labels, int n) {
   CHECK(data);
   CHECK(labels);
+  CHECK(!sync_) << "Use Push() to feed a MemoryDataLayer with a queue";
   CHECK_EQ(n % batch_size_, 0) << "n must be a multiple of batch size";
   // Warn with transformation parameters since a memory array is meant to
   // be generic and no transformations are done with Reset().
@@ -99,14 +154,107 @@ template <typename Dtype>
 void MemoryDataLayer<Dtype>::set_batch_size(int new_size) {
   CHECK(!has_new_data_) <<
       "Can't change batch_size until current data has been consumed.";
+  if (sync_) {
+    CHECK_LE(new_size, queue_labels_.count())
+        << "queue_capacity must hold at least one batch";
+  }
   batch_size_ = new_size;
   added_data_.Reshape(batch_size_, channels_, height_, width_);
   added_label_.Reshape(batch_size_, 1, 1, 1);
 }
 
+template <typename Dtype>
+bool MemoryDataLayer<Dtype>::Push(const Dtype* data, const Dtype* labels,
+    int n, int timeout_ms) {
+  CHECK(sync_) << "Push() needs memory_data_param.queue_capacity";
+  const int capacity = queue_labels_.count();
+  CHECK_GT(n, 0);
+  CHECK_LE(n, capacity) << "Can't push more samples than queue_capacity";
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (!wait_for(&sync_->not_full_, &lock, timeout_ms,
+      QueueHasRoom(&queue_count_, capacity, n))) {
+    return false;
+  }
+  // Copy under the lock so that the samples of one Push stay together when
+  // several threads produce.
+  int tail = (queue_head_ + queue_count_) % capacity;
+  for (int done = 0; done < n; ) {
+    const int chunk = std::min(n - done, capacity - tail);
+    caffe_copy(chunk * size_, data + done * size_,
+        queue_data_.mutable_cpu_data() + tail * size_);
+    caffe_copy(chunk, labels + done, queue_labels_.mutable_cpu_data() + tail);
+    done += chunk;
+    tail = (tail + chunk) % capacity;
+  }
+  queue_count_ += n;
+  lock.unlock();
+  sync_->not_empty_.notify_one();
+  return true;
+}
+
+template <typename Dtype>
+int MemoryDataLayer<Dtype>::queue_size() const {
+  CHECK(sync_) << "MemoryDataLayer has no queue";
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return queue_count_ - queue_held_;
+}
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::ForwardFromQueue(
+    const vector<Blob<Dtype>*>& top) {
+  const MemoryDataParameter& param = this->layer_param_.memory_data_param();
+  const int capacity = queue_labels_.count();
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  // The net is done with the previous batch once it runs forward again.
+  queue_head_ = (queue_head_ + queue_held_) % capacity;
+  queue_count_ -= queue_held_;
+  queue_held_ = 0;
+  sync_->not_full_.notify_all();
+  // A slow producer is not an error: without partial batches, keep waiting.
+  while (!wait_for(&sync_->not_empty_, &lock, param.timeout_ms(),
+      QueueHasSamples(&queue_count_, batch_size_))) {
+    if (param.partial_batch()) {
+      wait_for(&sync_->not_empty_, &lock, -1,
+          QueueHasSamples(&queue_count_, 1));
+      break;
+    }
+    LOG(WARNING) << "Timed out waiting for " << batch_size_ << " samples, "
+        << "only " << queue_count_ << " queued; still waiting";
+  }
+  const int n = std::min(queue_count_, batch_size_);
+  top[0]->Reshape(n, channels_, height_, width_);
+  top[1]->Reshape(n, 1, 1, 1);
+  if (queue_head_ + n <= capacity) {
+    // Zero-copy: producers can't overwrite these slots until they are
+    // released by the next Forward.
+    top[0]->set_cpu_data(queue_data_.mutable_cpu_data() + queue_head_ * size_);
+    top[1]->set_cpu_data(queue_labels_.mutable_cpu_data() + queue_head_);
+  } else {
+    // The batch wraps around the end of the ring.
+    const int first = capacity - queue_head_;
+    added_data_.Reshape(n, channels_, height_, width_);
+    added_label_.Reshape(n, 1, 1, 1);
+    caffe_copy(first * size_, queue_data_.cpu_data() + queue_head_ * size_,
+        added_data_.mutable_cpu_data());
+    caffe_copy((n - first) * size_, queue_data_.cpu_data(),
+        added_data_.mutable_cpu_data() + first * size_);
+    caffe_copy(first, queue_labels_.cpu_data() + queue_head_,
+        added_label_.mutable_cpu_data());
+    caffe_copy(n - first, queue_labels_.cpu_data(),
+        added_label_.mutable_cpu_data() + first);
+    top[0]->set_cpu_data(added_data_.mutable_cpu_data());
+    top[1]->set_cpu_data(added_label_.mutable_cpu_data());
+  }
+  queue_held_ = n;
+}
+
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (sync_) {
+    ForwardFromQueue(top);
+    return;
+  }
   CHECK(data_) << "MemoryDataLayer needs to be initialized by calling Reset";
   top[0]->Reshape(batch_size_, channels_, height_, width_);
   top[1]->Reshape(batch_size_, 1, 1, 1);
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <cfloat>
+#include <cstring>
 #include <vector>
 
 #include "caffe/layers/pooling_layer.hpp"
@@ -73,6 +74,12 @@ void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     CHECK_LT(pad_h_, kernel_h_);
     CHECK_LT(pad_w_, kernel_w_);
   }
+  offset_mask_ = top.size() > 1 &&
+      pool_param.mask_format() == PoolingParameter_MaskFormat_OFFSET;
+  if (offset_mask_) {
+    CHECK_LT(kernel_h_ * kernel_w_, kNoMaskOffset)
+        << "OFFSET masks need windows of less than 255 elements";
+  }
 }
 
 template <typename Dtype>
@@ -105,10 +112,14 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
   top[0]->Reshape(bottom[0]->num(), channels_, pooled_height_,
       pooled_width_);
-  if (top.size() > 1) {
+  if (offset_mask_) {
+    top[1]->Reshape(bottom[0]->num(), channels_, 1,
+        PackedMaskWidth<Dtype>(pooled_height_ * pooled_width_));
+  } else if (top.size() > 1) {
     top[1]->ReshapeLike(*top[0]);
   }
-  // If max pooling, we will initialize the vector index part.
+  // If max pooling without a top mask, we will initialize the vector index
+  // part. Top masks are written directly.
   if (this->layer_param_.pooling_param().pool() ==
       PoolingParameter_PoolMethod_MAX && top.size() == 1) {
     max_idx_.Reshape(bottom[0]->num(), channels_, pooled_height_,
@@ -120,103 +131,300 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     rand_idx_.Reshape(bottom[0]->num(), channels_, pooled_height_,
       pooled_width_);
   }
+  global_window_ = pooled_height_ == 1 && pooled_width_ == 1 &&
+      pad_h_ == 0 && pad_w_ == 0 &&
+      kernel_h_ >= height_ && kernel_w_ >= width_;
+  stride2_kernel_ = 0;
+  full_pooled_h_ = full_pooled_w_ = 0;
+  if (!global_window_ && pad_h_ == 0 && pad_w_ == 0 &&
+      stride_h_ == 2 && stride_w_ == 2 && kernel_h_ == kernel_w_ &&
+      (kernel_h_ == 2 || kernel_h_ == 3) &&
+      height_ >= kernel_h_ && width_ >= kernel_w_) {
+    stride2_kernel_ = kernel_h_;
+    full_pooled_h_ = (height_ - kernel_h_) / 2 + 1;
+    full_pooled_w_ = (width_ - kernel_w_) / 2 + 1;
+  }
+}
+
+// The masks max pooling can record, each writing the argmax of an output
+// straight into its storage. Plane(i) moves to the mask of plane i, and
+// Set(pool_index, ph, pw, index) records the bottom index of the maximum of
+// output (ph, pw) of a plane, or -1 for an empty window.
+struct PoolingNoMask {
+  static const bool kEnabled = false;
+  PoolingNoMask Plane(int i) const { return *this; }
+  void Set(int pool_index, int ph, int pw, int index) const {}
+};
+
+// Plain indices, as in max_idx_ or a Dtype top mask.
+template <typename T>
+struct PoolingIndexMask {
+  static const bool kEnabled = true;
+  PoolingIndexMask(T* mask, int plane_dim) : mask(mask), plane_dim(plane_dim) {}
+  PoolingIndexMask Plane(int i) const {
+    return PoolingIndexMask(mask + i * plane_dim, plane_dim);
+  }
+  void Set(int pool_index, int ph, int pw, int index) const {
+    mask[pool_index] = index;
+  }
+  T* mask;
+  int plane_dim;
+};
+
+// One byte per output: the offset of the maximum within its window.
+struct PoolingOffsetMask {
+  static const bool kEnabled = true;
+  PoolingOffsetMask Plane(int i) const {
+    PoolingOffsetMask plane = *this;
+    plane.mask += i * plane_dim;
+    return plane;
+  }
+  void Set(int pool_index, int ph, int pw, int index) const {
+    mask[pool_index] = index < 0 ? kNoMaskOffset :
+        (index / width - ph * stride_h + pad_h) * kernel_w +
+        index % width - pw * stride_w + pad_w;
+  }
+  uint8_t* mask;
+  int plane_dim;
+  int width, kernel_w, stride_h, stride_w, pad_h, pad_w;
+};
+
+// Max over the unclipped K x K, stride 2 windows of the first full_h x full_w
+// outputs of a plane. Windows are scanned in the same row-major order as
+// MaxPoolWindows, so ties resolve to the same argmax.
+template <typename Dtype, int K, typename Mask>
+static void MaxPoolStride2(const Dtype* bottom, int width, int pooled_width,
+    int full_h, int full_w, Dtype* top, const Mask& mask) {
+  for (int ph = 0; ph < full_h; ++ph) {
+    const Dtype* row = bottom + 2 * ph * width;
+    Dtype* out = top + ph * pooled_width;
+    if (Mask::kEnabled) {
+      for (int pw = 0; pw < full_w; ++pw) {
+        Dtype maxval = -FLT_MAX;
+        int maxidx = -1;
+        for (int kh = 0; kh < K; ++kh) {
+          const Dtype* in = row + kh * width + 2 * pw;
+          for (int kw = 0; kw < K; ++kw) {
+            if (in[kw] > maxval) {
+              maxval = in[kw];
+              maxidx = (2 * ph + kh) * width + 2 * pw + kw;
+            }
+          }
+        }
+        out[pw] = maxval;
+        mask.Set(ph * pooled_width + pw, ph, pw, maxidx);
+      }
+    } else {
+      // Without a mask, go row by row so the loop over outputs vectorizes.
+      for (int pw = 0; pw < full_w; ++pw) {
+        out[pw] = -FLT_MAX;
+      }
+      for (int kh = 0; kh < K; ++kh) {
+        const Dtype* in = row + kh * width;
+        for (int pw = 0; pw < full_w; ++pw) {
+          Dtype maxval = out[pw];
+          for (int kw = 0; kw < K; ++kw) {
+            maxval = in[2 * pw + kw] > maxval ? in[2 * pw + kw] : maxval;
+          }
+          out[pw] = maxval;
+        }
+      }
+    }
+  }
+}
+
+// Average counterpart of MaxPoolStride2, summing in the same order as
+// AvePoolWindows.
+template <typename Dtype, int K>
+static void AvePoolStride2(const Dtype* bottom, int width, int pooled_width,
+    int full_h, int full_w, Dtype* top) {
+  for (int ph = 0; ph < full_h; ++ph) {
+    const Dtype* row = bottom + 2 * ph * width;
+    Dtype* out = top + ph * pooled_width;
+    for (int pw = 0; pw < full_w; ++pw) {
+      out[pw] = 0;
+    }
+    for (int kh = 0; kh < K; ++kh) {
+      const Dtype* in = row + kh * width;
+      for (int pw = 0; pw < full_w; ++pw) {
+        for (int kw = 0; kw < K; ++kw) {
+          out[pw] += in[2 * pw + kw];
+        }
+      }
+    }
+    for (int pw = 0; pw < full_w; ++pw) {
+      out[pw] /= K * K;
+    }
+  }
 }
 
-// TODO(Yangqing): Is there a faster way to do pooling in the channel-first
-// case?
+template <typename Dtype>
+template <typename Mask>
+void PoolingLayer<Dtype>::MaxPoolWindows(const Dtype* bottom, Dtype* top,
+    const Mask& mask, int ph_begin, int ph_end, int pw_begin, int pw_end) {
+  for (int ph = ph_begin; ph < ph_end; ++ph) {
+    for (int pw = pw_begin; pw < pw_end; ++pw) {
+      int hstart = ph * stride_h_ - pad_h_;
+      int wstart = pw * stride_w_ - pad_w_;
+      const int hend = min(hstart + kernel_h_, height_);
+      const int wend = min(wstart + kernel_w_, width_);
+      hstart = max(hstart, 0);
+      wstart = max(wstart, 0);
+      Dtype maxval = -FLT_MAX;
+      int maxidx = -1;
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          const int index = h * width_ + w;
+          if (bottom[index] > maxval) {
+            maxval = bottom[index];
+            maxidx = index;
+          }
+        }
+      }
+      const int pool_index = ph * pooled_width_ + pw;
+      top[pool_index] = maxval;
+      mask.Set(pool_index, ph, pw, maxidx);
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::AvePoolWindows(const Dtype* bottom, Dtype* top,
+    int ph_begin, int ph_end, int pw_begin, int pw_end) {
+  for (int ph = ph_begin; ph < ph_end; ++ph) {
+    for (int pw = pw_begin; pw < pw_end; ++pw) {
+      int hstart = ph * stride_h_ - pad_h_;
+      int wstart = pw * stride_w_ - pad_w_;
+      int hend = min(hstart + kernel_h_, height_ + pad_h_);
+      int wend = min(wstart + kernel_w_, width_ + pad_w_);
+      const int pool_size = (hend - hstart) * (wend - wstart);
+      hstart = max(hstart, 0);
+      wstart = max(wstart, 0);
+      hend = min(hend, height_);
+      wend = min(wend, width_);
+      Dtype aveval = 0;
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          aveval += bottom[h * width_ + w];
+        }
+      }
+      top[ph * pooled_width_ + pw] = aveval / pool_size;
+    }
+  }
+}
+
+template <typename Dtype>
+template <typename Mask>
+void PoolingLayer<Dtype>::MaxPoolPlanes_cpu(int planes,
+    const Dtype* bottom_data, Dtype* top_data, const Mask& mask) {
+  const int bottom_dim = height_ * width_;
+  const int top_dim = pooled_height_ * pooled_width_;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < planes; ++i) {
+    const Dtype* bottom = bottom_data + i * bottom_dim;
+    Dtype* top = top_data + i * top_dim;
+    const Mask plane_mask = mask.Plane(i);
+    if (global_window_) {
+      Dtype maxval = -FLT_MAX;
+      int maxidx = -1;
+      for (int j = 0; j < bottom_dim; ++j) {
+        if (bottom[j] > maxval) {
+          maxval = bottom[j];
+          maxidx = j;
+        }
+      }
+      top[0] = maxval;
+      plane_mask.Set(0, 0, 0, maxidx);
+      continue;
+    }
+    if (stride2_kernel_ == 2) {
+      MaxPoolStride2<Dtype, 2, Mask>(bottom, width_, pooled_width_,
+          full_pooled_h_, full_pooled_w_, top, plane_mask);
+    } else if (stride2_kernel_ == 3) {
+      MaxPoolStride2<Dtype, 3, Mask>(bottom, width_, pooled_width_,
+          full_pooled_h_, full_pooled_w_, top, plane_mask);
+    }
+    // The clipped right column and bottom row, or everything.
+    MaxPoolWindows(bottom, top, plane_mask,
+        0, full_pooled_h_, full_pooled_w_, pooled_width_);
+    MaxPoolWindows(bottom, top, plane_mask,
+        full_pooled_h_, pooled_height_, 0, pooled_width_);
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::AvePoolPlanes_cpu(int planes,
+    const Dtype* bottom_data, Dtype* top_data) {
+  const int bottom_dim = height_ * width_;
+  const int top_dim = pooled_height_ * pooled_width_;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < planes; ++i) {
+    const Dtype* bottom = bottom_data + i * bottom_dim;
+    Dtype* top = top_data + i * top_dim;
+    if (global_window_) {
+      Dtype aveval = 0;
+      for (int j = 0; j < bottom_dim; ++j) {
+        aveval += bottom[j];
+      }
+      top[0] = aveval / bottom_dim;
+      continue;
+    }
+    if (stride2_kernel_ == 2) {
+      AvePoolStride2<Dtype, 2>(bottom, width_, pooled_width_,
+          full_pooled_h_, full_pooled_w_, top);
+    } else if (stride2_kernel_ == 3) {
+      AvePoolStride2<Dtype, 3>(bottom, width_, pooled_width_,
+          full_pooled_h_, full_pooled_w_, top);
+    }
+    AvePoolWindows(bottom, top, 0, full_pooled_h_, full_pooled_w_,
+        pooled_width_);
+    AvePoolWindows(bottom, top, full_pooled_h_, pooled_height_, 0,
+        pooled_width_);
+  }
+}
+
+// Planes are pooled independently and in parallel. MAX pooling in the TEST
+// phase does not record the argmax unless a top mask is requested.
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const int top_count = top[0]->count();
+  const int planes = top[0]->count(0, 2);
+  const int top_dim = pooled_height_ * pooled_width_;
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
-  int* mask = NULL;  // suppress warnings about uninitalized variables
-  Dtype* top_mask = NULL;
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more code.
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // Initialize
-    if (use_top_mask) {
-      top_mask = top[1]->mutable_cpu_data();
-      caffe_set(top_count, Dtype(-1), top_mask);
+    if (offset_mask_) {
+      PoolingOffsetMask mask;
+      mask.mask = reinterpret_cast<uint8_t*>(top[1]->mutable_cpu_data());
+      mask.plane_dim = top[1]->count(2) * sizeof(Dtype);
+      mask.width = width_;
+      mask.kernel_w = kernel_w_;
+      mask.stride_h = stride_h_;
+      mask.stride_w = stride_w_;
+      mask.pad_h = pad_h_;
+      mask.pad_w = pad_w_;
+      // Fill the padding at the end of each plane's mask.
+      memset(mask.mask, kNoMaskOffset, top[1]->count() * sizeof(Dtype));
+      MaxPoolPlanes_cpu(planes, bottom_data, top_data, mask);
+    } else if (use_top_mask) {
+      MaxPoolPlanes_cpu(planes, bottom_data, top_data,
+          PoolingIndexMask<Dtype>(top[1]->mutable_cpu_data(), top_dim));
+    } else if (this->phase_ != TEST) {
+      MaxPoolPlanes_cpu(planes, bottom_data, top_data,
+          PoolingIndexMask<int>(max_idx_.mutable_cpu_data(), top_dim));
     } else {
-      mask = max_idx_.mutable_cpu_data();
-      caffe_set(top_count, -1, mask);
-    }
-    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
-      }
+      MaxPoolPlanes_cpu(planes, bottom_data, top_data, PoolingNoMask());
     }
     break;
   case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
-    }
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
-            }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-      }
-    }
+    AvePoolPlanes_cpu(planes, bottom_data, top_data);
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
     NOT_IMPLEMENTED;
@@ -234,67 +442,91 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
   const Dtype* top_diff = top[0]->cpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more codes.
   caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
+  const int planes = top[0]->count(0, 2);
+  const int bottom_dim = height_ * width_;
+  const int top_dim = pooled_height_ * pooled_width_;
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
   const int* mask = NULL;  // suppress warnings about uninitialized variables
   const Dtype* top_mask = NULL;
+  const uint8_t* offset_mask = NULL;
+  int mask_dim = top_dim;
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // The main loop
-    if (use_top_mask) {
+    if (offset_mask_) {
+      offset_mask = reinterpret_cast<const uint8_t*>(top[1]->cpu_data());
+      mask_dim = top[1]->count(2) * sizeof(Dtype);
+    } else if (use_top_mask) {
       top_mask = top[1]->cpu_data();
     } else {
+      if (this->phase_ == TEST) {
+        // Forward did not keep the argmax; recompute it.
+        Blob<Dtype> pooled(top[0]->shape());
+        MaxPoolPlanes_cpu(planes, bottom[0]->cpu_data(),
+            pooled.mutable_cpu_data(),
+            PoolingIndexMask<int>(max_idx_.mutable_cpu_data(), top_dim));
+      }
       mask = max_idx_.cpu_data();
     }
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            const int index = ph * pooled_width_ + pw;
-            const int bottom_index =
-                use_top_mask ? top_mask[index] : mask[index];
-            bottom_diff[bottom_index] += top_diff[index];
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < planes; ++i) {
+      Dtype* plane_diff = bottom_diff + i * bottom_dim;
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          const int index = ph * pooled_width_ + pw;
+          int bottom_index;
+          if (offset_mask_) {
+            const int offset = offset_mask[i * mask_dim + index];
+            if (offset == kNoMaskOffset) {
+              continue;
+            }
+            bottom_index =
+                (ph * stride_h_ - pad_h_ + offset / kernel_w_) * width_ +
+                pw * stride_w_ - pad_w_ + offset % kernel_w_;
+          } else if (use_top_mask) {
+            bottom_index = top_mask[i * top_dim + index];
+          } else {
+            bottom_index = mask[i * top_dim + index];
+          }
+          if (bottom_index >= 0) {
+            plane_diff[bottom_index] += top_diff[i * top_dim + index];
           }
-        }
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
         }
       }
     }
     break;
   case PoolingParameter_PoolMethod_AVE:
-    // The main loop
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                bottom_diff[h * width_ + w] +=
-                  top_diff[ph * pooled_width_ + pw] / pool_size;
-              }
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < planes; ++i) {
+      Dtype* plane_diff = bottom_diff + i * bottom_dim;
+      const Dtype* plane_top_diff = top_diff + i * top_dim;
+      if (global_window_) {
+        caffe_set(bottom_dim, plane_top_diff[0] / bottom_dim, plane_diff);
+        continue;
+      }
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          int hstart = ph * stride_h_ - pad_h_;
+          int wstart = pw * stride_w_ - pad_w_;
+          int hend = min(hstart + kernel_h_, height_ + pad_h_);
+          int wend = min(wstart + kernel_w_, width_ + pad_w_);
+          int pool_size = (hend - hstart) * (wend - wstart);
+          hstart = max(hstart, 0);
+          wstart = max(wstart, 0);
+          hend = min(hend, height_);
+          wend = min(wend, width_);
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              plane_diff[h * width_ + w] +=
+                plane_top_diff[ph * pooled_width_ + pw] / pool_size;
             }
           }
         }
-        // offset
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
       }
     }
     break;
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -10,6 +11,16 @@
 
 namespace caffe {
 
+// Copies a (T x ...) blob into a (T' x ...) one with the same inner axes,
+// dropping the timesteps past T' or zero filling those past T.
+template <typename Dtype>
+static void copy_timesteps(int src_count, const Dtype* src, int dst_count,
+    Dtype* dst) {
+  const int count = std::min(src_count, dst_count);
+  caffe_copy(count, src, dst);
+  caffe_set(dst_count - count, Dtype(0), dst + count);
+}
+
 template <typename Dtype>
 void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -27,7 +38,12 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
   // If expose_hidden is set, we take as input and produce as output
   // the hidden state blobs at the first and last timesteps.
-  expose_hidden_ = this->layer_param_.recurrent_param().expose_hidden();
+  const RecurrentParameter& recurrent_param =
+      this->layer_param_.recurrent_param();
+  expose_hidden_ = recurrent_param.expose_hidden();
+  streaming_ = recurrent_param.streaming();
+  CHECK(!streaming_ || SupportsStreaming())
+      << this->type() << " layers do not support streaming";
 
   // Get (recurrent) input/output names.
   vector<string> output_names;
@@ -40,12 +56,85 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   CHECK_EQ(num_recur_blobs, recur_output_names.size());
 
   // If provided, bottom[2] is a static input to the recurrent net.
+  length_input_ = recurrent_param.sequence_length_input();
   const int num_hidden_exposed = expose_hidden_ * num_recur_blobs;
-  static_input_ = (bottom.size() > 2 + num_hidden_exposed);
+  static_input_ = (bottom.size() > 2 + num_hidden_exposed + length_input_);
   if (static_input_) {
     CHECK_GE(bottom[2]->num_axes(), 1);
     CHECK_EQ(N_, bottom[2]->shape(0));
   }
+  CHECK_EQ(top.size() - num_hidden_exposed, output_names.size())
+      << "OutputBlobNames must provide an output blob name for each top.";
+
+  // Create one unrolled net for each length bucket, or a single one for the
+  // input length.
+  length_buckets_.assign(recurrent_param.length_buckets().begin(),
+                         recurrent_param.length_buckets().end());
+  std::sort(length_buckets_.begin(), length_buckets_.end());
+  length_buckets_.erase(
+      std::unique(length_buckets_.begin(), length_buckets_.end()),
+      length_buckets_.end());
+  unrolled_nets_.clear();
+  CHECK(!length_input_ || length_buckets_.size())
+      << "sequence_length_input needs length_buckets";
+  if (length_buckets_.size()) {
+    CHECK(!streaming_) << "Streaming recurrent layers do not use buckets.";
+    CHECK_GT(length_buckets_[0], 0) << "Length buckets must be positive.";
+    for (int i = 0; i < length_buckets_.size(); ++i) {
+      T_ = length_buckets_[i];
+      LOG(INFO) << "Unrolling recurrent layer over " << T_ << " timesteps";
+      unrolled_nets_.push_back(CreateUnrolledNet(bottom));
+    }
+  } else {
+    unrolled_nets_.push_back(CreateUnrolledNet(bottom));
+  }
+
+  // This layer's parameters are any parameters in the layers of the unrolled
+  // net. We only want one copy of each parameter, so check that the parameter
+  // is "owned" by the layer, rather than shared with another.  The nets of
+  // the other buckets share the parameters of the first one.
+  const shared_ptr<Net<Dtype> >& first_net = unrolled_nets_[0];
+  this->blobs_.clear();
+  for (int i = 0; i < first_net->params().size(); ++i) {
+    if (first_net->param_owners()[i] == -1) {
+      LOG(INFO) << "Adding parameter " << i << ": "
+                << first_net->param_display_names()[i];
+      this->blobs_.push_back(first_net->params()[i]);
+    }
+  }
+  for (int i = 1; i < unrolled_nets_.size(); ++i) {
+    ShareUnrolledNetParams(unrolled_nets_[i].get());
+  }
+  this->param_propagate_down_.clear();
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+
+  top_bucket_.resize(output_names.size());
+  for (int i = 0; i < output_names.size(); ++i) {
+    top_bucket_[i].reset(new Blob<Dtype>());
+  }
+  unrolled_net_index_ = -1;
+  SelectUnrolledNet(0);
+
+  // The unrolled net above still owns the parameters in streaming mode;
+  // only the state lives outside of it.  Buckets keep the state outside of
+  // their nets too, as each stream's last valid timestep may differ.
+  if (streaming_ || length_buckets_.size()) {
+    stream_state_.resize(num_recur_blobs);
+    for (int i = 0; i < num_recur_blobs; ++i) {
+      stream_state_[i].reset(new Blob<Dtype>());
+    }
+  }
+}
+
+template <typename Dtype>
+shared_ptr<Net<Dtype> > RecurrentLayer<Dtype>::CreateUnrolledNet(
+    const vector<Blob<Dtype>*>& bottom) const {
+  vector<string> output_names;
+  OutputBlobNames(&output_names);
+  vector<string> recur_input_names;
+  RecurrentInputBlobNames(&recur_input_names);
+  vector<string> recur_output_names;
+  RecurrentOutputBlobNames(&recur_output_names);
 
   // Create a NetParameter; setup the inputs that aren't unique to particular
   // recurrent architectures.
@@ -56,15 +145,15 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   InputParameter* input_param = input_layer_param->mutable_input_param();
   input_layer_param->add_top("x");
   BlobShape input_shape;
-  for (int i = 0; i < bottom[0]->num_axes(); ++i) {
+  input_shape.add_dim(T_);
+  for (int i = 1; i < bottom[0]->num_axes(); ++i) {
     input_shape.add_dim(bottom[0]->shape(i));
   }
   input_param->add_shape()->CopyFrom(input_shape);
 
   input_shape.Clear();
-  for (int i = 0; i < bottom[1]->num_axes(); ++i) {
-    input_shape.add_dim(bottom[1]->shape(i));
-  }
+  input_shape.add_dim(T_);
+  input_shape.add_dim(N_);
   input_layer_param->add_top("cont");
   input_param->add_shape()->CopyFrom(input_shape);
 
@@ -105,77 +194,127 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 
   // Create the unrolled net.
-  unrolled_net_.reset(new Net<Dtype>(net_param));
-  unrolled_net_->set_debug_info(
-      this->layer_param_.recurrent_param().debug_info());
+  shared_ptr<Net<Dtype> > net(new Net<Dtype>(net_param));
+  net->set_debug_info(this->layer_param_.recurrent_param().debug_info());
+
+  // We should have 2 inputs (x and cont), plus a number of recurrent inputs,
+  // plus maybe a static input.
+  CHECK_EQ(2 + recur_input_names.size() + static_input_,
+           net->input_blobs().size());
+
+  // Check that param_propagate_down is set for all of the parameters in the
+  // unrolled net.
+  for (int i = 0; i < net->layers().size(); ++i) {
+    for (int j = 0; j < net->layers()[i]->blobs().size(); ++j) {
+      CHECK(net->layers()[i]->param_propagate_down(j))
+          << "param_propagate_down not set for layer " << i << ", param " << j;
+    }
+  }
+
+  // Set the diffs of recurrent outputs to 0 -- we can't backpropagate across
+  // batches.
+  for (int i = 0; i < recur_output_names.size(); ++i) {
+    Blob<Dtype>* recur_output =
+        CHECK_NOTNULL(net->blob_by_name(recur_output_names[i]).get());
+    caffe_set(recur_output->count(), Dtype(0),
+              recur_output->mutable_cpu_diff());
+  }
+
+  // Check that the last output_names.size() layers are the pseudo-losses.
+  const vector<string>& layer_names = net->layer_names();
+  const int last_layer_index = layer_names.size() - 1 - pseudo_losses.size();
+  for (int i = last_layer_index + 1, j = 0; i < layer_names.size(); ++i, ++j) {
+    CHECK_EQ(layer_names[i], pseudo_losses[j]);
+  }
+  return net;
+}
+
+template <typename Dtype>
+void RecurrentLayer<Dtype>::SelectUnrolledNet(int index) {
+  if (index == unrolled_net_index_) { return; }
+  const shared_ptr<Net<Dtype> >& net = unrolled_nets_[index];
+  if (length_buckets_.size()) {
+    T_ = length_buckets_[index];
+  }
+  vector<string> output_names;
+  OutputBlobNames(&output_names);
+  vector<string> recur_input_names;
+  RecurrentInputBlobNames(&recur_input_names);
+  vector<string> recur_output_names;
+  RecurrentOutputBlobNames(&recur_output_names);
 
   // Setup pointers to the inputs.
-  x_input_blob_ = CHECK_NOTNULL(unrolled_net_->blob_by_name("x").get());
-  cont_input_blob_ = CHECK_NOTNULL(unrolled_net_->blob_by_name("cont").get());
+  x_input_blob_ = CHECK_NOTNULL(net->blob_by_name("x").get());
+  cont_input_blob_ = CHECK_NOTNULL(net->blob_by_name("cont").get());
   if (static_input_) {
-    x_static_input_blob_ =
-        CHECK_NOTNULL(unrolled_net_->blob_by_name("x_static").get());
+    x_static_input_blob_ = CHECK_NOTNULL(net->blob_by_name("x_static").get());
   }
 
   // Setup pointers to paired recurrent inputs/outputs.
+  const int num_recur_blobs = recur_input_names.size();
   recur_input_blobs_.resize(num_recur_blobs);
   recur_output_blobs_.resize(num_recur_blobs);
-  for (int i = 0; i < recur_input_names.size(); ++i) {
+  for (int i = 0; i < num_recur_blobs; ++i) {
     recur_input_blobs_[i] =
-        CHECK_NOTNULL(unrolled_net_->blob_by_name(recur_input_names[i]).get());
+        CHECK_NOTNULL(net->blob_by_name(recur_input_names[i]).get());
     recur_output_blobs_[i] =
-        CHECK_NOTNULL(unrolled_net_->blob_by_name(recur_output_names[i]).get());
+        CHECK_NOTNULL(net->blob_by_name(recur_output_names[i]).get());
   }
 
   // Setup pointers to outputs.
-  CHECK_EQ(top.size() - num_hidden_exposed, output_names.size())
-      << "OutputBlobNames must provide an output blob name for each top.";
   output_blobs_.resize(output_names.size());
   for (int i = 0; i < output_names.size(); ++i) {
-    output_blobs_[i] =
-        CHECK_NOTNULL(unrolled_net_->blob_by_name(output_names[i]).get());
+    output_blobs_[i] = CHECK_NOTNULL(net->blob_by_name(output_names[i]).get());
   }
 
-  // We should have 2 inputs (x and cont), plus a number of recurrent inputs,
-  // plus maybe a static input.
-  CHECK_EQ(2 + num_recur_blobs + static_input_,
-           unrolled_net_->input_blobs().size());
+  // Don't run the pseudo-losses at the end of the net.
+  last_layer_index_ = net->layer_names().size() - 1 - output_names.size();
+  unrolled_net_ = net;
+  unrolled_net_index_ = index;
+}
 
-  // This layer's parameters are any parameters in the layers of the unrolled
-  // net. We only want one copy of each parameter, so check that the parameter
-  // is "owned" by the layer, rather than shared with another.
-  this->blobs_.clear();
-  for (int i = 0; i < unrolled_net_->params().size(); ++i) {
-    if (unrolled_net_->param_owners()[i] == -1) {
-      LOG(INFO) << "Adding parameter " << i << ": "
-                << unrolled_net_->param_display_names()[i];
-      this->blobs_.push_back(unrolled_net_->params()[i]);
-    }
-  }
-  // Check that param_propagate_down is set for all of the parameters in the
-  // unrolled net; set param_propagate_down to true in this layer.
-  for (int i = 0; i < unrolled_net_->layers().size(); ++i) {
-    for (int j = 0; j < unrolled_net_->layers()[i]->blobs().size(); ++j) {
-      CHECK(unrolled_net_->layers()[i]->param_propagate_down(j))
-          << "param_propagate_down not set for layer " << i << ", param " << j;
+template <typename Dtype>
+void RecurrentLayer<Dtype>::ShareUnrolledNetParams(Net<Dtype>* net) {
+  for (int i = 0, j = 0; i < net->params().size(); ++i) {
+    if (net->param_owners()[i] == -1) {
+      CHECK_LT(j, this->blobs_.size());
+      net->params()[i]->ShareData(*this->blobs_[j]);
+      net->params()[i]->ShareDiff(*this->blobs_[j]);
+      ++j;
     }
   }
-  this->param_propagate_down_.clear();
-  this->param_propagate_down_.resize(this->blobs_.size(), true);
+  net->ShareWeights();
+}
 
-  // Set the diffs of recurrent outputs to 0 -- we can't backpropagate across
-  // batches.
-  for (int i = 0; i < recur_output_blobs_.size(); ++i) {
-    caffe_set(recur_output_blobs_[i]->count(), Dtype(0),
-              recur_output_blobs_[i]->mutable_cpu_diff());
+template <typename Dtype>
+void RecurrentLayer<Dtype>::RecurrentStateBlobNames(int t,
+    vector<string>* names) const {
+  if (t == 0) {
+    RecurrentInputBlobNames(names);
+    return;
   }
+  CHECK_EQ(T_, t) << this->type()
+      << " layers only provide the state after the last timestep";
+  RecurrentOutputBlobNames(names);
+}
 
-  // Check that the last output_names.size() layers are the pseudo-losses;
-  // set last_layer_index so that we don't actually run these layers.
-  const vector<string>& layer_names = unrolled_net_->layer_names();
-  last_layer_index_ = layer_names.size() - 1 - pseudo_losses.size();
-  for (int i = last_layer_index_ + 1, j = 0; i < layer_names.size(); ++i, ++j) {
-    CHECK_EQ(layer_names[i], pseudo_losses[j]);
+template <typename Dtype>
+void RecurrentLayer<Dtype>::ReshapeStreamState() {
+  // The state starts from zero, and again whenever the number of streams
+  // changes.
+  vector<BlobShape> recur_input_shapes;
+  RecurrentInputShapes(&recur_input_shapes);
+  CHECK_EQ(recur_input_shapes.size(), stream_state_.size());
+  for (int i = 0; i < recur_input_shapes.size(); ++i) {
+    vector<int> shape;
+    for (int k = 0; k < recur_input_shapes[i].dim_size(); ++k) {
+      shape.push_back(recur_input_shapes[i].dim(k));
+    }
+    if (stream_state_[i]->shape() != shape) {
+      stream_state_[i]->Reshape(shape);
+      caffe_set(stream_state_[i]->count(), Dtype(0),
+                stream_state_[i]->mutable_cpu_data());
+    }
   }
 }
 
@@ -184,14 +323,49 @@ void RecurrentLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   CHECK_GE(bottom[0]->num_axes(), 2)
       << "bottom[0] must have at least 2 axes -- (#timesteps, #streams, ...)";
-  CHECK_EQ(T_, bottom[0]->shape(0)) << "input number of timesteps changed";
+  if (streaming_) {
+    StreamingReshape(bottom, top);
+    return;
+  }
+  const int input_T = bottom[0]->shape(0);
   N_ = bottom[0]->shape(1);
   CHECK_EQ(bottom[1]->num_axes(), 2)
       << "bottom[1] must have exactly 2 axes -- (#timesteps, #streams)";
-  CHECK_EQ(T_, bottom[1]->shape(0));
+  CHECK_EQ(input_T, bottom[1]->shape(0));
   CHECK_EQ(N_, bottom[1]->shape(1));
-  x_input_blob_->ReshapeLike(*bottom[0]);
+  if (length_buckets_.size()) {
+    // Run on the shortest bucket that holds the valid timesteps of every
+    // stream.
+    valid_lengths_.assign(N_, input_T);
+    if (length_input_) {
+      const Blob<Dtype>* lengths = bottom.back();
+      CHECK_EQ(N_, lengths->count()) << "need one sequence length per stream";
+      for (int n = 0; n < N_; ++n) {
+        valid_lengths_[n] = static_cast<int>(lengths->cpu_data()[n]);
+        CHECK_GE(valid_lengths_[n], 0) << "negative sequence length";
+        CHECK_LE(valid_lengths_[n], input_T)
+            << "sequence length exceeds the number of timesteps";
+      }
+    }
+    const int length =
+        *std::max_element(valid_lengths_.begin(), valid_lengths_.end());
+    int bucket = 0;
+    while (bucket < length_buckets_.size() &&
+           length_buckets_[bucket] < length) {
+      ++bucket;
+    }
+    CHECK_LT(bucket, length_buckets_.size()) << "Sequences of " << length
+        << " timesteps are longer than the largest length bucket";
+    SelectUnrolledNet(bucket);
+    ReshapeStreamState();
+  } else {
+    CHECK_EQ(T_, input_T) << "input number of timesteps changed";
+  }
+  vector<int> x_shape = bottom[0]->shape();
+  x_shape[0] = T_;
+  x_input_blob_->Reshape(x_shape);
   vector<int> cont_shape = bottom[1]->shape();
+  cont_shape[0] = T_;
   cont_input_blob_->Reshape(cont_shape);
   if (static_input_) {
     x_static_input_blob_->ReshapeLike(*bottom[2]);
@@ -203,16 +377,27 @@ void RecurrentLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     recur_input_blobs_[i]->Reshape(recur_input_shapes[i]);
   }
   unrolled_net_->Reshape();
-  x_input_blob_->ShareData(*bottom[0]);
-  x_input_blob_->ShareDiff(*bottom[0]);
-  cont_input_blob_->ShareData(*bottom[1]);
+  if (T_ == input_T) {
+    x_input_blob_->ShareData(*bottom[0]);
+    x_input_blob_->ShareDiff(*bottom[0]);
+    cont_input_blob_->ShareData(*bottom[1]);
+  } else {
+    // The bucket is shorter or longer than the input; Forward copies the
+    // timesteps they have in common.
+    x_bucket_.Reshape(x_shape);
+    x_input_blob_->ShareData(x_bucket_);
+    x_input_blob_->ShareDiff(x_bucket_);
+    cont_bucket_.Reshape(cont_shape);
+    cont_input_blob_->ShareData(cont_bucket_);
+  }
   if (static_input_) {
     x_static_input_blob_->ShareData(*bottom[2]);
     x_static_input_blob_->ShareDiff(*bottom[2]);
   }
   if (expose_hidden_) {
     const int bottom_offset = 2 + static_input_;
-    for (int i = bottom_offset, j = 0; i < bottom.size(); ++i, ++j) {
+    for (int j = 0; j < recur_input_blobs_.size(); ++j) {
+      const int i = bottom_offset + j;
       CHECK(recur_input_blobs_[j]->shape() == bottom[i]->shape())
           << "shape mismatch - recur_input_blobs_[" << j << "]: "
           << recur_input_blobs_[j]->shape_string()
@@ -221,9 +406,18 @@ void RecurrentLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     }
   }
   for (int i = 0; i < output_blobs_.size(); ++i) {
-    top[i]->ReshapeLike(*output_blobs_[i]);
-    top[i]->ShareData(*output_blobs_[i]);
-    top[i]->ShareDiff(*output_blobs_[i]);
+    if (T_ == input_T) {
+      top[i]->ReshapeLike(*output_blobs_[i]);
+      top[i]->ShareData(*output_blobs_[i]);
+      top[i]->ShareDiff(*output_blobs_[i]);
+    } else {
+      vector<int> top_shape = output_blobs_[i]->shape();
+      top_shape[0] = input_T;
+      top_bucket_[i]->Reshape(top_shape);
+      top[i]->Reshape(top_shape);
+      top[i]->ShareData(*top_bucket_[i]);
+      top[i]->ShareDiff(*top_bucket_[i]);
+    }
   }
   if (expose_hidden_) {
     const int top_offset = output_blobs_.size();
@@ -233,6 +427,39 @@ void RecurrentLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void RecurrentLayer<Dtype>::StreamingReshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  T_ = bottom[0]->shape(0);
+  N_ = bottom[0]->shape(1);
+  CHECK_EQ(bottom[1]->num_axes(), 2)
+      << "bottom[1] must have exactly 2 axes -- (#timesteps, #streams)";
+  CHECK_EQ(T_, bottom[1]->shape(0));
+  CHECK_EQ(N_, bottom[1]->shape(1));
+  if (static_input_) {
+    CHECK_EQ(N_, bottom[2]->shape(0));
+  }
+  ReshapeStreamState();
+  if (expose_hidden_) {
+    const int bottom_offset = 2 + static_input_;
+    for (int i = bottom_offset, j = 0; i < bottom.size(); ++i, ++j) {
+      CHECK(stream_state_[j]->shape() == bottom[i]->shape())
+          << "shape mismatch - stream_state_[" << j << "]: "
+          << stream_state_[j]->shape_string()
+          << " vs. bottom[" << i << "]: " << bottom[i]->shape_string();
+    }
+    const int top_offset = output_blobs_.size();
+    for (int i = top_offset, j = 0; i < top.size(); ++i, ++j) {
+      top[i]->ReshapeLike(*stream_state_[j]);
+    }
+  }
+  vector<int> top_shape(3);
+  top_shape[0] = T_;
+  top_shape[1] = N_;
+  top_shape[2] = this->layer_param_.recurrent_param().num_output();
+  top[0]->Reshape(top_shape);
+}
+
 template <typename Dtype>
 void RecurrentLayer<Dtype>::Reset() {
   // "Reset" the hidden state of the net by zeroing out all recurrent outputs.
@@ -240,36 +467,97 @@ void RecurrentLayer<Dtype>::Reset() {
     caffe_set(recur_output_blobs_[i]->count(), Dtype(0),
               recur_output_blobs_[i]->mutable_cpu_data());
   }
+  for (int i = 0; i < stream_state_.size(); ++i) {
+    caffe_set(stream_state_[i]->count(), Dtype(0),
+              stream_state_[i]->mutable_cpu_data());
+  }
 }
 
 template <typename Dtype>
 void RecurrentLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (streaming_) {
+    // With exposed hidden state, the caller owns the state between calls.
+    if (expose_hidden_) {
+      const int bottom_offset = 2 + static_input_;
+      for (int i = bottom_offset, j = 0; i < bottom.size(); ++i, ++j) {
+        caffe_copy(bottom[i]->count(), bottom[i]->cpu_data(),
+                   stream_state_[j]->mutable_cpu_data());
+      }
+    }
+    StreamingForward(bottom, top);
+    if (expose_hidden_) {
+      const int top_offset = output_blobs_.size();
+      for (int i = top_offset, j = 0; i < top.size(); ++i, ++j) {
+        caffe_copy(stream_state_[j]->count(), stream_state_[j]->cpu_data(),
+                   top[i]->mutable_cpu_data());
+      }
+    }
+    return;
+  }
+
   // Hacky fix for test time: reshare all the internal shared blobs, which may
   // currently point to a stale owner blob that was dropped when Solver::Test
   // called test_net->ShareTrainedLayersWith(net_.get()).
   // TODO: somehow make this work non-hackily.
   if (this->phase_ == TEST) {
-    unrolled_net_->ShareWeights();
+    ShareUnrolledNetParams(unrolled_net_.get());
   }
 
   DCHECK_EQ(recur_input_blobs_.size(), recur_output_blobs_.size());
   if (!expose_hidden_) {
+    // With buckets, the state lives in stream_state_ rather than in the
+    // last timestep of the net.
+    const bool bucket_state = length_buckets_.size();
     for (int i = 0; i < recur_input_blobs_.size(); ++i) {
       const int count = recur_input_blobs_[i]->count();
-      DCHECK_EQ(count, recur_output_blobs_[i]->count());
-      const Dtype* timestep_T_data = recur_output_blobs_[i]->cpu_data();
-      Dtype* timestep_0_data = recur_input_blobs_[i]->mutable_cpu_data();
-      caffe_copy(count, timestep_T_data, timestep_0_data);
+      const Blob<Dtype>& state =
+          bucket_state ? *stream_state_[i] : *recur_output_blobs_[i];
+      DCHECK_EQ(count, state.count());
+      caffe_copy(count, state.cpu_data(),
+                 recur_input_blobs_[i]->mutable_cpu_data());
     }
   }
 
+  const bool bucketed = (T_ != bottom[0]->shape(0));
+  if (bucketed) {
+    copy_timesteps(bottom[0]->count(), bottom[0]->cpu_data(),
+        x_input_blob_->count(), x_input_blob_->mutable_cpu_data());
+    copy_timesteps(bottom[1]->count(), bottom[1]->cpu_data(),
+        cont_input_blob_->count(), cont_input_blob_->mutable_cpu_data());
+  }
+
   unrolled_net_->ForwardTo(last_layer_index_);
 
+  if (bucketed) {
+    for (int i = 0; i < output_blobs_.size(); ++i) {
+      copy_timesteps(output_blobs_[i]->count(), output_blobs_[i]->cpu_data(),
+          top[i]->count(), top[i]->mutable_cpu_data());
+    }
+  }
+
+  // Each stream keeps its state after its last valid timestep, not after the
+  // padding that fills up the bucket.
+  if (length_buckets_.size()) {
+    vector<string> state_names;
+    for (int n = 0; n < N_; ++n) {
+      RecurrentStateBlobNames(valid_lengths_[n], &state_names);
+      CHECK_EQ(state_names.size(), stream_state_.size());
+      for (int i = 0; i < state_names.size(); ++i) {
+        const Blob<Dtype>* state =
+            CHECK_NOTNULL(unrolled_net_->blob_by_name(state_names[i]).get());
+        const int dim = state->count(2);
+        caffe_copy(dim, state->cpu_data() + n * dim,
+                   stream_state_[i]->mutable_cpu_data() + n * dim);
+      }
+    }
+  }
+
   if (expose_hidden_) {
     const int top_offset = output_blobs_.size();
     for (int i = top_offset, j = 0; i < top.size(); ++i, ++j) {
-      top[i]->ShareData(*recur_output_blobs_[j]);
+      top[i]->ShareData(length_buckets_.size() ? *stream_state_[j] :
+                        *recur_output_blobs_[j]);
     }
   }
 }
@@ -278,13 +566,25 @@ template <typename Dtype>
 void RecurrentLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   CHECK(!propagate_down[1]) << "Cannot backpropagate to sequence indicators.";
+  CHECK(!streaming_) << "Streaming recurrent layers are inference only.";
 
   // TODO: skip backpropagation to inputs and parameters inside the unrolled
   // net according to propagate_down[0] and propagate_down[2]. For now just
   // backprop to inputs and parameters unconditionally, as either the inputs or
   // the parameters do need backward (or Net would have set
   // layer_needs_backward_[i] == false for this layer).
+  const bool bucketed = (T_ != bottom[0]->shape(0));
+  if (bucketed) {
+    for (int i = 0; i < output_blobs_.size(); ++i) {
+      copy_timesteps(top[i]->count(), top[i]->cpu_diff(),
+          output_blobs_[i]->count(), output_blobs_[i]->mutable_cpu_diff());
+    }
+  }
   unrolled_net_->BackwardFrom(last_layer_index_);
+  if (bucketed && propagate_down[0]) {
+    copy_timesteps(x_input_blob_->count(), x_input_blob_->cpu_diff(),
+        bottom[0]->count(), bottom[0]->mutable_cpu_diff());
+  }
 }
 
 #ifdef CPU_ONLY
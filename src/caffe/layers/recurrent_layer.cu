@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <string>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -9,32 +11,80 @@
 
 namespace caffe {
 
+// GPU counterpart of copy_timesteps in recurrent_layer.cpp.
+template <typename Dtype>
+static void copy_timesteps_gpu(int src_count, const Dtype* src,
+    int dst_count, Dtype* dst) {
+  const int count = std::min(src_count, dst_count);
+  caffe_copy(count, src, dst);
+  caffe_gpu_set(dst_count - count, Dtype(0), dst + count);
+}
+
 template <typename Dtype>
 void RecurrentLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (streaming_) {
+    // Streaming steps are small; they run on the CPU.
+    Forward_cpu(bottom, top);
+    return;
+  }
   // Hacky fix for test time... reshare all the shared blobs.
   // TODO: somehow make this work non-hackily.
   if (this->phase_ == TEST) {
-    unrolled_net_->ShareWeights();
+    ShareUnrolledNetParams(unrolled_net_.get());
   }
 
   DCHECK_EQ(recur_input_blobs_.size(), recur_output_blobs_.size());
   if (!expose_hidden_) {
+    const bool bucket_state = length_buckets_.size();
     for (int i = 0; i < recur_input_blobs_.size(); ++i) {
       const int count = recur_input_blobs_[i]->count();
-      DCHECK_EQ(count, recur_output_blobs_[i]->count());
-      const Dtype* timestep_T_data = recur_output_blobs_[i]->gpu_data();
-      Dtype* timestep_0_data = recur_input_blobs_[i]->mutable_gpu_data();
-      caffe_copy(count, timestep_T_data, timestep_0_data);
+      const Blob<Dtype>& state =
+          bucket_state ? *stream_state_[i] : *recur_output_blobs_[i];
+      DCHECK_EQ(count, state.count());
+      caffe_copy(count, state.gpu_data(),
+                 recur_input_blobs_[i]->mutable_gpu_data());
     }
   }
 
+  const bool bucketed = (T_ != bottom[0]->shape(0));
+  if (bucketed) {
+    copy_timesteps_gpu(bottom[0]->count(), bottom[0]->gpu_data(),
+        x_input_blob_->count(), x_input_blob_->mutable_gpu_data());
+    copy_timesteps_gpu(bottom[1]->count(), bottom[1]->gpu_data(),
+        cont_input_blob_->count(), cont_input_blob_->mutable_gpu_data());
+  }
+
   unrolled_net_->ForwardTo(last_layer_index_);
 
+  if (bucketed) {
+    for (int i = 0; i < output_blobs_.size(); ++i) {
+      copy_timesteps_gpu(output_blobs_[i]->count(),
+          output_blobs_[i]->gpu_data(), top[i]->count(),
+          top[i]->mutable_gpu_data());
+    }
+  }
+
+  if (length_buckets_.size()) {
+    vector<string> state_names;
+    for (int n = 0; n < N_; ++n) {
+      RecurrentStateBlobNames(valid_lengths_[n], &state_names);
+      CHECK_EQ(state_names.size(), stream_state_.size());
+      for (int i = 0; i < state_names.size(); ++i) {
+        const Blob<Dtype>* state =
+            CHECK_NOTNULL(unrolled_net_->blob_by_name(state_names[i]).get());
+        const int dim = state->count(2);
+        caffe_copy(dim, state->gpu_data() + n * dim,
+                   stream_state_[i]->mutable_gpu_data() + n * dim);
+      }
+    }
+  }
+
   if (expose_hidden_) {
     const int top_offset = output_blobs_.size();
     for (int i = top_offset, j = 0; i < top.size(); ++i, ++j) {
-      top[i]->ShareData(*recur_output_blobs_[j]);
+      top[i]->ShareData(length_buckets_.size() ? *stream_state_[j] :
+                        *recur_output_blobs_[j]);
     }
   }
 }
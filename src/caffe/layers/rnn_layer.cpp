@@ -22,6 +22,13 @@ void RNNLayer<Dtype>::RecurrentOutputBlobNames(vector<string>* names) const {
   (*names)[0] = "h_" + format_int(this->T_);
 }
 
+template <typename Dtype>
+void RNNLayer<Dtype>::RecurrentStateBlobNames(int t,
+    vector<string>* names) const {
+  names->resize(1);
+  (*names)[0] = "h_" + format_int(t);
+}
+
 template <typename Dtype>
 void RNNLayer<Dtype>::RecurrentInputShapes(vector<BlobShape>* shapes) const {
   const int num_output = this->layer_param_.recurrent_param().num_output();
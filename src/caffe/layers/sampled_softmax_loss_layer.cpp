@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>  // NOLINT(readability/streams)
+#include <vector>
+
+#include "caffe/filler.hpp"
+#include "caffe/layers/sampled_softmax_loss_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::LayerSetUp(bottom, top);
+  const SampledSoftmaxLossParameter& param =
+      this->layer_param_.sampled_softmax_loss_param();
+  C_ = param.num_output();
+  CHECK_GT(C_, 0) << "SampledSoftmaxLoss num_output must be positive.";
+  num_sampled_ = param.num_sampled();
+  CHECK_GT(num_sampled_, 0) << "SampledSoftmaxLoss needs num_sampled > 0.";
+  bias_term_ = param.bias_term();
+  remove_accidental_hits_ = param.remove_accidental_hits();
+  const int axis = bottom[0]->CanonicalAxisIndex(param.axis());
+  K_ = bottom[0]->count(axis);
+  CHECK(top.size() == 1 || this->phase_ == TEST)
+      << "Class scores are only output in the TEST phase.";
+  has_ignore_label_ = this->layer_param_.loss_param().has_ignore_label();
+  if (has_ignore_label_) {
+    ignore_label_ = this->layer_param_.loss_param().ignore_label();
+  }
+  if (!this->layer_param_.loss_param().has_normalization() &&
+      this->layer_param_.loss_param().has_normalize()) {
+    normalization_ = this->layer_param_.loss_param().normalize() ?
+                     LossParameter_NormalizationMode_VALID :
+                     LossParameter_NormalizationMode_BATCH_SIZE;
+  } else {
+    normalization_ = this->layer_param_.loss_param().normalization();
+  }
+  log_uniform_ =
+      param.sampler() == SampledSoftmaxLossParameter_Sampler_LOG_UNIFORM;
+  if (!log_uniform_) {
+    CHECK(param.has_unigram_source())
+        << "The UNIGRAM sampler needs a unigram_source.";
+    std::ifstream infile(param.unigram_source().c_str());
+    CHECK(infile.good())
+        << "Failed to open unigram source " << param.unigram_source();
+    unigram_cdf_.clear();
+    unigram_total_ = 0;
+    double count;
+    while (infile >> count) {
+      CHECK_GT(count, 0) << "Unigram counts must be positive.";
+      unigram_total_ += pow(count, param.unigram_power());
+      unigram_cdf_.push_back(unigram_total_);
+    }
+    CHECK_EQ(C_, unigram_cdf_.size())
+        << "Expected one unigram count per class in "
+        << param.unigram_source();
+  }
+  // Check if we need to set up the weights
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else {
+    if (bias_term_) {
+      this->blobs_.resize(2);
+    } else {
+      this->blobs_.resize(1);
+    }
+    // Initialize the weights, laid out like an InnerProduct weight.
+    vector<int> weight_shape(2);
+    weight_shape[0] = C_;
+    weight_shape[1] = K_;
+    this->blobs_[0].reset(new Blob<Dtype>(weight_shape));
+    shared_ptr<Filler<Dtype> > weight_filler(GetFiller<Dtype>(
+        param.weight_filler()));
+    weight_filler->Fill(this->blobs_[0].get());
+    if (bias_term_) {
+      vector<int> bias_shape(1, C_);
+      this->blobs_[1].reset(new Blob<Dtype>(bias_shape));
+      shared_ptr<Filler<Dtype> > bias_filler(GetFiller<Dtype>(
+          param.bias_filler()));
+      bias_filler->Fill(this->blobs_[1].get());
+    }
+  }  // parameter initialization
+  for (int i = 0; i < this->blobs_.size(); ++i) {
+    this->blobs_[i]->set_sparse_diff(param.sparse_gradient());
+  }
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::Reshape(bottom, top);
+  const int axis = bottom[0]->CanonicalAxisIndex(
+      this->layer_param_.sampled_softmax_loss_param().axis());
+  CHECK_EQ(K_, bottom[0]->count(axis))
+      << "Input size incompatible with SampledSoftmaxLoss parameters.";
+  M_ = bottom[0]->count(0, axis);
+  CHECK_EQ(M_, bottom[1]->count())
+      << "SampledSoftmaxLoss takes one label per example.";
+  vector<int> shape(2);
+  shape[0] = num_sampled_;
+  shape[1] = K_;
+  sampled_weight_.Reshape(shape);
+  shape[0] = M_;
+  shape[1] = num_sampled_;
+  sampled_prob_.Reshape(shape);
+  true_prob_.Reshape(vector<int>(1, M_));
+  if (this->phase_ == TEST) {
+    shape[1] = C_;
+    if (top.size() > 1) {
+      top[1]->Reshape(shape);
+    } else {
+      scores_.Reshape(shape);
+    }
+  }
+}
+
+template <typename Dtype>
+Dtype SampledSoftmaxLossLayer<Dtype>::LogExpectedCount(int c) const {
+  double q;
+  if (log_uniform_) {
+    q = log((c + 2.0) / (c + 1.0)) / log(C_ + 1.0);
+  } else {
+    q = (unigram_cdf_[c] - (c > 0 ? unigram_cdf_[c - 1] : 0)) /
+        unigram_total_;
+  }
+  return log(num_sampled_ * q);
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::SampleClasses() {
+  sampled_.resize(num_sampled_);
+  sampled_log_count_.resize(num_sampled_);
+  vector<Dtype> u(num_sampled_);
+  caffe_rng_uniform(num_sampled_, Dtype(0), Dtype(1), &u[0]);
+  for (int s = 0; s < num_sampled_; ++s) {
+    int c;
+    if (log_uniform_) {
+      // Inverts the CDF log(c + 1) / log(C + 1) of the log-uniform law.
+      c = static_cast<int>(exp(u[s] * log(C_ + 1.0))) - 1;
+    } else {
+      c = std::upper_bound(unigram_cdf_.begin(), unigram_cdf_.end(),
+          u[s] * unigram_total_) - unigram_cdf_.begin();
+    }
+    c = std::min(std::max(c, 0), C_ - 1);
+    sampled_[s] = c;
+    sampled_log_count_[s] = LogExpectedCount(c);
+  }
+}
+
+template <typename Dtype>
+Dtype SampledSoftmaxLossLayer<Dtype>::get_normalizer(int valid_count,
+    int batch_size) const {
+  Dtype normalizer;
+  switch (normalization_) {
+    case LossParameter_NormalizationMode_FULL:
+      normalizer = Dtype(M_);
+      break;
+    case LossParameter_NormalizationMode_VALID:
+      normalizer = Dtype(valid_count);
+      break;
+    case LossParameter_NormalizationMode_BATCH_SIZE:
+      normalizer = Dtype(batch_size);
+      break;
+    case LossParameter_NormalizationMode_NONE:
+      normalizer = Dtype(1);
+      break;
+    default:
+      LOG(FATAL) << "Unknown normalization mode: "
+          << LossParameter_NormalizationMode_Name(normalization_);
+  }
+  return std::max(Dtype(1.0), normalizer);
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (this->phase_ == TEST) {
+    ForwardFull_cpu(bottom, top);
+    return;
+  }
+  SampleClasses();
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  Dtype* sampled_weight = sampled_weight_.mutable_cpu_data();
+  for (int s = 0; s < num_sampled_; ++s) {
+    caffe_copy(K_, weight + sampled_[s] * K_, sampled_weight + s * K_);
+  }
+  // The sampled logits of the whole batch in one GEMM.
+  Dtype* sampled_prob = sampled_prob_.mutable_cpu_data();
+  Dtype* true_prob = true_prob_.mutable_cpu_data();
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, num_sampled_, K_,
+      Dtype(1), bottom_data, sampled_weight, Dtype(0), sampled_prob);
+  Dtype loss = 0;
+  valid_count_ = 0;
+  for (int i = 0; i < M_; ++i) {
+    Dtype* prob = sampled_prob + i * num_sampled_;
+    const int label_value = static_cast<int>(label[i]);
+    if (has_ignore_label_ && label_value == ignore_label_) {
+      // Zero gradients for both the samples and the true class.
+      caffe_set(num_sampled_, Dtype(0), prob);
+      true_prob[i] = 1;
+      continue;
+    }
+    DCHECK_GE(label_value, 0);
+    DCHECK_LT(label_value, C_);
+    Dtype true_logit = caffe_cpu_dot(K_, bottom_data + i * K_,
+        weight + label_value * K_) - LogExpectedCount(label_value);
+    if (bias) {
+      true_logit += bias[label_value];
+    }
+    Dtype max_logit = true_logit;
+    for (int s = 0; s < num_sampled_; ++s) {
+      if (remove_accidental_hits_ && sampled_[s] == label_value) {
+        prob[s] = -FLT_MAX;
+        continue;
+      }
+      prob[s] -= sampled_log_count_[s];
+      if (bias) {
+        prob[s] += bias[sampled_[s]];
+      }
+      max_logit = std::max(max_logit, prob[s]);
+    }
+    Dtype sum = exp(true_logit - max_logit);
+    for (int s = 0; s < num_sampled_; ++s) {
+      prob[s] = exp(prob[s] - max_logit);
+      sum += prob[s];
+    }
+    caffe_scal(num_sampled_, Dtype(1) / sum, prob);
+    true_prob[i] = exp(true_logit - max_logit) / sum;
+    loss -= true_logit - max_logit - log(sum);
+    ++valid_count_;
+  }
+  top[0]->mutable_cpu_data()[0] =
+      loss / get_normalizer(valid_count_, bottom[0]->shape(0));
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::ForwardFull_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  Blob<Dtype>* scores = top.size() > 1 ? top[1] : &scores_;
+  Dtype* score = scores->mutable_cpu_data();
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, C_, K_, Dtype(1),
+      bottom_data, this->blobs_[0]->cpu_data(), Dtype(0), score);
+  if (bias_term_) {
+    const Dtype* bias = this->blobs_[1]->cpu_data();
+    for (int i = 0; i < M_; ++i) {
+      caffe_axpy(C_, Dtype(1), bias, score + i * C_);
+    }
+  }
+  Dtype loss = 0;
+  valid_count_ = 0;
+  for (int i = 0; i < M_; ++i) {
+    const int label_value = static_cast<int>(label[i]);
+    if (has_ignore_label_ && label_value == ignore_label_) {
+      continue;
+    }
+    DCHECK_GE(label_value, 0);
+    DCHECK_LT(label_value, C_);
+    const Dtype* row = score + i * C_;
+    const Dtype max_score = *std::max_element(row, row + C_);
+    Dtype sum = 0;
+    for (int c = 0; c < C_; ++c) {
+      sum += exp(row[c] - max_score);
+    }
+    loss -= row[label_value] - max_score - log(sum);
+    ++valid_count_;
+  }
+  top[0]->mutable_cpu_data()[0] =
+      loss / get_normalizer(valid_count_, bottom[0]->shape(0));
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  CHECK_EQ(TRAIN, this->phase_)
+      << this->type() << " Layer only backpropagates its sampled loss.";
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  const Dtype scale = top[0]->cpu_diff()[0] /
+      get_normalizer(valid_count_, bottom[0]->shape(0));
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  // The logit gradients: p for the samples, p - 1 for the true classes.
+  Dtype* sampled_grad = sampled_prob_.mutable_cpu_diff();
+  caffe_cpu_scale(sampled_prob_.count(), scale, sampled_prob_.cpu_data(),
+      sampled_grad);
+  const Dtype* true_prob = true_prob_.cpu_data();
+  Dtype* true_grad = true_prob_.mutable_cpu_diff();
+  for (int i = 0; i < M_; ++i) {
+    true_grad[i] = scale * (true_prob[i] - 1);
+  }
+  if (propagate_down[0]) {
+    const Dtype* weight = this->blobs_[0]->cpu_data();
+    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, K_, num_sampled_,
+        Dtype(1), sampled_grad, sampled_weight_.cpu_data(), Dtype(0),
+        bottom_diff);
+    for (int i = 0; i < M_; ++i) {
+      const int label_value = static_cast<int>(label[i]);
+      if (has_ignore_label_ && label_value == ignore_label_) {
+        continue;
+      }
+      caffe_axpy(K_, true_grad[i], weight + label_value * K_,
+          bottom_diff + i * K_);
+    }
+  }
+  if (this->param_propagate_down_[0]) {
+    Blob<Dtype>* weight = this->blobs_[0].get();
+    Dtype* weight_diff = weight->mutable_cpu_diff();
+    // The gradient of every sampled row in one GEMM, then scattered.
+    Dtype* sampled_weight_diff = sampled_weight_.mutable_cpu_diff();
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, num_sampled_, K_, M_,
+        Dtype(1), sampled_grad, bottom_data, Dtype(0), sampled_weight_diff);
+    for (int s = 0; s < num_sampled_; ++s) {
+      caffe_axpy(K_, Dtype(1), sampled_weight_diff + s * K_,
+          weight_diff + sampled_[s] * K_);
+      if (weight->sparse_diff()) {
+        weight->touch_diff_row(sampled_[s]);
+      }
+    }
+    for (int i = 0; i < M_; ++i) {
+      const int label_value = static_cast<int>(label[i]);
+      if (has_ignore_label_ && label_value == ignore_label_) {
+        continue;
+      }
+      caffe_axpy(K_, true_grad[i], bottom_data + i * K_,
+          weight_diff + label_value * K_);
+      if (weight->sparse_diff()) {
+        weight->touch_diff_row(label_value);
+      }
+    }
+  }
+  if (bias_term_ && this->param_propagate_down_[1]) {
+    Blob<Dtype>* bias = this->blobs_[1].get();
+    Dtype* bias_diff = bias->mutable_cpu_diff();
+    for (int s = 0; s < num_sampled_; ++s) {
+      for (int i = 0; i < M_; ++i) {
+        bias_diff[sampled_[s]] += sampled_grad[i * num_sampled_ + s];
+      }
+      if (bias->sparse_diff()) {
+        bias->touch_diff_row(sampled_[s]);
+      }
+    }
+    for (int i = 0; i < M_; ++i) {
+      const int label_value = static_cast<int>(label[i]);
+      if (has_ignore_label_ && label_value == ignore_label_) {
+        continue;
+      }
+      bias_diff[label_value] += true_grad[i];
+      if (bias->sparse_diff()) {
+        bias->touch_diff_row(label_value);
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(SampledSoftmaxLossLayer);
+REGISTER_LAYER_CLASS(SampledSoftmaxLoss);
+
+}  // namespace caffe
@@ -71,6 +71,38 @@ void SliceLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (top.size() == 1) {
     top[0]->ShareData(*bottom[0]);
     top[0]->ShareDiff(*bottom[0]);
+  } else if (allow_aliasing_ && num_slices_ == 1) {
+    AliasTops(bottom, top);
+  } else if (!data_views_.empty()) {
+    // Copying into tops that still view the bottom would overwrite it.
+    for (int i = 0; i < top.size(); ++i) {
+      Blob<Dtype> own(top[i]->shape());
+      if (data_aliased(top[i], i)) { top[i]->ShareData(own); }
+      if (diff_aliased(top[i], i)) { top[i]->ShareDiff(own); }
+    }
+    data_views_.clear();
+    diff_views_.clear();
+  }
+}
+
+template <typename Dtype>
+void SliceLayer<Dtype>::AliasTops(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  // The views are remade on every Reshape, since the bottom may have moved
+  // to other memory. Tops whose memory other blobs share are copied instead.
+  data_views_.resize(top.size());
+  diff_views_.resize(top.size());
+  int offset = 0;
+  for (int i = 0; i < top.size(); ++i) {
+    if (data_aliased(top[i], i) || top[i]->data().use_count() == 1) {
+      top[i]->ShareDataView(*bottom[0], offset);
+      data_views_[i] = top[i]->data();
+    }
+    if (diff_aliased(top[i], i) || top[i]->diff().use_count() == 1) {
+      top[i]->ShareDiffView(*bottom[0], offset);
+      diff_views_[i] = top[i]->diff();
+    }
+    offset += top[i]->count();
   }
 }
 
@@ -82,8 +114,12 @@ void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
   for (int i = 0; i < top.size(); ++i) {
-    Dtype* top_data = top[i]->mutable_cpu_data();
     const int top_slice_axis = top[i]->shape(slice_axis_);
+    if (data_aliased(top[i], i)) {
+      offset_slice_axis += top_slice_axis;
+      continue;
+    }
+    Dtype* top_data = top[i]->mutable_cpu_data();
     for (int n = 0; n < num_slices_; ++n) {
       const int top_offset = n * top_slice_axis * slice_size_;
       const int bottom_offset =
@@ -103,8 +139,12 @@ void SliceLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
   for (int i = 0; i < top.size(); ++i) {
-    const Dtype* top_diff = top[i]->cpu_diff();
     const int top_slice_axis = top[i]->shape(slice_axis_);
+    if (diff_aliased(top[i], i)) {
+      offset_slice_axis += top_slice_axis;
+      continue;
+    }
+    const Dtype* top_diff = top[i]->cpu_diff();
     for (int n = 0; n < num_slices_; ++n) {
       const int top_offset = n * top_slice_axis * slice_size_;
       const int bottom_offset =
@@ -33,8 +33,12 @@ void SliceLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
   const bool kForward = true;
   for (int i = 0; i < top.size(); ++i) {
-    Dtype* top_data = top[i]->mutable_gpu_data();
     const int top_slice_axis = top[i]->shape(slice_axis_);
+    if (data_aliased(top[i], i)) {
+      offset_slice_axis += top_slice_axis;
+      continue;
+    }
+    Dtype* top_data = top[i]->mutable_gpu_data();
     const int top_slice_size = top_slice_axis * slice_size_;
     const int nthreads = top_slice_size * num_slices_;
     Slice<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
@@ -54,8 +58,12 @@ void SliceLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
   const bool kForward = false;
   for (int i = 0; i < top.size(); ++i) {
-    const Dtype* top_diff = top[i]->gpu_diff();
     const int top_slice_axis = top[i]->shape(slice_axis_);
+    if (diff_aliased(top[i], i)) {
+      offset_slice_axis += top_slice_axis;
+      continue;
+    }
+    const Dtype* top_diff = top[i]->gpu_diff();
     const int top_slice_size = top_slice_axis * slice_size_;
     const int nthreads = top_slice_size * num_slices_;
     Slice<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cfloat>
 #include <vector>
 
 #include "caffe/layer.hpp"
@@ -7,6 +8,7 @@
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/layers/split_layer.hpp"
 #include "caffe/layers/spp_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -85,6 +87,14 @@ void SPPLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   flatten_outputs_.clear();
   concat_bottom_vec_.clear();
 
+  // Max and average pooling are fused into one pass unless the internal
+  // layers are asked for.
+  fused_ = spp_param.engine() == SPPParameter_Engine_DEFAULT &&
+      (spp_param.pool() == SPPParameter_PoolMethod_MAX ||
+       spp_param.pool() == SPPParameter_PoolMethod_AVE);
+  if (fused_) {
+    return;
+  }
   if (pyramid_height_ == 1) {
     // pooling layer setup
     LayerParameter pooling_param = GetPoolingParam(0, bottom_h_, bottom_w_,
@@ -158,6 +168,10 @@ void SPPLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   bottom_h_ = bottom[0]->height();
   bottom_w_ = bottom[0]->width();
   reshaped_first_time_ = true;
+  if (fused_) {
+    ReshapeFused(bottom, top);
+    return;
+  }
   SPPParameter spp_param = this->layer_param_.spp_param();
   if (pyramid_height_ == 1) {
     LayerParameter pooling_param = GetPoolingParam(0, bottom_h_, bottom_w_,
@@ -184,9 +198,203 @@ void SPPLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   concat_layer_->Reshape(concat_bottom_vec_, top);
 }
 
+template <typename Dtype>
+void SPPLayer<Dtype>::ReshapeFused(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const SPPParameter& spp_param = this->layer_param_.spp_param();
+  vector<int> levels_shape(2);
+  levels_shape[0] = pyramid_height_;
+  levels_shape[1] = kLevelParams;
+  levels_.Reshape(levels_shape);
+  int* levels = levels_.mutable_cpu_data();
+  int offset = 0;
+  for (int i = 0; i < pyramid_height_; ++i) {
+    // Same windows as the PoolingLayer the unfused engine would set up.
+    const PoolingParameter pool_param = GetPoolingParam(
+        i, bottom_h_, bottom_w_, spp_param).pooling_param();
+    const int kernel_h = pool_param.kernel_h();
+    const int kernel_w = pool_param.kernel_w();
+    const int pad_h = pool_param.pad_h();
+    const int pad_w = pool_param.pad_w();
+    CHECK_LT(pad_h, kernel_h);
+    CHECK_LT(pad_w, kernel_w);
+    int pooled_h = static_cast<int>(ceil(static_cast<float>(
+        bottom_h_ + 2 * pad_h - kernel_h) / kernel_h)) + 1;
+    int pooled_w = static_cast<int>(ceil(static_cast<float>(
+        bottom_w_ + 2 * pad_w - kernel_w) / kernel_w)) + 1;
+    if ((pooled_h - 1) * kernel_h >= bottom_h_ + pad_h) { --pooled_h; }
+    if ((pooled_w - 1) * kernel_w >= bottom_w_ + pad_w) { --pooled_w; }
+    int* level = levels + i * kLevelParams;
+    level[kPooledH] = pooled_h;
+    level[kPooledW] = pooled_w;
+    level[kKernelH] = kernel_h;
+    level[kKernelW] = kernel_w;
+    level[kPadH] = pad_h;
+    level[kPadW] = pad_w;
+    level[kOffset] = offset;
+    offset += channels_ * pooled_h * pooled_w;
+  }
+  if (pyramid_height_ == 1) {
+    top[0]->Reshape(num_, channels_, levels[kPooledH], levels[kPooledW]);
+  } else {
+    vector<int> top_shape(2);
+    top_shape[0] = num_;
+    top_shape[1] = offset;
+    top[0]->Reshape(top_shape);
+  }
+  if (spp_param.pool() == SPPParameter_PoolMethod_MAX) {
+    max_idx_.Reshape(top[0]->shape());
+  }
+}
+
+template <typename Dtype>
+void SPPLayer<Dtype>::ForwardFused_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const bool max_pool = this->layer_param_.spp_param().pool() ==
+      SPPParameter_PoolMethod_MAX;
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  int* mask = max_pool ? max_idx_.mutable_cpu_data() : NULL;
+  const int* levels = levels_.cpu_data();
+  const int top_dim = top[0]->count(1);
+  const int bottom_dim = bottom_h_ * bottom_w_;
+  // Each plane is read once, row by row, and every row is pooled into all
+  // the levels while it is still in cache.
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int p = 0; p < num_ * channels_; ++p) {
+    const Dtype* plane_data = bottom_data + p * bottom_dim;
+    const int top_plane = (p / channels_) * top_dim;
+    const int c = p % channels_;
+    for (int i = 0; i < pyramid_height_; ++i) {
+      const int* level = levels + i * kLevelParams;
+      const int level_dim = level[kPooledH] * level[kPooledW];
+      const int top_offset = top_plane + level[kOffset] + c * level_dim;
+      if (max_pool) {
+        caffe_set(level_dim, Dtype(-FLT_MAX), top_data + top_offset);
+        caffe_set(level_dim, -1, mask + top_offset);
+      } else {
+        caffe_set(level_dim, Dtype(0), top_data + top_offset);
+      }
+    }
+    for (int h = 0; h < bottom_h_; ++h) {
+      const Dtype* row = plane_data + h * bottom_w_;
+      for (int i = 0; i < pyramid_height_; ++i) {
+        const int* level = levels + i * kLevelParams;
+        const int ph = (h + level[kPadH]) / level[kKernelH];
+        if (ph >= level[kPooledH]) { continue; }
+        const int top_offset = top_plane + level[kOffset] +
+            (c * level[kPooledH] + ph) * level[kPooledW];
+        Dtype* top_row = top_data + top_offset;
+        int* mask_row = max_pool ? mask + top_offset : NULL;
+        // Bins are kernel_w wide, the first one cut short by the padding.
+        int pw = 0;
+        int bin_end = level[kKernelW] - level[kPadW];
+        for (int w = 0; w < bottom_w_; ++w) {
+          if (w == bin_end) {
+            if (++pw == level[kPooledW]) { break; }
+            bin_end += level[kKernelW];
+          }
+          if (max_pool) {
+            if (row[w] > top_row[pw]) {
+              top_row[pw] = row[w];
+              mask_row[pw] = h * bottom_w_ + w;
+            }
+          } else {
+            top_row[pw] += row[w];
+          }
+        }
+      }
+    }
+    if (max_pool) { continue; }
+    for (int i = 0; i < pyramid_height_; ++i) {
+      const int* level = levels + i * kLevelParams;
+      Dtype* top_level = top_data + top_plane + level[kOffset] +
+          c * level[kPooledH] * level[kPooledW];
+      for (int ph = 0; ph < level[kPooledH]; ++ph) {
+        const int hstart = ph * level[kKernelH] - level[kPadH];
+        const int hend = min(hstart + level[kKernelH],
+            bottom_h_ + level[kPadH]);
+        for (int pw = 0; pw < level[kPooledW]; ++pw) {
+          const int wstart = pw * level[kKernelW] - level[kPadW];
+          const int wend = min(wstart + level[kKernelW],
+              bottom_w_ + level[kPadW]);
+          top_level[ph * level[kPooledW] + pw] /=
+              (hend - hstart) * (wend - wstart);
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void SPPLayer<Dtype>::BackwardFused_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<Blob<Dtype>*>& bottom) {
+  const bool max_pool = this->layer_param_.spp_param().pool() ==
+      SPPParameter_PoolMethod_MAX;
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  const int* mask = max_pool ? max_idx_.cpu_data() : NULL;
+  const int* levels = levels_.cpu_data();
+  const int top_dim = top[0]->count(1);
+  const int bottom_dim = bottom_h_ * bottom_w_;
+  caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int p = 0; p < num_ * channels_; ++p) {
+    Dtype* plane_diff = bottom_diff + p * bottom_dim;
+    const int top_plane = (p / channels_) * top_dim;
+    const int c = p % channels_;
+    for (int i = 0; i < pyramid_height_; ++i) {
+      const int* level = levels + i * kLevelParams;
+      const int pooled_h = level[kPooledH];
+      const int pooled_w = level[kPooledW];
+      const int top_offset = top_plane + level[kOffset] +
+          c * pooled_h * pooled_w;
+      const Dtype* level_diff = top_diff + top_offset;
+      if (max_pool) {
+        const int* level_mask = mask + top_offset;
+        for (int j = 0; j < pooled_h * pooled_w; ++j) {
+          // Bins lying wholly in the padding have no argmax.
+          if (level_mask[j] >= 0) {
+            plane_diff[level_mask[j]] += level_diff[j];
+          }
+        }
+        continue;
+      }
+      for (int ph = 0; ph < pooled_h; ++ph) {
+        int hstart = ph * level[kKernelH] - level[kPadH];
+        int hend = min(hstart + level[kKernelH], bottom_h_ + level[kPadH]);
+        const int pool_h = hend - hstart;
+        hstart = max(hstart, 0);
+        hend = min(hend, bottom_h_);
+        for (int pw = 0; pw < pooled_w; ++pw) {
+          int wstart = pw * level[kKernelW] - level[kPadW];
+          int wend = min(wstart + level[kKernelW], bottom_w_ + level[kPadW]);
+          const Dtype diff = level_diff[ph * pooled_w + pw] /
+              (pool_h * (wend - wstart));
+          wstart = max(wstart, 0);
+          wend = min(wend, bottom_w_);
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              plane_diff[h * bottom_w_ + w] += diff;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void SPPLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (fused_) {
+    ForwardFused_cpu(bottom, top);
+    return;
+  }
   if (pyramid_height_ == 1) {
     pooling_layers_[0]->Forward(bottom, top);
     return;
@@ -207,6 +415,10 @@ void SPPLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   if (!propagate_down[0]) {
     return;
   }
+  if (fused_) {
+    BackwardFused_cpu(top, bottom);
+    return;
+  }
   if (pyramid_height_ == 1) {
     pooling_layers_[0]->Backward(top, propagate_down, bottom);
     return;
@@ -1,3 +1,5 @@
+#include <stdint.h>
+
 #include <algorithm>
 #include <cfloat>
 #include <vector>
@@ -46,6 +48,21 @@ void UpsampleLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
         << "the output size is ill-defined.";
     upsample_h_ = upsample_w_ = -1;  // flag to calculate in Reshape
   }
+  const PoolingParameter& pool_param = upsample_param.mask_pooling();
+  offset_mask_ = upsample_param.has_mask_pooling() &&
+      pool_param.mask_format() == PoolingParameter_MaskFormat_OFFSET;
+  if (offset_mask_) {
+    CHECK(!pool_param.global_pooling()) << "Global pooling has no mask";
+    mask_kernel_w_ = pool_param.has_kernel_w() ?
+        pool_param.kernel_w() : pool_param.kernel_size();
+    mask_stride_h_ = pool_param.has_stride_h() ?
+        pool_param.stride_h() : pool_param.stride();
+    mask_stride_w_ = pool_param.has_stride_w() ?
+        pool_param.stride_w() : pool_param.stride();
+    mask_pad_h_ = pool_param.has_pad_h() ? pool_param.pad_h() : pool_param.pad();
+    mask_pad_w_ = pool_param.has_pad_w() ? pool_param.pad_w() : pool_param.pad();
+    CHECK_GT(mask_kernel_w_, 0) << "mask_pooling needs the kernel size";
+  }
 }
 
 template <typename Dtype>
@@ -57,8 +74,14 @@ void UpsampleLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       << "corresponding to (num, channels, height, width)";
   CHECK_EQ(bottom[0]->num(), bottom[1]->num());
   CHECK_EQ(bottom[0]->channels(), bottom[1]->channels());
-  CHECK_EQ(bottom[0]->height(), bottom[1]->height());
-  CHECK_EQ(bottom[0]->width(), bottom[1]->width());
+  if (offset_mask_) {
+    CHECK_EQ(bottom[1]->count(2), PackedMaskWidth<Dtype>(
+        bottom[0]->height() * bottom[0]->width()))
+        << "The mask must be the OFFSET mask of the input";
+  } else {
+    CHECK_EQ(bottom[0]->height(), bottom[1]->height());
+    CHECK_EQ(bottom[0]->width(), bottom[1]->width());
+  }
 
   if (upsample_h_ <= 0 || upsample_w_ <= 0) {
     upsample_h_ = bottom[0]->height() * scale_h_ - int(pad_out_h_);
@@ -71,34 +94,58 @@ void UpsampleLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   width_ = bottom[0]->width();
 }
 
+// Index in the top plane of input i, either read from an index mask or
+// decoded from an OFFSET mask; -1 when the pooling window had no maximum.
+template <typename Dtype>
+inline int UpsampleLayer<Dtype>::MaskIndex(const Dtype* mask, int i) const {
+  if (!offset_mask_) {
+    return static_cast<int>(mask[i]);
+  }
+  const int offset = reinterpret_cast<const uint8_t*>(mask)[i];
+  if (offset == kNoMaskOffset) {
+    return -1;
+  }
+  const int h = i / width_ * mask_stride_h_ - mask_pad_h_ +
+      offset / mask_kernel_w_;
+  const int w = i % width_ * mask_stride_w_ - mask_pad_w_ +
+      offset % mask_kernel_w_;
+  return h * upsample_w_ + w;
+}
+
 template <typename Dtype>
 void UpsampleLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const Dtype* bottom_mask_data = bottom[1]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
+  const int planes = bottom[0]->num() * channels_;
+  const int bottom_dim = height_ * width_;
+  const int mask_dim = bottom[1]->count(2);
+  const int top_dim = upsample_h_ * upsample_w_;
 
   // Initialize
   const int top_count = top[0]->count();
   caffe_set(top_count, Dtype(0), top_data);
-  // The main loop
-  for (int n = 0; n < bottom[0]->num(); ++n) {
-    for (int c = 0; c < channels_; ++c) {
-      for (int i = 0; i < height_ * width_; ++i) {
-        const int idx = static_cast<int>(bottom_mask_data[i]);
-        if (idx >= upsample_h_ * upsample_w_) {
-          // this can happen if the pooling layer that created the input mask
-          // had an input with different size to top[0]
-          LOG(FATAL) << "upsample top index " << idx << " out of range - "
-            << "check scale settings match input pooling layer's "
-            << "downsample setup";
-        }
-        top_data[idx] = bottom_data[i];
+  // The planes are independent, so they are scattered in parallel.
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int p = 0; p < planes; ++p) {
+    const Dtype* plane_data = bottom_data + p * bottom_dim;
+    const Dtype* plane_mask = bottom_mask_data + p * mask_dim;
+    Dtype* plane_top = top_data + p * top_dim;
+    for (int i = 0; i < bottom_dim; ++i) {
+      const int idx = MaskIndex(plane_mask, i);
+      if (idx >= top_dim) {
+        // this can happen if the pooling layer that created the input mask
+        // had an input with different size to top[0]
+        LOG(FATAL) << "upsample top index " << idx << " out of range - "
+          << "check scale settings match input pooling layer's "
+          << "downsample setup";
+      }
+      if (idx >= 0) {
+        plane_top[idx] = plane_data[i];
       }
-      // compute offset
-      bottom_data += bottom[0]->offset(0, 1);
-      bottom_mask_data += bottom[1]->offset(0, 1);
-      top_data += top[0]->offset(0, 1);
     }
   }
 }
@@ -110,26 +157,28 @@ void UpsampleLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const Dtype* top_diff = top[0]->cpu_diff();
     const Dtype* bottom_mask_data = bottom[1]->cpu_data();
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    const int planes = bottom[0]->num() * channels_;
+    const int bottom_dim = height_ * width_;
+    const int mask_dim = bottom[1]->count(2);
+    const int top_dim = upsample_h_ * upsample_w_;
 
-    const int bottom_count = bottom[0]->count();
-    caffe_set(bottom_count, Dtype(0), bottom_diff);
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int i = 0; i < height_ * width_; ++i) {
-          const int idx = static_cast<int>(bottom_mask_data[i]);
-          if (idx >= height_ * width_ * scale_h_ * scale_w_) {
-            // this can happen if the pooling layer that created
-            // the input mask had an input with different size to top[0]
-            LOG(FATAL) << "upsample top index " << idx << " out of range - "
-              << "check scale settings match input pooling layer's downsample setup";
-          }
-          bottom_diff[i] = top_diff[idx];
+    // Every input gathers its own gradient, so the planes run in parallel.
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int p = 0; p < planes; ++p) {
+      const Dtype* plane_diff = top_diff + p * top_dim;
+      const Dtype* plane_mask = bottom_mask_data + p * mask_dim;
+      Dtype* plane_bottom = bottom_diff + p * bottom_dim;
+      for (int i = 0; i < bottom_dim; ++i) {
+        const int idx = MaskIndex(plane_mask, i);
+        if (idx >= top_dim) {
+          // this can happen if the pooling layer that created
+          // the input mask had an input with different size to top[0]
+          LOG(FATAL) << "upsample top index " << idx << " out of range - "
+            << "check scale settings match input pooling layer's downsample setup";
         }
-        // compute offset
-        bottom_diff += bottom[0]->offset(0, 1);
-        bottom_mask_data += bottom[1]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
+        plane_bottom[i] = idx >= 0 ? plane_diff[idx] : Dtype(0);
       }
     }
   }
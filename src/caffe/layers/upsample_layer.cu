@@ -21,6 +21,11 @@ template <typename Dtype>
 template <typename Dtype>
 void UpsampleLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (offset_mask_) {
+    // OFFSET masks are only implemented on the CPU.
+    Forward_cpu(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->gpu_data();
   const Dtype* bottom_mask = bottom[1]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
@@ -46,6 +51,10 @@ template <typename Dtype>
 template <typename Dtype>
 void UpsampleLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (offset_mask_) {
+    Backward_cpu(top, propagate_down, bottom);
+    return;
+  }
   if (propagate_down[0]) {
     const Dtype* top_diff = top[0]->gpu_diff();
     const Dtype* bottom_mask = bottom[1]->gpu_data();
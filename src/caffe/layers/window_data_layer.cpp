@@ -284,11 +284,36 @@ void WindowDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       pair<std::string, vector<int> > image =
           image_database_[window[WindowDataLayer<Dtype>::IMAGE_INDEX]];
 
+      // crop window out of image and warp it
+      int x1 = window[WindowDataLayer<Dtype>::X1];
+      int y1 = window[WindowDataLayer<Dtype>::Y1];
+      int x2 = window[WindowDataLayer<Dtype>::X2];
+      int y2 = window[WindowDataLayer<Dtype>::Y2];
+
       cv::Mat cv_img;
       if (this->cache_images_) {
         pair<std::string, Datum> image_cached =
           image_database_cache_[window[WindowDataLayer<Dtype>::IMAGE_INDEX]];
-        cv_img = DecodeDatumToCVMat(image_cached.second, true);
+        // The window is warped to crop_size x crop_size, so the image only
+        // needs enough pixels for the window to cover that. Context padding
+        // only grows the window.
+        const int image_height = image.second[1];
+        const int image_width = image.second[2];
+        const int window_height = y2 - y1 + 1;
+        const int window_width = x2 - x1 + 1;
+        cv_img = DecodeDatumToCVMat(image_cached.second, true,
+            (image_height * crop_size + window_height - 1) / window_height,
+            (image_width * crop_size + window_width - 1) / window_width);
+        if (cv_img.data && (cv_img.rows != image_height ||
+            cv_img.cols != image_width)) {
+          // Map the window onto the reduced decode.
+          x1 = x1 * cv_img.cols / image_width;
+          y1 = y1 * cv_img.rows / image_height;
+          x2 = std::max(x1, std::min(cv_img.cols,
+              (x2 + 1) * cv_img.cols / image_width) - 1);
+          y2 = std::max(y1, std::min(cv_img.rows,
+              (y2 + 1) * cv_img.rows / image_height) - 1);
+        }
       } else {
         cv_img = cv::imread(image.first, CV_LOAD_IMAGE_COLOR);
         if (!cv_img.data) {
@@ -300,12 +325,6 @@ void WindowDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       timer.Start();
       const int channels = cv_img.channels();
 
-      // crop window out of image and warp it
-      int x1 = window[WindowDataLayer<Dtype>::X1];
-      int y1 = window[WindowDataLayer<Dtype>::Y1];
-      int x2 = window[WindowDataLayer<Dtype>::X2];
-      int y2 = window[WindowDataLayer<Dtype>::Y2];
-
       int pad_w = 0;
       int pad_h = 0;
       if (context_pad > 0 || use_square) {
@@ -467,6 +486,9 @@ void WindowDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  // Images are read and decoded in one call.
+  batch->decode_time_ = read_time / 1000;
+  batch->trans_time_ = trans_time / 1000;
 }
 
 INSTANTIATE_CLASS(WindowDataLayer);
@@ -66,6 +66,28 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   param_id_vecs_.resize(param.layer_size());
   top_id_vecs_.resize(param.layer_size());
   bottom_need_backward_.resize(param.layer_size());
+  // Blobs that some layer computes in place, anywhere in the net, and blobs
+  // whose diffs hold loss weights must keep memory of their own.  Loss
+  // layers weight their first top by 1 unless told otherwise.
+  set<string> unaliasable_blobs;
+  for (int layer_id = 0; layer_id < param.layer_size(); ++layer_id) {
+    const LayerParameter& layer_param = param.layer(layer_id);
+    for (int top_id = 0; top_id < layer_param.top_size(); ++top_id) {
+      for (int bottom_id = 0; bottom_id < layer_param.bottom_size();
+           ++bottom_id) {
+        if (layer_param.top(top_id) == layer_param.bottom(bottom_id)) {
+          unaliasable_blobs.insert(layer_param.top(top_id));
+        }
+      }
+      const bool weighted = top_id < layer_param.loss_weight_size() ?
+          layer_param.loss_weight(top_id) != 0 :
+          (top_id == 0 && layer_param.loss_weight_size() == 0 &&
+           layer_param.type().find("Loss") != string::npos);
+      if (weighted) {
+        unaliasable_blobs.insert(layer_param.top(top_id));
+      }
+    }
+  }
   for (int layer_id = 0; layer_id < param.layer_size(); ++layer_id) {
     // Inherit phase from net if unset.
     if (!param.layer(layer_id).has_phase()) {
@@ -117,6 +139,18 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
         AppendTop(param, layer_id, num_top, NULL, NULL);
       }
     }
+    // Views join the memory of a layer's bottoms and tops, so a write to any
+    // of them, or a loss weight kept in any of their diffs, would reach the
+    // others.
+    bool allow_aliasing = true;
+    for (int top_id = 0; top_id < layer_param.top_size(); ++top_id) {
+      allow_aliasing &= !unaliasable_blobs.count(layer_param.top(top_id));
+    }
+    for (int bottom_id = 0; bottom_id < layer_param.bottom_size();
+         ++bottom_id) {
+      allow_aliasing &= !unaliasable_blobs.count(layer_param.bottom(bottom_id));
+    }
+    layer->set_allow_aliasing(allow_aliasing);
     // After this layer is connected, set it up.
     layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
     LOG_IF(INFO, Caffe::root_solver())
@@ -725,7 +759,7 @@ void Net<Dtype>::Backward() {
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
-    layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
+    layers_[i]->ReshapeIfChanged(bottom_vecs_[i], top_vecs_[i]);
   }
 }
 
@@ -769,7 +803,12 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
-  if (H5Fis_hdf5(trained_filename.c_str())) {
+  bool is_hdf5;
+  {
+    boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
+    is_hdf5 = H5Fis_hdf5(trained_filename.c_str()) > 0;
+  }
+  if (is_hdf5) {
     CopyTrainedLayersFromHDF5(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
@@ -786,6 +825,7 @@ void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fopen(trained_filename.c_str(), H5F_ACC_RDONLY,
                            H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open " << trained_filename;
@@ -848,6 +888,7 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -906,7 +947,20 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 template <typename Dtype>
 void Net<Dtype>::Update() {
   for (int i = 0; i < learnable_params_.size(); ++i) {
-    learnable_params_[i]->Update();
+    Blob<Dtype>* blob = learnable_params_[i];
+    if (Caffe::mode() == Caffe::CPU && blob->sparse_diff()) {
+      // Only the touched rows of a row-sparse diff can be nonzero.
+      const vector<int>& rows = blob->diff_rows();
+      const int dim = blob->count(1);
+      const Dtype* diff = blob->cpu_diff();
+      Dtype* data = blob->mutable_cpu_data();
+      for (int j = 0; j < rows.size(); ++j) {
+        caffe_axpy(dim, Dtype(-1), diff + rows[j] * dim,
+            data + rows[j] * dim);
+      }
+    } else {
+      blob->Update();
+    }
   }
 }
 
@@ -916,8 +970,17 @@ void Net<Dtype>::ClearParamDiffs() {
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
     case Caffe::CPU:
-      caffe_set(blob->count(), static_cast<Dtype>(0),
-                blob->mutable_cpu_diff());
+      if (blob->sparse_diff()) {
+        const vector<int>& rows = blob->diff_rows();
+        const int dim = blob->count(1);
+        Dtype* diff = blob->mutable_cpu_diff();
+        for (int j = 0; j < rows.size(); ++j) {
+          caffe_set(dim, static_cast<Dtype>(0), diff + rows[j] * dim);
+        }
+      } else {
+        caffe_set(blob->count(), static_cast<Dtype>(0),
+                  blob->mutable_cpu_diff());
+      }
       break;
     case Caffe::GPU:
 #ifndef CPU_ONLY
@@ -928,11 +991,21 @@ void Net<Dtype>::ClearParamDiffs() {
 #endif
       break;
     }
+    if (blob->sparse_diff()) {
+      blob->clear_diff_rows();
+    }
   }
 }
 
 template <typename Dtype>
 void Net<Dtype>::ShareWeights() {
+  // A shared param stays row-sparse only if every layer using it tracks
+  // its rows.
+  for (int i = 0; i < params_.size(); ++i) {
+    if (param_owners_[i] >= 0 && !params_[i]->sparse_diff()) {
+      params_[param_owners_[i]]->set_sparse_diff(false);
+    }
+  }
   for (int i = 0; i < params_.size(); ++i) {
     if (param_owners_[i] < 0) { continue; }
     params_[i]->ShareData(*params_[param_owners_[i]]);
@@ -1,10 +1,14 @@
 #include <cstdio>
 
+#include <set>
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/layers/eval_detection_layer.hpp"
 #include "caffe/solver.hpp"
+#include "caffe/util/detection.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
@@ -239,6 +243,7 @@ void Solver<Dtype>::Step(int iters) {
       LOG_IF(INFO, Caffe::root_solver()) << "Iteration " << iter_
           << " (" << per_s << " iter/s, " << lapse << "s/"
           << param_.display() << " iters), loss = " << smoothed_loss_;
+      DisplayPrefetchStats(lapse * 1000);
       iteration_timer_.Start();
       iterations_last_ = iter_;
       const vector<Blob<Dtype>*>& result = net_->output_blobs();
@@ -355,6 +360,24 @@ void Solver<Dtype>::Test(const int test_net_id) {
   vector<Dtype> test_score;
   vector<int> test_score_output_id;
   const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
+  // Detection evaluation outputs are merged into AP histograms instead of
+  // being averaged like the other outputs.
+  vector<int> ap_layer_ids;
+  vector<shared_ptr<DetectionAPAccumulator<Dtype> > > ap_accumulators;
+  std::set<int> ap_blob_ids;
+  for (int i = 0; i < test_net->layers().size(); ++i) {
+    if (!dynamic_cast<EvalDetectionLayer<Dtype>*>(
+        test_net->layers()[i].get())) {
+      continue;
+    }
+    const EvalDetectionParameter& eval_param =
+        test_net->layers()[i]->layer_param().eval_detection_param();
+    ap_layer_ids.push_back(i);
+    ap_accumulators.push_back(shared_ptr<DetectionAPAccumulator<Dtype> >(
+        new DetectionAPAccumulator<Dtype>(eval_param.num_class(),
+            eval_param.ap_bins(), eval_param.ap_version())));
+    ap_blob_ids.insert(test_net->top_ids(i)[0]);
+  }
   Dtype loss = 0;
   for (int i = 0; i < param_.test_iter(test_net_id); ++i) {
     SolverAction::Enum request = GetRequestedAction();
@@ -378,8 +401,15 @@ void Solver<Dtype>::Test(const int test_net_id) {
     if (param_.test_compute_loss()) {
       loss += iter_loss;
     }
+    for (int j = 0; j < ap_layer_ids.size(); ++j) {
+      const Blob<Dtype>* rows = test_net->top_vecs()[ap_layer_ids[j]][0];
+      ap_accumulators[j]->Add(rows->cpu_data(), rows->num(), rows->count(1));
+    }
     if (i == 0) {
       for (int j = 0; j < result.size(); ++j) {
+        if (ap_blob_ids.count(test_net->output_blob_indices()[j])) {
+          continue;
+        }
         const Dtype* result_vec = result[j]->cpu_data();
         for (int k = 0; k < result[j]->count(); ++k) {
           test_score.push_back(result_vec[k]);
@@ -389,6 +419,9 @@ void Solver<Dtype>::Test(const int test_net_id) {
     } else {
       int idx = 0;
       for (int j = 0; j < result.size(); ++j) {
+        if (ap_blob_ids.count(test_net->output_blob_indices()[j])) {
+          continue;
+        }
         const Dtype* result_vec = result[j]->cpu_data();
         for (int k = 0; k < result[j]->count(); ++k) {
           test_score[idx++] += result_vec[k];
@@ -418,6 +451,59 @@ void Solver<Dtype>::Test(const int test_net_id) {
     LOG(INFO) << "    Test net output #" << i << ": " << output_name << " = "
               << mean_score << loss_msg_stream.str();
   }
+  for (int i = 0; i < ap_layer_ids.size(); ++i) {
+    const string& layer_name = test_net->layer_names()[ap_layer_ids[i]];
+    const DetectionAPAccumulator<Dtype>& accumulator = *ap_accumulators[i];
+    ostringstream ap_stream;
+    for (int c = 0; c < test_net->layers()[ap_layer_ids[i]]->layer_param()
+         .eval_detection_param().num_class(); ++c) {
+      const Dtype ap = accumulator.AP(c);
+      if (ap >= 0) {
+        ap_stream << " " << c << ":" << ap;
+      }
+    }
+    LOG(INFO) << "    Test net " << layer_name << " mAP = "
+              << accumulator.MeanAP() << " (AP by class" << ap_stream.str()
+              << ")";
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::DisplayPrefetchStats(const float lapse) {
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+  for (int i = 0; i < layers.size(); ++i) {
+    BasePrefetchingDataLayer<Dtype>* data_layer =
+        dynamic_cast<BasePrefetchingDataLayer<Dtype>*>(layers[i].get());
+    if (!data_layer || data_layer->prefetch_stats().batches == 0) {
+      continue;
+    }
+    const PrefetchStats& stats = data_layer->prefetch_stats();
+    const double batches = stats.batches;
+    LOG_IF(INFO, Caffe::root_solver()) << "    Data layer "
+        << net_->layer_names()[i] << ": wait " << stats.wait_time / batches
+        << " ms, queue " << stats.queue_depth / batches << "/"
+        << data_layer->prefetch_count() << ", per batch read "
+        << stats.read_time / batches << " ms, decode "
+        << stats.decode_time / batches << " ms, transform "
+        << stats.trans_time / batches << " ms, load "
+        << stats.load_time / batches << " ms";
+    // Attribute stalls of more than a tenth of the time to the slowest stage.
+    if (lapse > 0 && stats.wait_time > 0.1 * lapse) {
+      const char* stage = "read";
+      double stage_time = stats.read_time;
+      if (stats.decode_time > stage_time) {
+        stage = "decode";
+        stage_time = stats.decode_time;
+      }
+      if (stats.trans_time > stage_time) {
+        stage = "transform";
+      }
+      LOG_IF(INFO, Caffe::root_solver()) << "    Input-bound: waited "
+          << 100 * stats.wait_time / lapse << "% of the time for "
+          << net_->layer_names()[i] << ", slowest stage: " << stage;
+    }
+    data_layer->ResetPrefetchStats();
+  }
 }
 
 template <typename Dtype>
@@ -18,34 +18,31 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   Dtype local_rate = rate * net_params_lr[param_id];
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    // compute square of gradient in update
-    caffe_powx(net_params[param_id]->count(),
-        net_params[param_id]->cpu_diff(), Dtype(2),
-        this->update_[param_id]->mutable_cpu_data());
+    vector<int> offsets;
+    int count;
+    this->DiffRanges(param_id, &offsets, &count);
+    Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+    Dtype* history = this->history_[param_id]->mutable_cpu_data();
+    Dtype* update = this->update_[param_id]->mutable_cpu_data();
+    for (int i = 0; i < offsets.size(); ++i) {
+      const int offset = offsets[i];
+      // compute square of gradient in update
+      caffe_powx(count, diff + offset, Dtype(2), update + offset);
 
-    // update history
-    caffe_add(net_params[param_id]->count(),
-        this->update_[param_id]->cpu_data(),
-        this->history_[param_id]->cpu_data(),
-        this->history_[param_id]->mutable_cpu_data());
+      // update history
+      caffe_add(count, update + offset, history + offset, history + offset);
 
-    // prepare update
-    caffe_powx(net_params[param_id]->count(),
-              this->history_[param_id]->cpu_data(), Dtype(0.5),
-              this->update_[param_id]->mutable_cpu_data());
+      // prepare update
+      caffe_powx(count, history + offset, Dtype(0.5), update + offset);
 
-    caffe_add_scalar(net_params[param_id]->count(),
-              delta, this->update_[param_id]->mutable_cpu_data());
+      caffe_add_scalar(count, delta, update + offset);
 
-    caffe_div(net_params[param_id]->count(),
-              net_params[param_id]->cpu_diff(),
-              this->update_[param_id]->cpu_data(),
-              this->update_[param_id]->mutable_cpu_data());
+      caffe_div(count, diff + offset, update + offset, update + offset);
 
-    // scale and copy
-    caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
-        this->update_[param_id]->cpu_data(), Dtype(0),
-        net_params[param_id]->mutable_cpu_diff());
+      // scale and copy
+      caffe_cpu_axpby(count, local_rate, update + offset, Dtype(0),
+          diff + offset);
+    }
     break;
   }
   case Caffe::GPU: {
@@ -98,9 +98,20 @@ void SGDSolver<Dtype>::ClipGradients() {
   const Dtype clip_gradients = this->param_.clip_gradients();
   if (clip_gradients < 0) { return; }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  vector<int> offsets;
+  int count;
   Dtype sumsq_diff = 0;
   for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
+    if (Caffe::mode() == Caffe::CPU && net_params[i]->sparse_diff()) {
+      DiffRanges(i, &offsets, &count);
+      const Dtype* diff = net_params[i]->cpu_diff();
+      for (int j = 0; j < offsets.size(); ++j) {
+        sumsq_diff += caffe_cpu_dot(count, diff + offsets[j],
+            diff + offsets[j]);
+      }
+    } else {
+      sumsq_diff += net_params[i]->sumsq_diff();
+    }
   }
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
   if (l2norm_diff > clip_gradients) {
@@ -109,8 +120,33 @@ void SGDSolver<Dtype>::ClipGradients() {
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
     for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
+      if (Caffe::mode() == Caffe::CPU && net_params[i]->sparse_diff()) {
+        DiffRanges(i, &offsets, &count);
+        Dtype* diff = net_params[i]->mutable_cpu_diff();
+        for (int j = 0; j < offsets.size(); ++j) {
+          caffe_scal(count, scale_factor, diff + offsets[j]);
+        }
+      } else {
+        net_params[i]->scale_diff(scale_factor);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::DiffRanges(int param_id, vector<int>* offsets,
+    int* count) {
+  const Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  offsets->clear();
+  if (Caffe::mode() == Caffe::CPU && param->sparse_diff()) {
+    const vector<int>& rows = param->diff_rows();
+    *count = param->count(1);
+    for (int i = 0; i < rows.size(); ++i) {
+      offsets->push_back(rows[i] * *count);
     }
+  } else {
+    *count = param->count();
+    offsets->push_back(0);
   }
 }
 
@@ -139,8 +175,13 @@ void SGDSolver<Dtype>::Normalize(int param_id) {
   const Dtype accum_normalization = Dtype(1.) / this->param_.iter_size();
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    caffe_scal(net_params[param_id]->count(), accum_normalization,
-        net_params[param_id]->mutable_cpu_diff());
+    vector<int> offsets;
+    int count;
+    DiffRanges(param_id, &offsets, &count);
+    Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+    for (int i = 0; i < offsets.size(); ++i) {
+      caffe_scal(count, accum_normalization, diff + offsets[i]);
+    }
     break;
   }
   case Caffe::GPU: {
@@ -168,20 +209,24 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
   switch (Caffe::mode()) {
   case Caffe::CPU: {
     if (local_decay) {
+      vector<int> offsets;
+      int count;
+      DiffRanges(param_id, &offsets, &count);
+      const Dtype* data = net_params[param_id]->cpu_data();
+      Dtype* diff = net_params[param_id]->mutable_cpu_diff();
       if (regularization_type == "L2") {
         // add weight decay
-        caffe_axpy(net_params[param_id]->count(),
-            local_decay,
-            net_params[param_id]->cpu_data(),
-            net_params[param_id]->mutable_cpu_diff());
+        for (int i = 0; i < offsets.size(); ++i) {
+          caffe_axpy(count, local_decay, data + offsets[i],
+              diff + offsets[i]);
+        }
       } else if (regularization_type == "L1") {
-        caffe_cpu_sign(net_params[param_id]->count(),
-            net_params[param_id]->cpu_data(),
-            temp_[param_id]->mutable_cpu_data());
-        caffe_axpy(net_params[param_id]->count(),
-            local_decay,
-            temp_[param_id]->cpu_data(),
-            net_params[param_id]->mutable_cpu_diff());
+        Dtype* sign = temp_[param_id]->mutable_cpu_data();
+        for (int i = 0; i < offsets.size(); ++i) {
+          caffe_cpu_sign(count, data + offsets[i], sign + offsets[i]);
+          caffe_axpy(count, local_decay, sign + offsets[i],
+              diff + offsets[i]);
+        }
       } else {
         LOG(FATAL) << "Unknown regularization type: " << regularization_type;
       }
@@ -234,12 +279,16 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   // Compute the update to history, then copy it to the parameter diff.
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
-              net_params[param_id]->cpu_diff(), momentum,
-              history_[param_id]->mutable_cpu_data());
-    caffe_copy(net_params[param_id]->count(),
-        history_[param_id]->cpu_data(),
-        net_params[param_id]->mutable_cpu_diff());
+    vector<int> offsets;
+    int count;
+    DiffRanges(param_id, &offsets, &count);
+    Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+    Dtype* history = history_[param_id]->mutable_cpu_data();
+    for (int i = 0; i < offsets.size(); ++i) {
+      caffe_cpu_axpby(count, local_rate, diff + offsets[i], momentum,
+          history + offsets[i]);
+      caffe_copy(count, history + offsets[i], diff + offsets[i]);
+    }
     break;
   }
   case Caffe::GPU: {
@@ -297,6 +346,7 @@ void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
   string snapshot_filename =
       Solver<Dtype>::SnapshotFilename(".solverstate.h5");
   LOG(INFO) << "Snapshotting solver state to HDF5 file " << snapshot_filename;
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fcreate(snapshot_filename.c_str(), H5F_ACC_TRUNC,
       H5P_DEFAULT, H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -339,6 +389,7 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
 
 template <typename Dtype>
 void SGDSolver<Dtype>::RestoreSolverStateFromHDF5(const string& state_file) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fopen(state_file.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open solver state file " << state_file;
   this->iter_ = hdf5_load_int(file_hid, "iter");
@@ -5,7 +5,8 @@
 namespace caffe {
 SyncedMemory::SyncedMemory()
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    offset_(0) {
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -15,7 +16,22 @@ SyncedMemory::SyncedMemory()
 
 SyncedMemory::SyncedMemory(size_t size)
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    offset_(0) {
+#ifndef CPU_ONLY
+#ifdef DEBUG
+  CUDA_CHECK(cudaGetDevice(&device_));
+#endif
+#endif
+}
+
+SyncedMemory::SyncedMemory(const shared_ptr<SyncedMemory>& parent,
+    size_t offset, size_t size)
+  : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    parent_(parent), offset_(offset) {
+  CHECK(parent_);
+  CHECK_LE(offset + size, parent_->size()) << "View exceeds its parent";
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -91,6 +107,9 @@ inline void SyncedMemory::to_gpu() {
 }
 
 const void* SyncedMemory::cpu_data() {
+  if (parent_) {
+    return static_cast<const char*>(parent_->cpu_data()) + offset_;
+  }
   check_device();
   to_cpu();
   return (const void*)cpu_ptr_;
@@ -99,6 +118,7 @@ const void* SyncedMemory::cpu_data() {
 void SyncedMemory::set_cpu_data(void* data) {
   check_device();
   CHECK(data);
+  CHECK(!parent_) << "Can't set the data of a view";
   if (own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
   }
@@ -110,6 +130,9 @@ void SyncedMemory::set_cpu_data(void* data) {
 const void* SyncedMemory::gpu_data() {
   check_device();
 #ifndef CPU_ONLY
+  if (parent_) {
+    return static_cast<const char*>(parent_->gpu_data()) + offset_;
+  }
   to_gpu();
   return (const void*)gpu_ptr_;
 #else
@@ -122,6 +145,7 @@ void SyncedMemory::set_gpu_data(void* data) {
   check_device();
 #ifndef CPU_ONLY
   CHECK(data);
+  CHECK(!parent_) << "Can't set the data of a view";
   if (own_gpu_data_) {
     CUDA_CHECK(cudaFree(gpu_ptr_));
   }
@@ -134,6 +158,9 @@ void SyncedMemory::set_gpu_data(void* data) {
 }
 
 void* SyncedMemory::mutable_cpu_data() {
+  if (parent_) {
+    return static_cast<char*>(parent_->mutable_cpu_data()) + offset_;
+  }
   check_device();
   to_cpu();
   head_ = HEAD_AT_CPU;
@@ -143,6 +170,9 @@ void* SyncedMemory::mutable_cpu_data() {
 void* SyncedMemory::mutable_gpu_data() {
   check_device();
 #ifndef CPU_ONLY
+  if (parent_) {
+    return static_cast<char*>(parent_->mutable_gpu_data()) + offset_;
+  }
   to_gpu();
   head_ = HEAD_AT_GPU;
   return gpu_ptr_;
@@ -154,6 +184,10 @@ void* SyncedMemory::mutable_gpu_data() {
 
 #ifndef CPU_ONLY
 void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
+  if (parent_) {
+    parent_->async_gpu_push(stream);
+    return;
+  }
   check_device();
   CHECK(head_ == HEAD_AT_CPU);
   if (gpu_ptr_ == NULL) {
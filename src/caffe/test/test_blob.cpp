@@ -59,6 +59,30 @@ TYPED_TEST(BlobSimpleTest, TestReshapeZero) {
   EXPECT_EQ(this->blob_->count(), 0);
 }
 
+TYPED_TEST(BlobSimpleTest, TestSparseDiffRows) {
+  EXPECT_FALSE(this->blob_preshaped_->sparse_diff());
+  this->blob_preshaped_->set_sparse_diff(true);
+  EXPECT_TRUE(this->blob_preshaped_->sparse_diff());
+  this->blob_preshaped_->touch_diff_row(1);
+  this->blob_preshaped_->touch_diff_row(0);
+  this->blob_preshaped_->touch_diff_row(1);
+  const vector<int>& rows = this->blob_preshaped_->diff_rows();
+  ASSERT_EQ(2, rows.size());
+  EXPECT_EQ(1, rows[0]);
+  EXPECT_EQ(0, rows[1]);
+  // Blobs sharing the diff share its rows.
+  Blob<TypeParam> other(2, 3, 4, 5);
+  other.ShareDiff(*this->blob_preshaped_);
+  EXPECT_TRUE(other.sparse_diff());
+  EXPECT_EQ(2, other.diff_rows().size());
+  other.clear_diff_rows();
+  EXPECT_EQ(0, this->blob_preshaped_->diff_rows().size());
+  this->blob_preshaped_->touch_diff_row(1);
+  EXPECT_EQ(1, other.diff_rows().size());
+  this->blob_preshaped_->set_sparse_diff(false);
+  EXPECT_FALSE(this->blob_preshaped_->sparse_diff());
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
@@ -362,6 +362,81 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  void TestUint8Batch() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+
+    TransformationParameter* transform_param =
+        param.mutable_transform_param();
+    transform_param->set_crop_size(2);
+    transform_param->set_mirror(true);
+    transform_param->set_scale(0.5);
+    transform_param->add_mean_value(3);
+    transform_param->add_mean_value(7);
+
+    // Get the normalized float batches with Caffe seed 1701.
+    Caffe::set_random_seed(seed_);
+    vector<vector<Dtype> > batches;
+    {
+      DataLayer<Dtype> layer1(param);
+      layer1.SetUp(blob_bottom_vec_, blob_top_vec_);
+      for (int iter = 0; iter < 2; ++iter) {
+        layer1.Forward(blob_bottom_vec_, blob_top_vec_);
+        batches.push_back(vector<Dtype>(blob_top_data_->cpu_data(),
+            blob_top_data_->cpu_data() + blob_top_data_->count()));
+      }
+    }  // destroy 1st data layer and unlock the db
+
+    // uint8 batches normalized in Forward must match exactly.
+    transform_param->set_uint8_batch(true);
+    Caffe::set_random_seed(seed_);
+    DataLayer<Dtype> layer2(param);
+    layer2.SetUp(blob_bottom_vec_, blob_top_vec_);
+    for (int iter = 0; iter < 2; ++iter) {
+      layer2.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+      }
+      ASSERT_EQ(batches[iter].size(), blob_top_data_->count());
+      for (int j = 0; j < blob_top_data_->count(); ++j) {
+        EXPECT_EQ(batches[iter][j], blob_top_data_->cpu_data()[j])
+            << "debug: iter " << iter << " j " << j;
+      }
+    }
+  }
+
+  void TestPrefetchStats() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(0, layer.prefetch_stats().batches);
+    for (int iter = 0; iter < 4; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    }
+    const PrefetchStats& stats = layer.prefetch_stats();
+    EXPECT_EQ(4, stats.batches);
+    EXPECT_GE(stats.read_time, 0);
+    EXPECT_EQ(0, stats.decode_time);
+    EXPECT_GE(stats.trans_time, 0);
+    EXPECT_GE(stats.load_time, stats.read_time + stats.trans_time);
+    EXPECT_GE(stats.wait_time, 0);
+    EXPECT_GE(stats.queue_depth, 0);
+    EXPECT_LE(stats.queue_depth, 4 * layer.prefetch_count());
+    layer.ResetPrefetchStats();
+    EXPECT_EQ(0, layer.prefetch_stats().batches);
+    EXPECT_EQ(0, layer.prefetch_stats().load_time);
+  }
+
   virtual ~DataLayerTest() { delete blob_top_data_; delete blob_top_label_; }
 
   DataParameter_DB backend_;
@@ -418,6 +493,17 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLevelDB) {
   this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
   this->TestReadCrop(TEST);
 }
+
+TYPED_TEST(DataLayerTest, TestUint8BatchLevelDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestUint8Batch();
+}
+
+TYPED_TEST(DataLayerTest, TestPrefetchStatsLevelDB) {
+  this->Fill(false, DataParameter_DB_LEVELDB);
+  this->TestPrefetchStats();
+}
 #endif  // USE_LEVELDB
 
 #ifdef USE_LMDB
@@ -464,6 +550,17 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLMDB) {
   this->TestReadCrop(TEST);
 }
 
+TYPED_TEST(DataLayerTest, TestUint8BatchLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestUint8Batch();
+}
+
+TYPED_TEST(DataLayerTest, TestPrefetchStatsLMDB) {
+  this->Fill(false, DataParameter_DB_LMDB);
+  this->TestPrefetchStats();
+}
+
 #endif  // USE_LMDB
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -1,4 +1,8 @@
 #ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -29,6 +33,40 @@ void FillDatum(const int label, const int channels, const int height,
   }
 }
 
+// Interleaved (HWC) copy of a uint8 Datum.
+cv::Mat DatumToMat(const Datum& datum) {
+  const int channels = datum.channels();
+  cv::Mat img(datum.height(), datum.width(), CV_8UC(channels));
+  for (int h = 0; h < datum.height(); ++h) {
+    uchar* ptr = img.ptr<uchar>(h);
+    for (int w = 0; w < datum.width(); ++w) {
+      for (int c = 0; c < channels; ++c) {
+        ptr[w * channels + c] = static_cast<uint8_t>(
+            datum.data()[(c * datum.height() + h) * datum.width() + w]);
+      }
+    }
+  }
+  return img;
+}
+
+// Per pixel reference of crop, mirror, mean value subtraction and scaling.
+template <typename Dtype>
+void ReferenceTransform(const cv::Mat& img, const int h_off, const int w_off,
+    const int height, const int width, const bool mirror,
+    const vector<float>& mean_values, const float scale, Dtype* out) {
+  const int channels = img.channels();
+  for (int c = 0; c < channels; ++c) {
+    for (int h = 0; h < height; ++h) {
+      for (int w = 0; w < width; ++w) {
+        const int top_w = mirror ? width - 1 - w : w;
+        Dtype pixel = img.ptr<uchar>(h_off + h)[(w_off + w) * channels + c];
+        out[(c * height + h) * width + top_w] =
+            (pixel - static_cast<Dtype>(mean_values[c])) * scale;
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 class DataTransformTest : public ::testing::Test {
  protected:
@@ -340,5 +378,206 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestMatMatchesDatum) {
+  TransformationParameter transform_param;
+  const int channels = 3;
+  const int height = 20;
+  const int width = 17;
+  const int crop_size = 9;
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_mirror(true);
+  transform_param.set_scale(0.5);
+  transform_param.add_mean_value(10);
+  transform_param.add_mean_value(20);
+  transform_param.add_mean_value(30);
+  Datum datum;
+  FillDatum(0, channels, height, width, true, &datum);
+  cv::Mat img = DatumToMat(datum);
+  Blob<TypeParam> datum_blob(1, channels, crop_size, crop_size);
+  Blob<TypeParam> mat_blob(1, channels, crop_size, crop_size);
+  DataTransformer<TypeParam> datum_transformer(transform_param, TRAIN);
+  DataTransformer<TypeParam> mat_transformer(transform_param, TRAIN);
+  Caffe::set_random_seed(this->seed_);
+  datum_transformer.InitRand();
+  Caffe::set_random_seed(this->seed_);
+  mat_transformer.InitRand();
+  // Both paths draw the same mirror and crop, so outputs must agree.
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    datum_transformer.Transform(datum, &datum_blob);
+    mat_transformer.Transform(img, &mat_blob);
+    for (int j = 0; j < datum_blob.count(); ++j) {
+      EXPECT_EQ(datum_blob.cpu_data()[j], mat_blob.cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestMatMatchesReference) {
+  TransformationParameter transform_param;
+  const int channels = 3;
+  const int height = 12;
+  const int width = 15;
+  const int crop_size = 7;
+  const float scale = 0.25;
+  vector<float> mean_values;
+  mean_values.push_back(1);
+  mean_values.push_back(2);
+  mean_values.push_back(3);
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_mirror(true);
+  transform_param.set_scale(scale);
+  for (int c = 0; c < channels; ++c) {
+    transform_param.add_mean_value(mean_values[c]);
+  }
+  Datum datum;
+  FillDatum(0, channels, height, width, true, &datum);
+  cv::Mat img = DatumToMat(datum);
+  const int h_off = (height - crop_size) / 2;
+  const int w_off = (width - crop_size) / 2;
+  Blob<TypeParam> blob(1, channels, crop_size, crop_size);
+  Blob<TypeParam> plain(1, channels, crop_size, crop_size);
+  Blob<TypeParam> mirrored(1, channels, crop_size, crop_size);
+  ReferenceTransform(img, h_off, w_off, crop_size, crop_size, false,
+      mean_values, scale, plain.mutable_cpu_data());
+  ReferenceTransform(img, h_off, w_off, crop_size, crop_size, true,
+      mean_values, scale, mirrored.mutable_cpu_data());
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  Caffe::set_random_seed(this->seed_);
+  transformer.InitRand();
+  int num_mirrored = 0;
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    transformer.Transform(img, &blob);
+    const bool is_mirrored =
+        blob.cpu_data()[0] == mirrored.cpu_data()[0];
+    const TypeParam* expected =
+        is_mirrored ? mirrored.cpu_data() : plain.cpu_data();
+    num_mirrored += is_mirrored;
+    for (int j = 0; j < blob.count(); ++j) {
+      EXPECT_EQ(blob.cpu_data()[j], expected[j]);
+    }
+  }
+  EXPECT_GT(num_mirrored, 0);
+  EXPECT_LT(num_mirrored, this->num_iter_);
+}
+
+TYPED_TEST(DataTransformTest, TestTransformRaw) {
+  TransformationParameter transform_param;
+  const int channels = 3;
+  const int height = 10;
+  const int width = 11;
+  const int crop_size = 6;
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_mirror(true);
+  Datum datum;
+  FillDatum(0, channels, height, width, true, &datum);
+  cv::Mat img = DatumToMat(datum);
+  Blob<TypeParam> blob(1, channels, crop_size, crop_size);
+  vector<uint8_t> raw(blob.count());
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  DataTransformer<TypeParam> raw_transformer(transform_param, TRAIN);
+  Caffe::set_random_seed(this->seed_);
+  transformer.InitRand();
+  Caffe::set_random_seed(this->seed_);
+  raw_transformer.InitRand();
+  // Without mean and scale, the raw pixels equal the transformed ones.
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    transformer.Transform(datum, &blob);
+    raw_transformer.TransformRaw(datum, &raw[0]);
+    for (int j = 0; j < blob.count(); ++j) {
+      EXPECT_EQ(blob.cpu_data()[j], raw[j]);
+    }
+    transformer.Transform(img, &blob);
+    raw_transformer.TransformRaw(img, &raw[0]);
+    for (int j = 0; j < blob.count(); ++j) {
+      EXPECT_EQ(blob.cpu_data()[j], raw[j]);
+    }
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestBoxTransform) {
+  TransformationParameter transform_param;
+  Datum datum;
+  FillDatum(0, 3, 40, 60, true, &datum);
+  vector<uchar> buf;
+  cv::imencode(".png", DatumToMat(datum), buf);
+  datum.set_data(std::string(reinterpret_cast<char*>(&buf[0]), buf.size()));
+  datum.set_encoded(true);
+  // A box centered in the image, and one at the right border, which no crop
+  // can keep.
+  const float boxes[2][6] = {{1, 0, 0.5, 0.5, 0.2, 0.2},
+                             {2, 1, 0.999, 0.5, 0.1, 0.1}};
+  for (int j = 0; j < 6; ++j) {
+    datum.add_float_data(boxes[0][j]);
+  }
+  // The sample is resized to the blob, whatever the crop.
+  Blob<TypeParam> blob(1, 3, 20, 30);
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  transformer.InitRand();
+  vector<BoxLabel> box_labels;
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    transformer.Transform(datum, &blob, &box_labels);
+    ASSERT_EQ(box_labels.size(), 1);
+    EXPECT_EQ(box_labels[0].class_label_, 1);
+    for (int k = 0; k < 2; ++k) {
+      EXPECT_GE(box_labels[0].box_[k], 0);
+      EXPECT_LE(box_labels[0].box_[k], 1);
+    }
+  }
+  // Crops never keep the border box, so the whole image is used instead.
+  datum.clear_float_data();
+  for (int j = 0; j < 6; ++j) {
+    datum.add_float_data(boxes[1][j]);
+  }
+  transformer.Transform(datum, &blob, &box_labels);
+  ASSERT_EQ(box_labels.size(), 1);
+  for (int k = 0; k < 4; ++k) {
+    EXPECT_EQ(box_labels[0].box_[k], boxes[1][k + 2]);
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestBoxTransformReduced) {
+  TransformationParameter transform_param;
+  Datum datum;
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  ASSERT_TRUE(ReadFileToDatum(filename, &datum));
+  const float box[6] = {1, 0, 0.5, 0.5, 0.4, 0.4};
+  for (int j = 0; j < 6; ++j) {
+    datum.add_float_data(box[j]);
+  }
+  // 1/8 of the 360x480 source still covers the blob in the TEST phase.
+  Blob<TypeParam> blob(1, 3, 40, 40);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  vector<BoxLabel> box_labels;
+  transformer.Transform(datum, &blob, &box_labels);
+  ASSERT_EQ(box_labels.size(), 1);
+  for (int k = 0; k < 4; ++k) {
+    EXPECT_EQ(box_labels[0].box_[k], box[k + 2]);
+  }
+  // The sample should stay close to a full decode resized to the blob.
+  cv::Mat cv_img;
+  cv::resize(ReadImageToCVMat(filename), cv_img, cv::Size(40, 40));
+  double diff = 0;
+  for (int c = 0; c < 3; ++c) {
+    for (int h = 0; h < 40; ++h) {
+      for (int w = 0; w < 40; ++w) {
+        diff += std::abs(blob.data_at(0, c, h, w) -
+            cv_img.ptr<uchar>(h)[w * 3 + c]);
+      }
+    }
+  }
+  EXPECT_LT(diff / blob.count(), 20);
+  // Every TRAIN crop keeps the centered box at a relative position.
+  DataTransformer<TypeParam> train_transformer(transform_param, TRAIN);
+  train_transformer.InitRand();
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    train_transformer.Transform(datum, &blob, &box_labels);
+    ASSERT_EQ(box_labels.size(), 1);
+    for (int k = 0; k < 2; ++k) {
+      EXPECT_GE(box_labels[0].box_[k], 0);
+      EXPECT_LE(box_labels[0].box_[k], 1);
+    }
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/detection.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class DetectionTest : public ::testing::Test {
+ protected:
+  DetectionTest() {
+    Caffe::set_random_seed(1701);
+  }
+
+  void FillBoxes(int n, int num_class, DetectionBoxes<Dtype>* boxes) {
+    vector<Dtype> values(6 * n);
+    caffe_rng_uniform(6 * n, Dtype(0), Dtype(1), &values[0]);
+    boxes->Clear();
+    for (int i = 0; i < n; ++i) {
+      const Dtype* v = &values[6 * i];
+      boxes->Push(v[0], v[1], v[2] * Dtype(0.4) + Dtype(0.05),
+          v[3] * Dtype(0.4) + Dtype(0.05), v[4],
+          static_cast<int>(v[5] * num_class) % num_class);
+    }
+  }
+
+  static Dtype IoU(const DetectionBoxes<Dtype>& boxes, int a, int b) {
+    const Dtype iw = std::min(boxes.x[a] + boxes.w[a] / 2,
+        boxes.x[b] + boxes.w[b] / 2) - std::max(boxes.x[a] - boxes.w[a] / 2,
+        boxes.x[b] - boxes.w[b] / 2);
+    const Dtype ih = std::min(boxes.y[a] + boxes.h[a] / 2,
+        boxes.y[b] + boxes.h[b] / 2) - std::max(boxes.y[a] - boxes.h[a] / 2,
+        boxes.y[b] - boxes.h[b] / 2);
+    if (iw < 0 || ih < 0) return 0;
+    return iw * ih / (boxes.w[a] * boxes.h[a] + boxes.w[b] * boxes.h[b] -
+        iw * ih);
+  }
+
+  // Greedy NMS over all boxes, one pair at a time. Returns the kept indices
+  // ordered by label, then by descending score.
+  vector<int> ReferenceNms(const DetectionBoxes<Dtype>& boxes,
+      Dtype threshold, bool per_class) {
+    vector<std::pair<Dtype, int> > ranked;
+    for (int i = 0; i < boxes.size(); ++i) {
+      ranked.push_back(std::make_pair(-boxes.score[i], i));
+    }
+    std::sort(ranked.begin(), ranked.end());
+    vector<bool> suppressed(ranked.size(), false);
+    vector<std::pair<int, std::pair<Dtype, int> > > kept;
+    for (int i = 0; i < ranked.size(); ++i) {
+      if (suppressed[i]) continue;
+      const int a = ranked[i].second;
+      kept.push_back(std::make_pair(boxes.label[a], ranked[i]));
+      for (int j = i + 1; j < ranked.size(); ++j) {
+        const int b = ranked[j].second;
+        if (per_class && boxes.label[a] != boxes.label[b]) continue;
+        if (IoU(boxes, a, b) >= threshold) suppressed[j] = true;
+      }
+    }
+    std::sort(kept.begin(), kept.end());
+    vector<int> result;
+    for (int i = 0; i < kept.size(); ++i) {
+      result.push_back(kept[i].second.second);
+    }
+    return result;
+  }
+
+  void ExpectKept(const DetectionBoxes<Dtype>& boxes,
+      const DetectionBoxes<Dtype>& kept, const vector<int>& expected) {
+    ASSERT_EQ(expected.size(), kept.size());
+    for (int i = 0; i < kept.size(); ++i) {
+      EXPECT_EQ(boxes.x[expected[i]], kept.x[i]);
+      EXPECT_EQ(boxes.y[expected[i]], kept.y[i]);
+      EXPECT_EQ(boxes.score[expected[i]], kept.score[i]);
+      EXPECT_EQ(boxes.label[expected[i]], kept.label[i]);
+    }
+  }
+
+  void TestNms(bool per_class) {
+    DetectionBoxes<Dtype> boxes, kept;
+    FillBoxes(300, 5, &boxes);
+    BoxNms<Dtype> nms(0.3, per_class, -1);
+    nms.Apply(boxes, &kept);
+    ExpectKept(boxes, kept, ReferenceNms(boxes, 0.3, per_class));
+  }
+};
+
+TYPED_TEST_CASE(DetectionTest, TestDtypes);
+
+TYPED_TEST(DetectionTest, TestNms) {
+  this->TestNms(false);
+}
+
+TYPED_TEST(DetectionTest, TestNmsPerClass) {
+  this->TestNms(true);
+}
+
+TYPED_TEST(DetectionTest, TestNoSuppression) {
+  DetectionBoxes<TypeParam> boxes, kept;
+  this->FillBoxes(50, 3, &boxes);
+  BoxNms<TypeParam> nms(-1, false, -1);
+  nms.Apply(boxes, &kept);
+  ASSERT_EQ(50, kept.size());
+  for (int i = 1; i < kept.size(); ++i) {
+    EXPECT_LE(kept.label[i - 1], kept.label[i]);
+    if (kept.label[i - 1] == kept.label[i]) {
+      EXPECT_GE(kept.score[i - 1], kept.score[i]);
+    }
+  }
+}
+
+TYPED_TEST(DetectionTest, TestTopK) {
+  DetectionBoxes<TypeParam> boxes, kept;
+  this->FillBoxes(100, 1, &boxes);
+  BoxNms<TypeParam> nms(-1, false, 10);
+  nms.Apply(boxes, &kept);
+  ASSERT_EQ(10, kept.size());
+  vector<TypeParam> scores(boxes.score);
+  std::sort(scores.rbegin(), scores.rend());
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(scores[i], kept.score[i]);
+  }
+}
+
+TYPED_TEST(DetectionTest, TestDecodeGridBoxes) {
+  const int side = 2;
+  const int num_class = 3;
+  const int num_object = 2;
+  const int locations = side * side;
+  vector<TypeParam> input(locations * (num_class + 5 * num_object));
+  caffe_rng_uniform(input.size(), TypeParam(0), TypeParam(1), &input[0]);
+  DetectionBoxes<TypeParam> boxes;
+  DecodeGridBoxes(&input[0], side, num_class, num_object, true, true,
+      EvalDetectionParameter_ScoreType_OBJ, TypeParam(0.5), &boxes);
+  int n = 0;
+  for (int j = 0; j < locations; ++j) {
+    int label = 0;
+    for (int c = 1; c < num_class; ++c) {
+      if (input[c * locations + j] > input[label * locations + j]) {
+        label = c;
+      }
+    }
+    for (int k = 0; k < num_object; ++k) {
+      const TypeParam score = input[(num_class + k) * locations + j];
+      if (score < 0.5) continue;
+      ASSERT_LT(n, boxes.size());
+      const TypeParam* box =
+          &input[(num_class + num_object + 4 * k) * locations + j];
+      EXPECT_EQ(label, boxes.label[n]);
+      EXPECT_EQ(score, boxes.score[n]);
+      EXPECT_NEAR((j % side + box[0]) / side, boxes.x[n], 1e-6);
+      EXPECT_NEAR((j / side + box[locations]) / side, boxes.y[n], 1e-6);
+      EXPECT_NEAR(box[2 * locations] * box[2 * locations], boxes.w[n], 1e-6);
+      EXPECT_NEAR(box[3 * locations] * box[3 * locations], boxes.h[n], 1e-6);
+      ++n;
+    }
+  }
+  EXPECT_EQ(n, boxes.size());
+}
+
+TYPED_TEST(DetectionTest, TestGridSide) {
+  EXPECT_EQ(7, GridSide(7 * 7 * (20 + 5 * 2), 20, 2));
+  EXPECT_EQ(19, GridSide(19 * 19 * (80 + 5 * 5), 80, 5));
+}
+
+TYPED_TEST(DetectionTest, TestNmsReuse) {
+  // A 13x13 grid with 5 predictors per cell, run twice through the same
+  // reserved buffers.
+  DetectionBoxes<TypeParam> boxes, kept;
+  BoxNms<TypeParam> nms(0.45, false, -1);
+  nms.Reserve(845);
+  for (int i = 0; i < 2; ++i) {
+    this->FillBoxes(845, 20, &boxes);
+    nms.Apply(boxes, &kept);
+    this->ExpectKept(boxes, kept, this->ReferenceNms(boxes, 0.45, false));
+  }
+}
+
+TYPED_TEST(DetectionTest, TestAPAccumulator) {
+  // Two images with 2 and 1 ground truth boxes of class 0 and none of
+  // class 1, added in two passes.
+  const int num_class = 2;
+  const int dim = num_class + 3 * 4;
+  TypeParam rows[2 * dim] = {
+    2, 0, 0, 0.9, 1, 0, 0, 0.7, 1, 0, 1, 0.8, 0, 1,
+    1, 0, 0, 0.6, 0, 1, 0, 0.5, 1, 0, 0, 0, 0, 0,
+  };
+  DetectionAPAccumulator<TypeParam> accumulator(num_class, 100,
+      EvalDetectionParameter_APVersion_INTEGRAL);
+  accumulator.Add(rows, 1, dim);
+  accumulator.Add(rows + dim, 1, dim);
+  // Ranked: 0.9 tp, 0.7 tp, 0.6 fp, 0.5 tp for 3 boxes.
+  EXPECT_NEAR(1. / 3 + 1. / 3 + 1. / 3 * 0.75, accumulator.AP(0), 1e-6);
+  EXPECT_EQ(-1, accumulator.AP(1));
+  EXPECT_NEAR(accumulator.AP(0), accumulator.MeanAP(), 1e-6);
+
+  DetectionAPAccumulator<TypeParam> eleven_point(num_class, 100,
+      EvalDetectionParameter_APVersion_ELEVEN_POINT);
+  eleven_point.Add(rows, 2, dim);
+  EXPECT_NEAR((7 + 4 * 0.75) / 11, eleven_point.AP(0), 1e-6);
+
+  accumulator.Reset();
+  EXPECT_EQ(-1, accumulator.AP(0));
+}
+
+}  // namespace caffe
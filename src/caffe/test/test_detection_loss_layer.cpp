@@ -0,0 +1,276 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/detection_loss_layer.hpp"
+#include "caffe/util/detection.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class DetectionLossLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  DetectionLossLayerTest()
+      : side_(7), num_class_(20), num_object_(2),
+        blob_bottom_data_(new Blob<Dtype>()),
+        blob_bottom_label_(new Blob<Dtype>()),
+        blob_top_loss_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+  }
+  virtual ~DetectionLossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_loss_;
+  }
+
+  void SetUpParam(LayerParameter* layer_param, bool constriant) {
+    DetectionLossParameter* param =
+        layer_param->mutable_detection_loss_param();
+    param->set_side(side_);
+    param->set_num_class(num_class_);
+    param->set_num_object(num_object_);
+    param->set_constriant(constriant);
+  }
+
+  // Random predictions, and objects in about a third of the cells with
+  // boxes of normalized image coordinates.
+  void FillBottom(int num) {
+    const int locations = side_ * side_;
+    blob_bottom_data_->Reshape(num,
+        locations * (num_class_ + 5 * num_object_), 1, 1);
+    blob_bottom_label_->Reshape(num, locations * 7, 1, 1);
+    FillerParameter filler_param;
+    filler_param.set_min(0.1);
+    filler_param.set_max(0.9);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_bottom_data_);
+    Dtype* label = blob_bottom_label_->mutable_cpu_data();
+    caffe_set(blob_bottom_label_->count(), Dtype(0), label);
+    for (int i = 0; i < num; ++i) {
+      Dtype* image_label = label + i * locations * 7;
+      for (int j = 0; j < locations; ++j) {
+        image_label[locations + j] = caffe_rng_rand() % 3 == 0;
+        image_label[locations * 2 + j] = caffe_rng_rand() % num_class_;
+        Dtype* box = image_label + locations * 3 + j * 4;
+        caffe_rng_uniform(2, Dtype(0), Dtype(1), box);
+        caffe_rng_uniform(2, Dtype(0.05), Dtype(0.5), box + 2);
+      }
+    }
+  }
+
+  // Rewrites the dense label into the sparse layout with max_objects entries.
+  void ToSparseLabel(int max_objects) {
+    const int locations = side_ * side_;
+    const int num = blob_bottom_label_->num();
+    vector<Dtype> dense(blob_bottom_label_->cpu_data(),
+        blob_bottom_label_->cpu_data() + blob_bottom_label_->count());
+    blob_bottom_label_->Reshape(num, 1 + max_objects * kSparseLabelEntry,
+        1, 1);
+    Dtype* label = blob_bottom_label_->mutable_cpu_data();
+    caffe_set(blob_bottom_label_->count(), Dtype(0), label);
+    for (int i = 0; i < num; ++i) {
+      const Dtype* image_dense = &dense[i * locations * 7];
+      Dtype* image_label = label + i * blob_bottom_label_->count(1);
+      int n = 0;
+      for (int j = 0; j < locations; ++j) {
+        if (!image_dense[locations + j]) continue;
+        ASSERT_LT(n, max_objects);
+        Dtype* entry = image_label + 1 + n++ * kSparseLabelEntry;
+        entry[0] = j;
+        entry[1] = image_dense[locations * 2 + j];
+        entry[2] = image_dense[j];
+        for (int o = 0; o < 4; ++o) {
+          entry[3 + o] = image_dense[locations * 3 + j * 4 + o];
+        }
+      }
+      image_label[0] = n;
+    }
+  }
+
+  // The loss as originally computed cell by cell, before the forward pass
+  // was restructured.
+  Dtype ReferenceForward(bool constriant, Dtype object_scale,
+      Dtype noobject_scale, Dtype class_scale, Dtype coord_scale,
+      vector<Dtype>* diff) {
+    const Dtype* input_data = blob_bottom_data_->cpu_data();
+    const Dtype* label_data = blob_bottom_label_->cpu_data();
+    const int num = blob_bottom_data_->num();
+    const int locations = side_ * side_;
+    diff->assign(blob_bottom_data_->count(), Dtype(0));
+    Dtype class_loss(0), noobj_loss(0), obj_loss(0), coord_loss(0);
+    Dtype obj_count(0);
+    for (int i = 0; i < num; ++i) {
+      int index = i * blob_bottom_data_->count(1);
+      int true_index = i * blob_bottom_label_->count(1);
+      for (int j = 0; j < locations; ++j) {
+        for (int k = 0; k < num_object_; ++k) {
+          int p_index = index + num_class_ * locations + k * locations + j;
+          noobj_loss += noobject_scale * pow(input_data[p_index], 2);
+          (*diff)[p_index] = noobject_scale * input_data[p_index];
+        }
+        if (!label_data[true_index + locations + j]) {
+          continue;
+        }
+        obj_count += 1;
+        int label = static_cast<int>(label_data[true_index + locations * 2 + j]);
+        for (int c = 0; c < num_class_; ++c) {
+          int class_index = index + c * locations + j;
+          Dtype target = Dtype(c == label);
+          class_loss += class_scale * pow(input_data[class_index] - target, 2);
+          (*diff)[class_index] = class_scale * (input_data[class_index] - target);
+        }
+        const Dtype* true_box_pt =
+            label_data + true_index + locations * 3 + j * 4;
+        vector<Dtype> true_box(true_box_pt, true_box_pt + 4);
+        const Dtype* box_pt =
+            input_data + index + (num_class_ + num_object_) * locations + j;
+        Dtype best_iou = 0.;
+        Dtype best_rmse = 20.;
+        int best_index = 0;
+        for (int k = 0; k < num_object_; ++k) {
+          vector<Dtype> box;
+          for (int o = 0; o < 4; ++o) {
+            box.push_back(*(box_pt + (k * 4 + o) * locations));
+          }
+          if (constriant) {
+            box[0] = (j % side_ + box[0]) / side_;
+            box[1] = (j / side_ + box[1]) / side_;
+          }
+          box[2] = pow(box[2], 2);
+          box[3] = pow(box[3], 2);
+          Dtype iou = Calc_iou(box, true_box);
+          Dtype rmse = Calc_rmse(box, true_box);
+          if (best_iou > 0 || iou > 0) {
+            if (iou > best_iou) {
+              best_iou = iou;
+              best_index = k;
+            }
+          } else if (rmse < best_rmse) {
+            best_rmse = rmse;
+            best_index = k;
+          }
+        }
+        int p_index = index + num_class_ * locations + best_index * locations + j;
+        noobj_loss -= noobject_scale * pow(input_data[p_index], 2);
+        obj_loss += object_scale * pow(input_data[p_index] - 1., 2);
+        (*diff)[p_index] = object_scale * (input_data[p_index] - best_iou);
+        int box_index =
+            index + (num_class_ + num_object_ + best_index * 4) * locations + j;
+        if (constriant) {
+          true_box[0] = true_box[0] * side_ - Dtype(j % side_);
+          true_box[1] = true_box[1] * side_ - Dtype(j / side_);
+        }
+        true_box[2] = sqrt(true_box[2]);
+        true_box[3] = sqrt(true_box[3]);
+        for (int o = 0; o < 4; ++o) {
+          Dtype delta = input_data[box_index + o * locations] - true_box[o];
+          (*diff)[box_index + o * locations] = coord_scale * delta;
+          coord_loss += coord_scale * delta * delta;
+        }
+      }
+    }
+    return (class_loss + coord_loss + obj_loss) / obj_count +
+        noobj_loss / (locations * num_object_ * num - obj_count);
+  }
+
+  void TestForward(bool constriant, int num) {
+    FillBottom(num);
+    LayerParameter layer_param;
+    SetUpParam(&layer_param, constriant);
+    DetectionLossLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const DetectionLossParameter& param = layer_param.detection_loss_param();
+    vector<Dtype> diff;
+    const Dtype loss = ReferenceForward(constriant, param.object_scale(),
+        param.noobject_scale(), param.class_scale(), param.coord_scale(),
+        &diff);
+    EXPECT_NEAR(loss, this->blob_top_loss_->cpu_data()[0], 1e-4 * loss);
+    // The gradient is the diff scaled by top diff / num.
+    this->blob_top_loss_->mutable_cpu_diff()[0] = Dtype(2);
+    vector<bool> propagate_down(2, false);
+    propagate_down[0] = true;
+    layer.Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+    const Dtype* bottom_diff = this->blob_bottom_data_->cpu_diff();
+    for (int i = 0; i < diff.size(); ++i) {
+      EXPECT_NEAR(diff[i] * 2 / num, bottom_diff[i], 1e-5);
+    }
+  }
+
+  const int side_;
+  const int num_class_;
+  const int num_object_;
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(DetectionLossLayerTest, TestDtypes);
+
+TYPED_TEST(DetectionLossLayerTest, TestForwardBackward) {
+  this->TestForward(false, 4);
+}
+
+TYPED_TEST(DetectionLossLayerTest, TestForwardBackwardConstriant) {
+  this->TestForward(true, 4);
+}
+
+TYPED_TEST(DetectionLossLayerTest, TestSparseLabel) {
+  this->FillBottom(4);
+  LayerParameter layer_param;
+  this->SetUpParam(&layer_param, true);
+  DetectionLossLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const TypeParam dense_loss = this->blob_top_loss_->cpu_data()[0];
+  vector<bool> propagate_down(2, false);
+  propagate_down[0] = true;
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  const vector<TypeParam> dense_diff(this->blob_bottom_data_->cpu_diff(),
+      this->blob_bottom_data_->cpu_diff() + this->blob_bottom_data_->count());
+  this->ToSparseLabel(this->side_ * this->side_);
+  layer_param.mutable_detection_loss_param()->set_sparse_label(true);
+  DetectionLossLayer<TypeParam> sparse_layer(layer_param);
+  sparse_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  sparse_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NEAR(dense_loss, this->blob_top_loss_->cpu_data()[0],
+      1e-5 * dense_loss);
+  sparse_layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  const TypeParam* bottom_diff = this->blob_bottom_data_->cpu_diff();
+  for (int i = 0; i < dense_diff.size(); ++i) {
+    EXPECT_NEAR(dense_diff[i], bottom_diff[i], 1e-6);
+  }
+}
+
+TYPED_TEST(DetectionLossLayerTest, TestNoObjects) {
+  this->FillBottom(2);
+  caffe_set(this->blob_bottom_label_->count(), TypeParam(0),
+      this->blob_bottom_label_->mutable_cpu_data());
+  LayerParameter layer_param;
+  this->SetUpParam(&layer_param, false);
+  DetectionLossLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const TypeParam loss = this->blob_top_loss_->cpu_data()[0];
+  EXPECT_FALSE(std::isnan(loss));
+  EXPECT_GT(loss, 0);
+}
+
+TYPED_TEST(DetectionLossLayerTest, TestForwardLargeBatch) {
+  // Enough images for the batch-parallel reduction to split the work.
+  this->TestForward(true, 64);
+}
+
+}  // namespace caffe
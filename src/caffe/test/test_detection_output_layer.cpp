@@ -0,0 +1,149 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/detection_output_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class DetectionOutputLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  DetectionOutputLayerTest()
+      : side_(2), num_class_(2), num_object_(2),
+        blob_bottom_(new Blob<Dtype>(2, 4 * (2 + 5 * 2), 1, 1)),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_count_(new Blob<Dtype>()) {
+    // Every image has two overlapping boxes of class 0 in cell 0, a box of
+    // class 1 in cell 1 and low confidence everywhere else.
+    caffe_set(blob_bottom_->count(), Dtype(0.1),
+        blob_bottom_->mutable_cpu_data());
+    for (int i = 0; i < blob_bottom_->num(); ++i) {
+      SetClass(i, 0, 0);
+      SetClass(i, 1, 1);
+      SetBox(i, 0, 0, 0.9, 0.3, 0.3, 0.2, 0.2);
+      SetBox(i, 0, 1, 0.8, 0.31, 0.3, 0.2, 0.2);
+      SetBox(i, 1, 0, 0.6, 0.7, 0.3, 0.2, 0.2);
+    }
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+    blob_top_vec_.push_back(blob_top_count_);
+  }
+  virtual ~DetectionOutputLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_top_count_;
+  }
+
+  void SetClass(int n, int cell, int label) {
+    const int locations = side_ * side_;
+    Dtype* data = blob_bottom_->mutable_cpu_data() + blob_bottom_->offset(n);
+    for (int c = 0; c < num_class_; ++c) {
+      data[c * locations + cell] = c == label ? 1 : 0;
+    }
+  }
+
+  void SetBox(int n, int cell, int k, Dtype conf, Dtype x, Dtype y, Dtype w,
+      Dtype h) {
+    const int locations = side_ * side_;
+    Dtype* data = blob_bottom_->mutable_cpu_data() + blob_bottom_->offset(n);
+    data[(num_class_ + k) * locations + cell] = conf;
+    Dtype* box = data + (num_class_ + num_object_ + k * 4) * locations + cell;
+    box[0] = x;
+    box[locations] = y;
+    box[2 * locations] = w;
+    box[3 * locations] = h;
+  }
+
+  void SetUpParam(LayerParameter* layer_param, int keep_top_k) {
+    DetectionOutputParameter* param =
+        layer_param->mutable_detection_output_param();
+    param->set_side(side_);
+    param->set_num_class(num_class_);
+    param->set_num_object(num_object_);
+    param->set_sqrt(false);
+    param->set_constriant(false);
+    param->set_score_type(EvalDetectionParameter_ScoreType_OBJ);
+    param->set_keep_top_k(keep_top_k);
+  }
+
+  void ExpectDetection(const Dtype* detection, int label, Dtype score,
+      Dtype x, Dtype y) {
+    EXPECT_EQ(label, detection[0]);
+    EXPECT_NEAR(score, detection[1], 1e-6);
+    EXPECT_NEAR(x, detection[2], 1e-6);
+    EXPECT_NEAR(y, detection[3], 1e-6);
+    EXPECT_NEAR(0.2, detection[4], 1e-6);
+    EXPECT_NEAR(0.2, detection[5], 1e-6);
+  }
+
+  const int side_;
+  const int num_class_;
+  const int num_object_;
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_count_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(DetectionOutputLayerTest, TestDtypes);
+
+TYPED_TEST(DetectionOutputLayerTest, TestSetup) {
+  LayerParameter layer_param;
+  this->SetUpParam(&layer_param, 3);
+  DetectionOutputLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_EQ(3, this->blob_top_->num_axes());
+  EXPECT_EQ(2, this->blob_top_->shape(0));
+  EXPECT_EQ(3, this->blob_top_->shape(1));
+  EXPECT_EQ(6, this->blob_top_->shape(2));
+  EXPECT_EQ(2, this->blob_top_count_->count());
+}
+
+TYPED_TEST(DetectionOutputLayerTest, TestForward) {
+  LayerParameter layer_param;
+  this->SetUpParam(&layer_param, 3);
+  DetectionOutputLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < 2; ++i) {
+    const TypeParam* detection = this->blob_top_->cpu_data() +
+        this->blob_top_->offset(i);
+    EXPECT_EQ(2, this->blob_top_count_->cpu_data()[i]);
+    this->ExpectDetection(detection, 0, 0.9, 0.3, 0.3);
+    this->ExpectDetection(detection + 6, 1, 0.6, 0.7, 0.3);
+    EXPECT_EQ(-1, detection[12]);
+  }
+}
+
+TYPED_TEST(DetectionOutputLayerTest, TestForwardKeepTopK) {
+  LayerParameter layer_param;
+  this->SetUpParam(&layer_param, 1);
+  DetectionOutputLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(1, this->blob_top_count_->cpu_data()[0]);
+  this->ExpectDetection(this->blob_top_->cpu_data(), 0, 0.9, 0.3, 0.3);
+}
+
+TYPED_TEST(DetectionOutputLayerTest, TestForwardNoNms) {
+  LayerParameter layer_param;
+  this->SetUpParam(&layer_param, 3);
+  layer_param.mutable_detection_output_param()->set_nms_threshold(-1);
+  DetectionOutputLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const TypeParam* detection = this->blob_top_->cpu_data();
+  EXPECT_EQ(3, this->blob_top_count_->cpu_data()[0]);
+  this->ExpectDetection(detection, 0, 0.9, 0.3, 0.3);
+  this->ExpectDetection(detection + 6, 0, 0.8, 0.31, 0.3);
+  this->ExpectDetection(detection + 12, 1, 0.6, 0.7, 0.3);
+}
+
+}  // namespace caffe
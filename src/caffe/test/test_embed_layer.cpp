@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -154,6 +155,36 @@ TYPED_TEST(EmbedLayerTest, TestGradient) {
       this->blob_top_vec_, -2);
 }
 
+TYPED_TEST(EmbedLayerTest, TestSparseGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  EmbedParameter* embed_param = layer_param.mutable_embed_param();
+  embed_param->set_num_output(10);
+  embed_param->set_input_dim(5);
+  embed_param->set_bias_term(false);
+  embed_param->set_sparse_gradient(true);
+  embed_param->mutable_weight_filler()->set_type("uniform");
+  embed_param->mutable_weight_filler()->set_min(-10);
+  embed_param->mutable_weight_filler()->set_max(10);
+  EmbedLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  this->blob_bottom_->mutable_cpu_data()[0] = 4;
+  this->blob_bottom_->mutable_cpu_data()[1] = 2;
+  this->blob_bottom_->mutable_cpu_data()[2] = 2;
+  this->blob_bottom_->mutable_cpu_data()[3] = 3;
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, -2);
+  if (Caffe::mode() == Caffe::CPU) {
+    // Each looked up row is recorded once.
+    vector<int> rows = layer.blobs()[0]->diff_rows();
+    std::sort(rows.begin(), rows.end());
+    ASSERT_EQ(3, rows.size());
+    EXPECT_EQ(2, rows[0]);
+    EXPECT_EQ(3, rows[1]);
+    EXPECT_EQ(4, rows[2]);
+  }
+}
+
 TYPED_TEST(EmbedLayerTest, TestGradientWithBias) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -1286,4 +1286,99 @@ TYPED_TEST(RMSPropSolverTest, TestSnapshotShare) {
   }
 }
 
+template <typename Dtype>
+class SparseGradientSolverTest : public CPUDeviceTest<Dtype> {
+ protected:
+  // Trains an Embed layer that always looks up row 2 with the given solver,
+  // returning its weights before and after.
+  void Train(const string& type, bool sparse, Blob<Dtype>* initial,
+      Blob<Dtype>* trained) {
+    ostringstream proto;
+    proto <<
+        "type: '" << type << "' "
+        "base_lr: 0.1 "
+        "lr_policy: 'fixed' "
+        "weight_decay: 0.1 "
+        "iter_size: 2 "
+        "clip_gradients: 0.5 "
+        "momentum2: 0.999 "
+        "delta: 1e-6 ";
+    if (type == "AdaGrad" || type == "RMSProp") {
+      proto << "momentum: 0 rms_decay: 0.9 ";
+    } else {
+      proto << "momentum: 0.9 ";
+    }
+    proto <<
+        "net_param { "
+        "  name: 'EmbedNet' "
+        "  layer { "
+        "    name: 'data' "
+        "    type: 'DummyData' "
+        "    dummy_data_param { "
+        "      shape { dim: 4 } "
+        "      shape { dim: 4 dim: 3 } "
+        "      data_filler { type: 'constant' value: 2 } "
+        "      data_filler { type: 'constant' value: 1 } "
+        "    } "
+        "    top: 'data' "
+        "    top: 'target' "
+        "  } "
+        "  layer { "
+        "    name: 'embed' "
+        "    type: 'Embed' "
+        "    embed_param { "
+        "      num_output: 3 "
+        "      input_dim: 5 "
+        "      bias_term: false "
+        "      sparse_gradient: " << (sparse ? "true" : "false") << " "
+        "      weight_filler { type: 'gaussian' std: 1 } "
+        "    } "
+        "    bottom: 'data' "
+        "    top: 'embed' "
+        "  } "
+        "  layer { "
+        "    name: 'loss' "
+        "    type: 'EuclideanLoss' "
+        "    bottom: 'embed' "
+        "    bottom: 'target' "
+        "  } "
+        "} ";
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(), &param));
+    Caffe::set_random_seed(1701);
+    shared_ptr<Solver<Dtype> > solver(
+        SolverRegistry<Dtype>::CreateSolver(param));
+    Blob<Dtype>* weights = solver->net()->learnable_params()[0];
+    EXPECT_EQ(sparse, weights->sparse_diff());
+    initial->CopyFrom(*weights, false, true);
+    solver->Step(3);
+    trained->CopyFrom(*weights, false, true);
+  }
+};
+
+TYPED_TEST_CASE(SparseGradientSolverTest, TestDtypes);
+
+TYPED_TEST(SparseGradientSolverTest, TestLazyUpdates) {
+  const char* types[] =
+      { "SGD", "Nesterov", "AdaGrad", "RMSProp", "AdaDelta", "Adam" };
+  for (int t = 0; t < sizeof(types) / sizeof(types[0]); ++t) {
+    Blob<TypeParam> initial, dense, sparse;
+    this->Train(types[t], false, &initial, &dense);
+    this->Train(types[t], true, &initial, &sparse);
+    for (int row = 0; row < initial.shape(0); ++row) {
+      for (int i = row * 3; i < (row + 1) * 3; ++i) {
+        if (row == 2) {
+          // The looked up row gets exactly the dense update.
+          EXPECT_NEAR(dense.cpu_data()[i], sparse.cpu_data()[i], 1e-5)
+              << types[t];
+          EXPECT_NE(initial.cpu_data()[i], sparse.cpu_data()[i]) << types[t];
+        } else {
+          // The others are not even decayed.
+          EXPECT_EQ(initial.cpu_data()[i], sparse.cpu_data()[i]) << types[t];
+        }
+      }
+    }
+  }
+}
+
 }  // namespace caffe
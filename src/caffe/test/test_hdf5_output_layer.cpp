@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -9,6 +10,7 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -119,4 +121,61 @@ TYPED_TEST(HDF5OutputLayerTest, TestForward) {
       this->output_file_name_;
 }
 
+TYPED_TEST(HDF5OutputLayerTest, TestForwardAppend) {
+  typedef typename TypeParam::Dtype Dtype;
+  hid_t file_id = H5Fopen(this->input_file_name_.c_str(), H5F_ACC_RDONLY,
+                          H5P_DEFAULT);
+  ASSERT_GE(file_id, 0) << "Failed to open HDF5 file" <<
+      this->input_file_name_;
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_DATASET_NAME, 0, 4,
+                       this->blob_data_, true);
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_LABEL_NAME, 0, 4,
+                       this->blob_label_, true);
+  EXPECT_GE(H5Fclose(file_id), 0);
+
+  // Write the rows in batches of 4, 4 and 2.
+  Blob<Dtype> batch_data, batch_label;
+  this->blob_bottom_vec_.push_back(&batch_data);
+  this->blob_bottom_vec_.push_back(&batch_label);
+  LayerParameter param;
+  param.mutable_hdf5_output_param()->set_file_name(this->output_file_name_);
+  {
+    HDF5OutputLayer<Dtype> layer(param);
+    const int num = this->blob_data_->num();
+    const int data_dim = this->blob_data_->count(1);
+    const int label_dim = this->blob_label_->count(1);
+    for (int start = 0; start < num; start += 4) {
+      vector<int> shape = this->blob_data_->shape();
+      shape[0] = std::min(4, num - start);
+      batch_data.Reshape(shape);
+      shape = this->blob_label_->shape();
+      shape[0] = std::min(4, num - start);
+      batch_label.Reshape(shape);
+      caffe_copy(batch_data.count(),
+          this->blob_data_->cpu_data() + start * data_dim,
+          batch_data.mutable_cpu_data());
+      caffe_copy(batch_label.count(),
+          this->blob_label_->cpu_data() + start * label_dim,
+          batch_label.mutable_cpu_data());
+      if (start == 0) {
+        layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      }
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    }
+    layer.Flush();
+  }
+  file_id = H5Fopen(this->output_file_name_.c_str(), H5F_ACC_RDONLY,
+                    H5P_DEFAULT);
+  ASSERT_GE(file_id, 0) << "Failed to open HDF5 file" <<
+      this->output_file_name_;
+  Blob<Dtype> blob_data, blob_label;
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_DATASET_NAME, 0, 4, &blob_data,
+                       true);
+  this->CheckBlobEqual(*this->blob_data_, blob_data);
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_LABEL_NAME, 0, 4, &blob_label,
+                       true);
+  this->CheckBlobEqual(*this->blob_label_, blob_label);
+  EXPECT_GE(H5Fclose(file_id), 0);
+}
+
 }  // namespace caffe
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -85,8 +86,6 @@ TYPED_TEST(HDF5DataLayerTest, TestRead) {
   EXPECT_EQ(this->blob_top_label2_->shape(0), batch_size);
   EXPECT_EQ(this->blob_top_label2_->shape(1), 1);
 
-  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
-
   // Go through the data 10 times (5 batches).
   const int data_size = num_cols * height * width;
   for (int iter = 0; iter < 10; ++iter) {
@@ -162,4 +161,77 @@ TYPED_TEST(HDF5DataLayerTest, TestSkip) {
   Caffe::set_solver_rank(0);
 }
 
+TYPED_TEST(HDF5DataLayerTest, TestReadWindowed) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Reading 3 rows at a time keeps the order of whole files.
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  const int batch_size = 4;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_source(*(this->filename));
+  hdf5_data_param->set_window_size(3);
+  vector<Blob<Dtype>*> top_vec(this->blob_top_vec_.begin(),
+                               this->blob_top_vec_.begin() + 2);
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, top_vec);
+  // Two files of 10 rows.
+  const int data_size = this->blob_top_data_->count(1);
+  for (int iter = 0, row = 0; iter < 10; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, top_vec);
+    for (int i = 0; i < batch_size; ++i, ++row) {
+      const int file_offset = (row % 20 < 10) ? 0 : 2400;
+      EXPECT_EQ(1 + row % 10, this->blob_top_label_->cpu_data()[i]);
+      EXPECT_EQ(file_offset + (row % 10) * data_size,
+                this->blob_top_data_->cpu_data()[i * data_size]);
+    }
+  }
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestShuffleWindowed) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  const int batch_size = 5;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_source(*(this->filename));
+  hdf5_data_param->set_window_size(3);
+  hdf5_data_param->set_shuffle(true);
+  vector<Blob<Dtype>*> top_vec(this->blob_top_vec_.begin(),
+                               this->blob_top_vec_.begin() + 2);
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, top_vec);
+  // Each file yields all of its rows once, one window of rows 3w to 3w + 2
+  // after the other.
+  const int data_size = this->blob_top_data_->count(1);
+  vector<int> labels;
+  for (int iter = 0; iter < 8; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, top_vec);
+    for (int i = 0; i < batch_size; ++i) {
+      const int label = this->blob_top_label_->cpu_data()[i];
+      const int data = this->blob_top_data_->cpu_data()[i * data_size];
+      EXPECT_EQ((label - 1) * data_size, data % 2400);
+      labels.push_back(label);
+    }
+  }
+  for (int file = 0; file < labels.size() / 10; ++file) {
+    vector<bool> seen(10, false);
+    for (int i = 0; i < 10; ++i) {
+      const int row = labels[file * 10 + i] - 1;
+      EXPECT_FALSE(seen[row]);
+      seen[row] = true;
+      if (i > 0 && row / 3 != (labels[file * 10 + i - 1] - 1) / 3) {
+        // A new window starts; the previous one must be complete.
+        const int previous = (labels[file * 10 + i - 1] - 1) / 3;
+        for (int r = 3 * previous; r < std::min(3 * previous + 3, 10); ++r) {
+          EXPECT_TRUE(seen[r]);
+        }
+      }
+    }
+  }
+}
+
 }  // namespace caffe
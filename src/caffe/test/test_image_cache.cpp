@@ -0,0 +1,135 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/format.hpp"
+#include "caffe/util/image_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ImageCacheTest : public ::testing::Test {
+ protected:
+  ImageCacheTest() {
+    param_.set_capacity_mb(1);
+    param_.set_block_kb(4);
+  }
+
+  // A 3-channel image whose bytes encode its seed and position.
+  cv::Mat MakeImage(int rows, int cols, int seed) {
+    cv::Mat img(rows, cols, CV_8UC3);
+    for (int h = 0; h < rows; ++h) {
+      uchar* ptr = img.ptr<uchar>(h);
+      for (int w = 0; w < cols * 3; ++w) {
+        ptr[w] = static_cast<uchar>((seed * 31 + h * 7 + w) % 256);
+      }
+    }
+    return img;
+  }
+
+  void ExpectEqual(const cv::Mat& a, const cv::Mat& b) {
+    ASSERT_EQ(a.rows, b.rows);
+    ASSERT_EQ(a.cols, b.cols);
+    ASSERT_EQ(a.type(), b.type());
+    for (int h = 0; h < a.rows; ++h) {
+      for (int w = 0; w < a.cols * a.channels(); ++w) {
+        EXPECT_EQ(a.ptr<uchar>(h)[w], b.ptr<uchar>(h)[w]);
+      }
+    }
+  }
+
+  ImageCacheParameter param_;
+};
+
+TEST_F(ImageCacheTest, TestInsertLookup) {
+  ImageCache cache(param_);
+  EXPECT_EQ(cache.capacity(), 1024 * 1024);
+  // Spans several blocks with a partial last block.
+  cv::Mat img = MakeImage(50, 60, 1);
+  cv::Mat out;
+  EXPECT_FALSE(cache.Lookup("a", &out));
+  EXPECT_TRUE(cache.Insert("a", img));
+  EXPECT_TRUE(cache.Lookup("a", &out));
+  ExpectEqual(img, out);
+  EXPECT_EQ(cache.size(), 1);
+  EXPECT_EQ(cache.hits(), 1);
+  EXPECT_EQ(cache.misses(), 1);
+}
+
+TEST_F(ImageCacheTest, TestLookupIsACopy) {
+  ImageCache cache(param_);
+  cv::Mat img = MakeImage(10, 10, 2);
+  cache.Insert("a", img);
+  cv::Mat out;
+  cache.Lookup("a", &out);
+  out.ptr<uchar>(0)[0] = img.ptr<uchar>(0)[0] + 1;
+  cv::Mat again;
+  cache.Lookup("a", &again);
+  ExpectEqual(img, again);
+}
+
+TEST_F(ImageCacheTest, TestInsertROI) {
+  ImageCache cache(param_);
+  cv::Mat img = MakeImage(40, 40, 3);
+  cv::Mat roi = img(cv::Rect(5, 7, 20, 11));
+  cache.Insert("roi", roi);
+  cv::Mat out;
+  EXPECT_TRUE(cache.Lookup("roi", &out));
+  ExpectEqual(roi, out);
+}
+
+TEST_F(ImageCacheTest, TestLRUEviction) {
+  // Each 100x100x3 image takes 8 blocks of 4 KB, so 1 MB holds 32 of them.
+  ImageCache cache(param_);
+  for (int i = 0; i < 32; ++i) {
+    EXPECT_TRUE(cache.Insert(format_int(i), MakeImage(100, 100, i)));
+  }
+  EXPECT_EQ(cache.size(), 32);
+  // Touch the oldest entry so that the second oldest gets evicted.
+  cv::Mat out;
+  EXPECT_TRUE(cache.Lookup(format_int(0), &out));
+  EXPECT_TRUE(cache.Insert("new", MakeImage(100, 100, 100)));
+  EXPECT_EQ(cache.size(), 32);
+  EXPECT_TRUE(cache.Lookup(format_int(0), &out));
+  ExpectEqual(MakeImage(100, 100, 0), out);
+  EXPECT_FALSE(cache.Lookup(format_int(1), &out));
+  EXPECT_TRUE(cache.Lookup("new", &out));
+  ExpectEqual(MakeImage(100, 100, 100), out);
+}
+
+TEST_F(ImageCacheTest, TestAllPolicyNeverEvicts) {
+  param_.set_policy(ImageCacheParameter_Policy_ALL);
+  ImageCache cache(param_);
+  for (int i = 0; i < 32; ++i) {
+    EXPECT_TRUE(cache.Insert(format_int(i), MakeImage(100, 100, i)));
+  }
+  EXPECT_FALSE(cache.Insert("new", MakeImage(100, 100, 100)));
+  cv::Mat out;
+  EXPECT_FALSE(cache.Lookup("new", &out));
+  for (int i = 0; i < 32; ++i) {
+    EXPECT_TRUE(cache.Lookup(format_int(i), &out));
+  }
+}
+
+TEST_F(ImageCacheTest, TestTooLarge) {
+  ImageCache cache(param_);
+  EXPECT_FALSE(cache.Insert("big", MakeImage(1000, 1000, 0)));
+  EXPECT_EQ(cache.size(), 0);
+}
+
+TEST_F(ImageCacheTest, TestShared) {
+  shared_ptr<ImageCache> a = ImageCache::Get("shared", param_);
+  shared_ptr<ImageCache> b = ImageCache::Get("shared", param_);
+  shared_ptr<ImageCache> c = ImageCache::Get("other", param_);
+  EXPECT_EQ(a.get(), b.get());
+  EXPECT_NE(a.get(), c.get());
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -152,6 +152,37 @@ TYPED_TEST(ImageDataLayerTest, TestReshape) {
   EXPECT_EQ(this->blob_top_data_->width(), 481);
 }
 
+TYPED_TEST(ImageDataLayerTest, TestResizeCached) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(5);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_new_height(256);
+  image_data_param->set_new_width(256);
+  image_data_param->set_shuffle(false);
+  ImageDataLayer<Dtype> reference_layer(param);
+  reference_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  reference_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> reference;
+  reference.CopyFrom(*this->blob_top_data_, false, true);
+
+  image_data_param->mutable_cache_param()->set_capacity_mb(8);
+  ImageDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The first epoch fills the cache, the second one reads from it.
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    ASSERT_EQ(reference.count(), this->blob_top_data_->count());
+    for (int i = 0; i < reference.count(); ++i) {
+      EXPECT_EQ(reference.cpu_data()[i], this->blob_top_data_->cpu_data()[i]);
+    }
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(i, this->blob_top_label_->cpu_data()[i]);
+    }
+  }
+}
+
 TYPED_TEST(ImageDataLayerTest, TestShuffle) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
@@ -0,0 +1,116 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/interp_layer.hpp"
+#include "caffe/util/interp.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class InterpLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  InterpLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 5, 4)),
+        blob_top_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~InterpLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  // Compares the forward and backward passes with the untabled functions.
+  void TestAgainstReference(const LayerParameter& layer_param) {
+    InterpLayer<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    const InterpParameter& param = layer_param.interp_param();
+    const int channels = blob_bottom_->num() * blob_bottom_->channels();
+    const int height = blob_bottom_->height();
+    const int width = blob_bottom_->width();
+    const int crop = -param.pad_beg();
+    const int height_eff = height + param.pad_beg() + param.pad_end();
+    const int width_eff = width + param.pad_beg() + param.pad_end();
+    const int height_out = blob_top_->height();
+    const int width_out = blob_top_->width();
+    Blob<Dtype> expected(blob_top_->shape());
+    caffe_cpu_interp2<Dtype, false>(channels, blob_bottom_->cpu_data(),
+        crop, crop, height_eff, width_eff, height, width,
+        expected.mutable_cpu_data(), 0, 0, height_out, width_out,
+        height_out, width_out);
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_EQ(expected.cpu_data()[i], blob_top_->cpu_data()[i]);
+    }
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&expected);
+    caffe_copy(expected.count(), expected.cpu_data(),
+        blob_top_->mutable_cpu_diff());
+    layer.Backward(blob_top_vec_, vector<bool>(1, true), blob_bottom_vec_);
+    Blob<Dtype> expected_diff(blob_bottom_->shape());
+    caffe_set(expected_diff.count(), Dtype(0),
+        expected_diff.mutable_cpu_data());
+    caffe_cpu_interp2_backward<Dtype, false>(channels,
+        expected_diff.mutable_cpu_data(), crop, crop, height_eff, width_eff,
+        height, width, expected.cpu_data(), 0, 0, height_out, width_out,
+        height_out, width_out);
+    for (int i = 0; i < expected_diff.count(); ++i) {
+      EXPECT_EQ(expected_diff.cpu_data()[i], blob_bottom_->cpu_diff()[i]);
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(InterpLayerTest, TestDtypes);
+
+TYPED_TEST(InterpLayerTest, TestZoom) {
+  LayerParameter layer_param;
+  layer_param.mutable_interp_param()->set_zoom_factor(3);
+  this->TestAgainstReference(layer_param);
+  EXPECT_EQ(13, this->blob_top_->height());
+  EXPECT_EQ(10, this->blob_top_->width());
+}
+
+TYPED_TEST(InterpLayerTest, TestShrinkCropped) {
+  LayerParameter layer_param;
+  InterpParameter* param = layer_param.mutable_interp_param();
+  param->set_shrink_factor(2);
+  param->set_pad_beg(-1);
+  param->set_pad_end(0);
+  this->TestAgainstReference(layer_param);
+}
+
+TYPED_TEST(InterpLayerTest, TestSameSize) {
+  LayerParameter layer_param;
+  layer_param.mutable_interp_param()->set_height(5);
+  layer_param.mutable_interp_param()->set_width(4);
+  this->TestAgainstReference(layer_param);
+}
+
+TYPED_TEST(InterpLayerTest, TestGradient) {
+  LayerParameter layer_param;
+  layer_param.mutable_interp_param()->set_height(7);
+  layer_param.mutable_interp_param()->set_width(3);
+  InterpLayer<TypeParam> layer(layer_param);
+  GradientChecker<TypeParam> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
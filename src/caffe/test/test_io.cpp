@@ -4,6 +4,8 @@
 #include <opencv2/highgui/highgui_c.h>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
 #include <string>
 
 #include "gtest/gtest.h"
@@ -108,6 +110,29 @@ TEST_F(IOTest, TestReadImageToDatumReferenceResized) {
   }
 }
 
+TEST_F(IOTest, TestReadImageToDatumReferenceReduced) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  Datum datum, datum_ref;
+  // Half the 360x480 source or less, so JPEG reduced decoding may apply.
+  ReadImageToDatum(filename, 0, 90, 120, true, &datum);
+  ReadImageToDatumReference(filename, 0, 90, 120, true, &datum_ref);
+  EXPECT_EQ(datum.channels(), datum_ref.channels());
+  EXPECT_EQ(datum.height(), datum_ref.height());
+  EXPECT_EQ(datum.width(), datum_ref.width());
+  ASSERT_EQ(datum.data().size(), datum_ref.data().size());
+
+  // The reference decodes at full size before resizing, so only compare
+  // within the tolerance of a different resampling path.
+  const string& data = datum.data();
+  const string& data_ref = datum_ref.data();
+  double diff = 0;
+  for (int i = 0; i < datum.data().size(); ++i) {
+    diff += std::abs(static_cast<int>(static_cast<uint8_t>(data[i])) -
+                     static_cast<int>(static_cast<uint8_t>(data_ref[i])));
+  }
+  EXPECT_LT(diff / datum.data().size(), 20);
+}
+
 TEST_F(IOTest, TestReadImageToDatumContent) {
   string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
   Datum datum;
@@ -229,6 +254,70 @@ TEST_F(IOTest, TestReadImageToCVMatResizedGray) {
   EXPECT_EQ(cv_img.cols, 256);
 }
 
+TEST_F(IOTest, TestReadImageToCVMatReduced) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  // 1/8 of the 360x480 source, so the smallest reduced decode applies.
+  cv::Mat cv_img = ReadImageToCVMat(filename, 45, 60, true);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, 45);
+  EXPECT_EQ(cv_img.cols, 60);
+  // Reduced decoding should stay close to a full decode and resize.
+  cv::Mat cv_img_full;
+  cv::resize(ReadImageToCVMat(filename), cv_img_full, cv::Size(60, 45));
+  double diff = 0;
+  for (int h = 0; h < cv_img.rows; ++h) {
+    for (int w = 0; w < cv_img.cols * 3; ++w) {
+      diff += std::abs(static_cast<int>(cv_img.ptr<uchar>(h)[w]) -
+                       static_cast<int>(cv_img_full.ptr<uchar>(h)[w]));
+    }
+  }
+  EXPECT_LT(diff / (45 * 60 * 3), 20);
+}
+
+TEST_F(IOTest, TestReadBoxDataToDatumResized) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  string annoname;
+  MakeTempFilename(&annoname);
+  std::ofstream anno(annoname.c_str());
+  anno << "<annotation><size><width>480</width><height>360</height></size>"
+      << "<object><name>cat</name><difficult>0</difficult><bndbox>"
+      << "<xmin>48</xmin><ymin>36</ymin><xmax>144</xmax><ymax>108</ymax>"
+      << "</bndbox></object></annotation>";
+  anno.close();
+  std::map<string, int> label_map;
+  label_map["cat"] = 0;
+  // Shrunk to a longer side of 120, boxes relative to the original size.
+  Datum datum;
+  EXPECT_TRUE(ReadBoxDataToDatum(filename, annoname, label_map, 0, 0, 120,
+      true, "jpg", &datum));
+  EXPECT_TRUE(datum.encoded());
+  cv::Mat cv_img = DecodeDatumToCVMatNative(datum);
+  EXPECT_EQ(cv_img.rows, 90);
+  EXPECT_EQ(cv_img.cols, 120);
+  const float boxes[6] = {0, 0, 0.2, 0.2, 0.2, 0.2};
+  ASSERT_EQ(datum.float_data_size(), 6);
+  for (int j = 0; j < 6; ++j) {
+    EXPECT_FLOAT_EQ(datum.float_data(j), boxes[j]);
+  }
+  // An explicit size wins over max_side.
+  EXPECT_TRUE(ReadBoxDataToDatum(filename, annoname, label_map, 45, 60, 120,
+      true, "", &datum));
+  EXPECT_FALSE(datum.encoded());
+  EXPECT_EQ(datum.channels(), 3);
+  EXPECT_EQ(datum.height(), 45);
+  EXPECT_EQ(datum.width(), 60);
+  ASSERT_EQ(datum.float_data_size(), 6);
+  for (int j = 0; j < 6; ++j) {
+    EXPECT_FLOAT_EQ(datum.float_data(j), boxes[j]);
+  }
+  // Images within max_side are stored as they are.
+  EXPECT_TRUE(ReadBoxDataToDatum(filename, annoname, label_map, 0, 0, 480,
+      true, "jpg", &datum));
+  Datum file_datum;
+  EXPECT_TRUE(ReadFileToDatum(filename, &file_datum));
+  EXPECT_EQ(datum.data(), file_datum.data());
+}
+
 TEST_F(IOTest, TestCVMatToDatum) {
   string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
   cv::Mat cv_img = ReadImageToCVMat(filename);
@@ -340,6 +429,36 @@ TEST_F(IOTest, TestDecodeDatumToCVMatContent) {
   }
 }
 
+TEST_F(IOTest, TestDecodeDatumToCVMatReduced) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  Datum datum;
+  EXPECT_TRUE(ReadFileToDatum(filename, &datum));
+  // The strongest reduction of the 360x480 source that covers the minimum.
+  cv::Mat cv_img = DecodeDatumToCVMat(datum, true, 100, 200);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, 180);
+  EXPECT_EQ(cv_img.cols, 240);
+  cv_img = DecodeDatumToCVMat(datum, false, 45, 60);
+  EXPECT_EQ(cv_img.channels(), 1);
+  EXPECT_EQ(cv_img.rows, 45);
+  EXPECT_EQ(cv_img.cols, 60);
+  cv_img = DecodeDatumToCVMatNative(datum, 90, 100);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, 90);
+  EXPECT_EQ(cv_img.cols, 120);
+  // Without a minimum size the datum is decoded as is.
+  cv_img = DecodeDatumToCVMat(datum, true, 0, 0);
+  EXPECT_EQ(cv_img.rows, 360);
+  EXPECT_EQ(cv_img.cols, 480);
+  // Native decoding keeps gray JPEGs gray.
+  filename = EXAMPLES_SOURCE_DIR "images/cat_gray.jpg";
+  EXPECT_TRUE(ReadFileToDatum(filename, &datum));
+  cv_img = DecodeDatumToCVMatNative(datum, 45, 60);
+  EXPECT_EQ(cv_img.channels(), 1);
+  EXPECT_EQ(cv_img.rows, 45);
+  EXPECT_EQ(cv_img.cols, 60);
+}
+
 TEST_F(IOTest, TestDecodeDatumNative) {
   string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
   Datum datum;
@@ -284,5 +284,198 @@ TYPED_TEST(LSTMLayerTest, TestGradientNonZeroContBufferSize2WithStaticInput) {
       this->blob_top_vec_, 2);
 }
 
+TYPED_TEST(LSTMLayerTest, TestStreamingForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumTimesteps = 4;
+  const int num = 3;
+  this->ReshapeBlobs(kNumTimesteps, num);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&this->blob_bottom_);
+  filler.Fill(&this->blob_bottom_static_);
+  this->blob_bottom_vec_.push_back(&this->blob_bottom_static_);
+  // Sequences start at the first timestep, and stream 1 restarts at t = 2.
+  Dtype* cont = this->blob_bottom_cont_.mutable_cpu_data();
+  for (int t = 0; t < kNumTimesteps; ++t) {
+    for (int n = 0; n < num; ++n) {
+      cont[t * num + n] = t > 0 && !(t == 2 && n == 1);
+    }
+  }
+  LSTMLayer<Dtype> unrolled(this->layer_param_);
+  unrolled.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  unrolled.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> expected;
+  expected.CopyFrom(this->blob_top_, false, true);
+
+  // Stream the same input one timestep, then three timesteps at a time.
+  LayerParameter streaming_param(this->layer_param_);
+  streaming_param.mutable_recurrent_param()->set_streaming(true);
+  LSTMLayer<Dtype> streaming(streaming_param);
+  Blob<Dtype> step_x, step_cont;
+  vector<Blob<Dtype>*> step_bottom;
+  step_bottom.push_back(&step_x);
+  step_bottom.push_back(&step_cont);
+  step_bottom.push_back(&this->blob_bottom_static_);
+  const int x_dim = this->blob_bottom_.count(1);
+  const int h_dim = expected.count(1);
+  for (int start = 0, steps = 1; start < kNumTimesteps;
+       start += steps, steps = kNumTimesteps - 1) {
+    vector<int> shape = this->blob_bottom_.shape();
+    shape[0] = steps;
+    step_x.Reshape(shape);
+    shape.resize(2);
+    step_cont.Reshape(shape);
+    caffe_copy(step_x.count(), this->blob_bottom_.cpu_data() + start * x_dim,
+               step_x.mutable_cpu_data());
+    caffe_copy(step_cont.count(), cont + start * num,
+               step_cont.mutable_cpu_data());
+    if (start == 0) {
+      streaming.SetUp(step_bottom, this->blob_top_vec_);
+      ASSERT_EQ(unrolled.blobs().size(), streaming.blobs().size());
+      for (int i = 0; i < unrolled.blobs().size(); ++i) {
+        streaming.blobs()[i]->CopyFrom(*unrolled.blobs()[i]);
+      }
+    } else {
+      streaming.Reshape(step_bottom, this->blob_top_vec_);
+    }
+    streaming.Forward(step_bottom, this->blob_top_vec_);
+    ASSERT_EQ(steps * h_dim, this->blob_top_.count());
+    for (int i = 0; i < this->blob_top_.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[start * h_dim + i],
+                  this->blob_top_.cpu_data()[i], 1e-5);
+    }
+  }
+}
+
+TYPED_TEST(LSTMLayerTest, TestLengthBuckets) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumTimesteps = 5;
+  const int num = 2;
+  this->ReshapeBlobs(kNumTimesteps, num);
+  // Stream 0 holds 3 valid timesteps and restarts at t = 2 with a sequence of
+  // length 1; stream 1 holds 2.  The rest is padding, which continues.
+  const int lengths[] = {3, 2};
+  Dtype* cont = this->blob_bottom_cont_.mutable_cpu_data();
+  for (int t = 0; t < kNumTimesteps; ++t) {
+    for (int n = 0; n < num; ++n) {
+      cont[t * num + n] = !(t == 0 || (t == 2 && n == 0));
+    }
+  }
+  LSTMLayer<Dtype> reference(this->layer_param_);
+  reference.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  reference.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> expected;
+  expected.CopyFrom(this->blob_top_, false, true);
+  const int h_dim = expected.count(1);
+
+  LayerParameter bucket_param(this->layer_param_);
+  bucket_param.mutable_recurrent_param()->add_length_buckets(6);
+  bucket_param.mutable_recurrent_param()->add_length_buckets(3);
+  bucket_param.mutable_recurrent_param()->set_sequence_length_input(true);
+  Blob<Dtype> length_blob(vector<int>(1, num));
+  for (int n = 0; n < num; ++n) {
+    length_blob.mutable_cpu_data()[n] = lengths[n];
+  }
+  vector<Blob<Dtype>*> bottom(this->blob_bottom_vec_);
+  bottom.push_back(&length_blob);
+  LSTMLayer<Dtype> layer(bucket_param);
+  layer.SetUp(bottom, this->blob_top_vec_);
+  ASSERT_EQ(reference.blobs().size(), layer.blobs().size());
+  for (int i = 0; i < reference.blobs().size(); ++i) {
+    layer.blobs()[i]->CopyFrom(*reference.blobs()[i]);
+  }
+  // The 3 timesteps that hold valid ones run on the shorter net, and the
+  // timesteps past it come out as 0.
+  layer.Forward(bottom, this->blob_top_vec_);
+  ASSERT_EQ(expected.count(), this->blob_top_.count());
+  for (int i = 0; i < expected.count(); ++i) {
+    const Dtype value = i < 3 * h_dim ? expected.cpu_data()[i] : Dtype(0);
+    EXPECT_NEAR(value, this->blob_top_.cpu_data()[i], 1e-5) << "i = " << i;
+  }
+
+  // A continuing timestep, padded to the bucket of 3, picks up each stream
+  // after its last valid timestep.
+  Blob<Dtype> step_x, step_cont;
+  vector<int> shape = this->blob_bottom_.shape();
+  shape[0] = 1;
+  step_x.Reshape(shape);
+  shape.resize(2);
+  step_cont.Reshape(shape);
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(&step_x);
+  caffe_set(step_cont.count(), Dtype(1), step_cont.mutable_cpu_data());
+  caffe_set(length_blob.count(), Dtype(1), length_blob.mutable_cpu_data());
+  vector<Blob<Dtype>*> step_bottom;
+  step_bottom.push_back(&step_x);
+  step_bottom.push_back(&step_cont);
+  step_bottom.push_back(&length_blob);
+  layer.Reshape(step_bottom, this->blob_top_vec_);
+  layer.Forward(step_bottom, this->blob_top_vec_);
+  ASSERT_EQ(h_dim, this->blob_top_.count());
+  Blob<Dtype> step_top;
+  step_top.CopyFrom(this->blob_top_, false, true);
+
+  // The reference runs each stream through its valid timesteps and the new
+  // one, ending both at t = 3; stream 1 starts a timestep late.
+  Blob<Dtype> first_x, first_cont;
+  first_x.CopyFrom(this->blob_bottom_, false, true);
+  first_cont.CopyFrom(this->blob_bottom_cont_, false, true);
+  const int x_dim = first_x.count(2);
+  this->ReshapeBlobs(4, num);
+  Dtype* x = this->blob_bottom_.mutable_cpu_data();
+  cont = this->blob_bottom_cont_.mutable_cpu_data();
+  for (int t = 0; t < 4; ++t) {
+    for (int n = 0; n < num; ++n) {
+      const int src_t = t - (3 - lengths[n]);
+      Dtype* x_tn = x + (t * num + n) * x_dim;
+      if (src_t < 0) {
+        caffe_set(x_dim, Dtype(0), x_tn);
+        cont[t * num + n] = 0;
+      } else if (src_t < lengths[n]) {
+        caffe_copy(x_dim, first_x.cpu_data() + (src_t * num + n) * x_dim,
+                   x_tn);
+        cont[t * num + n] = first_cont.cpu_data()[src_t * num + n];
+      } else {
+        caffe_copy(x_dim, step_x.cpu_data() + n * x_dim, x_tn);
+        cont[t * num + n] = 1;
+      }
+    }
+  }
+  LSTMLayer<Dtype> step_reference(this->layer_param_);
+  step_reference.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < reference.blobs().size(); ++i) {
+    step_reference.blobs()[i]->CopyFrom(*reference.blobs()[i]);
+  }
+  step_reference.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < h_dim; ++i) {
+    EXPECT_NEAR(this->blob_top_.cpu_data()[3 * h_dim + i],
+                step_top.cpu_data()[i], 1e-5) << "i = " << i;
+  }
+}
+
+TYPED_TEST(LSTMLayerTest, TestGradientLengthBuckets) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->ReshapeBlobs(4, 2);
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(&this->blob_bottom_);
+  // Sequences of 2 timesteps followed by 2 of padding.
+  for (int i = 0; i < this->blob_bottom_cont_.count(); ++i) {
+    this->blob_bottom_cont_.mutable_cpu_data()[i] = (i / 2 == 1);
+  }
+  Blob<Dtype> length_blob(vector<int>(1, 2));
+  caffe_set(length_blob.count(), Dtype(2), length_blob.mutable_cpu_data());
+  this->blob_bottom_vec_.push_back(&length_blob);
+  this->layer_param_.mutable_recurrent_param()->add_length_buckets(2);
+  this->layer_param_.mutable_recurrent_param()->add_length_buckets(4);
+  this->layer_param_.mutable_recurrent_param()->set_sequence_length_input(
+      true);
+  LSTMLayer<Dtype> layer(this->layer_param_);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
 
 }  // namespace caffe
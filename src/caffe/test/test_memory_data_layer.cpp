@@ -2,6 +2,9 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -115,6 +118,109 @@ TYPED_TEST(MemoryDataLayerTest, TestForward) {
   }
 }
 
+template <typename Dtype>
+static void PushInChunks(MemoryDataLayer<Dtype>* layer, const Dtype* data,
+    const Dtype* labels, int n, int chunk, int size) {
+  for (int i = 0; i < n; i += chunk) {
+    CHECK(layer->Push(data + i * size, labels + i, std::min(chunk, n - i)));
+  }
+}
+
+// stream the data in from another thread through a queue that holds less
+// than the whole input, so that batches wrap around the end of the ring
+TYPED_TEST(MemoryDataLayerTest, TestPushFromThread) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  md_param->set_queue_capacity(this->batch_size_ * 2 + 3);
+  MemoryDataLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int size = this->data_->count(1);
+  boost::thread producer(boost::bind(&PushInChunks<Dtype>, &layer,
+      this->data_->cpu_data(), this->labels_->cpu_data(), this->data_->num(),
+      3, size));
+  for (int batch_num = 0; batch_num < this->batches_; ++batch_num) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    ASSERT_EQ(this->batch_size_, this->data_blob_->num());
+    for (int j = 0; j < this->data_blob_->count(); ++j) {
+      EXPECT_EQ(this->data_blob_->cpu_data()[j],
+          this->data_->cpu_data()[size * this->batch_size_ * batch_num + j]);
+    }
+    for (int j = 0; j < this->label_blob_->count(); ++j) {
+      EXPECT_EQ(this->label_blob_->cpu_data()[j],
+          this->labels_->cpu_data()[this->batch_size_ * batch_num + j]);
+    }
+  }
+  producer.join();
+  EXPECT_EQ(0, layer.queue_size());
+}
+
+TYPED_TEST(MemoryDataLayerTest, TestPartialBatch) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  md_param->set_queue_capacity(this->batch_size_);
+  md_param->set_timeout_ms(10);
+  md_param->set_partial_batch(true);
+  MemoryDataLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int n = this->batch_size_ - 3;
+  ASSERT_TRUE(layer.Push(this->data_->cpu_data(), this->labels_->cpu_data(),
+      n));
+  // a push that does not fit times out without queueing anything
+  EXPECT_FALSE(layer.Push(this->data_->cpu_data(), this->labels_->cpu_data(),
+      this->batch_size_, 10));
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_EQ(n, this->data_blob_->num());
+  ASSERT_EQ(n, this->label_blob_->num());
+  for (int j = 0; j < this->data_blob_->count(); ++j) {
+    EXPECT_EQ(this->data_blob_->cpu_data()[j], this->data_->cpu_data()[j]);
+  }
+  for (int j = 0; j < n; ++j) {
+    EXPECT_EQ(this->label_blob_->cpu_data()[j], this->labels_->cpu_data()[j]);
+  }
+  EXPECT_EQ(0, layer.queue_size());
+}
+
+// without partial batches, a timeout only warns and Forward waits on
+TYPED_TEST(MemoryDataLayerTest, TestTimeoutWaitsForFullBatch) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  md_param->set_queue_capacity(this->batch_size_);
+  md_param->set_timeout_ms(1);
+  MemoryDataLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int size = this->data_->count(1);
+  boost::thread producer(boost::bind(&PushInChunks<Dtype>, &layer,
+      this->data_->cpu_data(), this->labels_->cpu_data(), this->batch_size_,
+      1, size));
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  producer.join();
+  ASSERT_EQ(this->batch_size_, this->data_blob_->num());
+  for (int j = 0; j < this->data_blob_->count(); ++j) {
+    EXPECT_EQ(this->data_blob_->cpu_data()[j], this->data_->cpu_data()[j]);
+  }
+  for (int j = 0; j < this->batch_size_; ++j) {
+    EXPECT_EQ(this->label_blob_->cpu_data()[j], this->labels_->cpu_data()[j]);
+  }
+}
+
 #ifdef USE_OPENCV
 TYPED_TEST(MemoryDataLayerTest, AddDatumVectorDefaultTransform) {
   typedef typename TypeParam::Dtype Dtype;
@@ -2446,6 +2446,38 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestConcatInPlaceBottom) {
+  typedef typename TypeParam::Dtype Dtype;
+  // "a" is doubled in place before the concat reads it.
+  const string& proto =
+      "layer { name: 'input' type: 'Input' top: 'a' top: 'b' "
+      "  input_param { shape { dim: 2 dim: 3 } shape { dim: 1 dim: 3 } } } "
+      "layer { name: 'double' type: 'Power' bottom: 'a' top: 'a' "
+      "  power_param { scale: 2 } } "
+      "layer { name: 'concat' type: 'Concat' bottom: 'a' bottom: 'b' "
+      "  top: 'c' concat_param { axis: 0 } } ";
+  this->InitNetFromProtoString(proto);
+  Blob<Dtype>* a = this->net_->blob_by_name("a").get();
+  Blob<Dtype>* b = this->net_->blob_by_name("b").get();
+  for (int i = 0; i < a->count(); ++i) {
+    a->mutable_cpu_data()[i] = i;
+  }
+  for (int i = 0; i < b->count(); ++i) {
+    b->mutable_cpu_data()[i] = a->count() + i;
+  }
+  this->net_->Forward();
+  const Blob<Dtype>* c = this->net_->blob_by_name("c").get();
+  ASSERT_EQ(a->count() + b->count(), c->count());
+  for (int i = 0; i < c->count(); ++i) {
+    EXPECT_EQ(i < a->count() ? 2 * i : i, c->cpu_data()[i]);
+  }
+  // The input is doubled again on every pass.
+  this->net_->Forward();
+  for (int i = 0; i < a->count(); ++i) {
+    EXPECT_EQ(4 * i, c->cpu_data()[i]);
+  }
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
@@ -33,6 +33,20 @@
 
 namespace caffe {
 
+// Counts the Reshapes that reach the layer.
+template <typename Dtype>
+class CountingReLULayer : public ReLULayer<Dtype> {
+ public:
+  explicit CountingReLULayer(const LayerParameter& param)
+      : ReLULayer<Dtype>(param), reshapes_(0) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    ++reshapes_;
+    ReLULayer<Dtype>::Reshape(bottom, top);
+  }
+  int reshapes_;
+};
+
 template <typename TypeParam>
 class NeuronLayerTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -220,6 +234,32 @@ TYPED_TEST(NeuronLayerTest, TestReLU) {
   }
 }
 
+TYPED_TEST(NeuronLayerTest, TestReshapeOnShapeChangeOnly) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  CountingReLULayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(layer.reshapes_, 1);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(layer.reshapes_, 1);
+  // A new input size reshapes once, as does going back to the old one.
+  this->blob_bottom_->Reshape(2, 3, 2, 5);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(layer.reshapes_, 2);
+  EXPECT_EQ(this->blob_top_->shape(), this->blob_bottom_->shape());
+  this->blob_bottom_->Reshape(2, 3, 4, 5);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(layer.reshapes_, 3);
+  EXPECT_EQ(this->blob_top_->shape(), this->blob_bottom_->shape());
+  // So does a top that was reshaped behind the layer's back.
+  this->blob_top_->Reshape(1, 1, 1, 1);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(layer.reshapes_, 4);
+  EXPECT_EQ(this->blob_top_->shape(), this->blob_bottom_->shape());
+}
+
 TYPED_TEST(NeuronLayerTest, TestReLUGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
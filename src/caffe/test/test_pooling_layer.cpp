@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cfloat>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -6,6 +8,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/pooling_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_pooling_layer.hpp"
@@ -540,6 +543,61 @@ TYPED_TEST(PoolingLayerTest, TestGradientMaxTopMask) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestMaxOffsetMask) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_size(3);
+  pooling_param->set_stride(2);
+  pooling_param->set_pad(1);
+  pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+  this->blob_top_vec_.push_back(this->blob_top_mask_);
+  PoolingLayer<Dtype> index_layer(layer_param);
+  index_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  index_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> index_mask;
+  index_mask.CopyFrom(*this->blob_top_mask_, false, true);
+  Blob<Dtype> top_diff(this->blob_top_->shape());
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&top_diff);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  index_layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+      this->blob_bottom_vec_);
+  Blob<Dtype> index_diff;
+  index_diff.CopyFrom(*this->blob_bottom_, true, true);
+
+  pooling_param->set_mask_format(PoolingParameter_MaskFormat_OFFSET);
+  PoolingLayer<Dtype> offset_layer(layer_param);
+  offset_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int pooled_count = this->blob_top_->count(2);
+  EXPECT_EQ(1, this->blob_top_mask_->height());
+  EXPECT_EQ(PackedMaskWidth<Dtype>(pooled_count),
+      this->blob_top_mask_->width());
+  offset_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Decode the offsets back to input indices.
+  const int pooled_width = this->blob_top_->width();
+  const int width = this->blob_bottom_->width();
+  for (int p = 0; p < this->blob_top_->count(0, 2); ++p) {
+    const uint8_t* offsets = reinterpret_cast<const uint8_t*>(
+        this->blob_top_mask_->cpu_data() + p * this->blob_top_mask_->count(2));
+    for (int i = 0; i < pooled_count; ++i) {
+      const int h = i / pooled_width * 2 - 1 + offsets[i] / 3;
+      const int w = i % pooled_width * 2 - 1 + offsets[i] % 3;
+      EXPECT_EQ(index_mask.cpu_data()[p * pooled_count + i], h * width + w);
+    }
+  }
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  offset_layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+      this->blob_bottom_vec_);
+  for (int i = 0; i < index_diff.count(); ++i) {
+    EXPECT_EQ(index_diff.cpu_diff()[i], this->blob_bottom_->cpu_diff()[i]);
+  }
+  this->blob_top_vec_.pop_back();
+}
+
 TYPED_TEST(PoolingLayerTest, TestForwardAve) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -609,6 +667,143 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+// Unpadded pooling done naively, to check the CPU fast paths against.
+template <typename Dtype>
+void ReferencePool(const Blob<Dtype>& bottom, int kernel_h, int kernel_w,
+    int stride, bool max_pool, const Blob<Dtype>& top, Blob<Dtype>* ref,
+    Blob<Dtype>* ref_mask) {
+  ref->ReshapeLike(top);
+  ref_mask->ReshapeLike(top);
+  const int height = bottom.height();
+  const int width = bottom.width();
+  for (int n = 0; n < top.num(); ++n) {
+    for (int c = 0; c < top.channels(); ++c) {
+      for (int ph = 0; ph < top.height(); ++ph) {
+        for (int pw = 0; pw < top.width(); ++pw) {
+          Dtype value = max_pool ? -FLT_MAX : 0;
+          int argmax = -1;
+          int count = 0;
+          for (int h = ph * stride; h < std::min(ph * stride + kernel_h,
+              height); ++h) {
+            for (int w = pw * stride; w < std::min(pw * stride + kernel_w,
+                width); ++w) {
+              const Dtype x = bottom.data_at(n, c, h, w);
+              if (!max_pool) {
+                value += x;
+              } else if (x > value) {
+                value = x;
+                argmax = h * width + w;
+              }
+              ++count;
+            }
+          }
+          const int index = top.offset(n, c, ph, pw);
+          ref->mutable_cpu_data()[index] = max_pool ? value : value / count;
+          ref_mask->mutable_cpu_data()[index] = argmax;
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestForwardStride2) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Odd sizes leave clipped windows on the right and bottom edges.
+  this->blob_bottom_->Reshape(2, 3, 7, 9);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  this->blob_top_vec_.push_back(this->blob_top_mask_);
+  for (int kernel = 2; kernel <= 3; ++kernel) {
+    for (int max_pool = 0; max_pool <= 1; ++max_pool) {
+      LayerParameter layer_param;
+      PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+      pooling_param->set_kernel_size(kernel);
+      pooling_param->set_stride(2);
+      pooling_param->set_pool(max_pool ? PoolingParameter_PoolMethod_MAX :
+          PoolingParameter_PoolMethod_AVE);
+      vector<Blob<Dtype>*> top_vec(this->blob_top_vec_.begin(),
+          this->blob_top_vec_.begin() + (max_pool ? 2 : 1));
+      PoolingLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, top_vec);
+      layer.Forward(this->blob_bottom_vec_, top_vec);
+      Blob<Dtype> ref, ref_mask;
+      ReferencePool(*this->blob_bottom_, kernel, kernel, 2, max_pool,
+          *this->blob_top_, &ref, &ref_mask);
+      for (int i = 0; i < ref.count(); ++i) {
+        EXPECT_NEAR(ref.cpu_data()[i], this->blob_top_->cpu_data()[i], 1e-5);
+        if (max_pool) {
+          EXPECT_EQ(ref_mask.cpu_data()[i],
+              this->blob_top_mask_->cpu_data()[i]);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestForwardGlobal) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_top_vec_.push_back(this->blob_top_mask_);
+  for (int max_pool = 0; max_pool <= 1; ++max_pool) {
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_global_pooling(true);
+    pooling_param->set_pool(max_pool ? PoolingParameter_PoolMethod_MAX :
+        PoolingParameter_PoolMethod_AVE);
+    vector<Blob<Dtype>*> top_vec(this->blob_top_vec_.begin(),
+        this->blob_top_vec_.begin() + (max_pool ? 2 : 1));
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, top_vec);
+    layer.Forward(this->blob_bottom_vec_, top_vec);
+    Blob<Dtype> ref, ref_mask;
+    ReferencePool(*this->blob_bottom_, this->blob_bottom_->height(),
+        this->blob_bottom_->width(), 1, max_pool, *this->blob_top_, &ref,
+        &ref_mask);
+    for (int i = 0; i < ref.count(); ++i) {
+      EXPECT_NEAR(ref.cpu_data()[i], this->blob_top_->cpu_data()[i], 1e-5);
+      if (max_pool) {
+        EXPECT_EQ(ref_mask.cpu_data()[i], this->blob_top_mask_->cpu_data()[i]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestBackwardMaxTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_size(3);
+  pooling_param->set_stride(2);
+  pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+  PoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> top_diff;
+  top_diff.ReshapeLike(*this->blob_top_);
+  filler.Fill(&top_diff);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  Blob<Dtype> bottom_diff;
+  bottom_diff.CopyFrom(*this->blob_bottom_, true, true);
+  // The TEST phase layer keeps no argmax in Forward but must still
+  // propagate the same gradient.
+  layer_param.set_phase(TEST);
+  PoolingLayer<Dtype> test_layer(layer_param);
+  test_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  test_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  test_layer.Backward(this->blob_top_vec_, propagate_down,
+      this->blob_bottom_vec_);
+  for (int i = 0; i < bottom_diff.count(); ++i) {
+    EXPECT_EQ(bottom_diff.cpu_diff()[i], this->blob_bottom_->cpu_diff()[i]);
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
@@ -0,0 +1,206 @@
+#include <cmath>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/sampled_softmax_loss_layer.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+// Exposes the drawn classes and can pin them so that the sampled loss is a
+// deterministic function of the inputs for the gradient checker.
+template <typename Dtype>
+class FixedSampledSoftmaxLossLayer : public SampledSoftmaxLossLayer<Dtype> {
+ public:
+  explicit FixedSampledSoftmaxLossLayer(const LayerParameter& param)
+      : SampledSoftmaxLossLayer<Dtype>(param) {}
+  const vector<int>& sampled() const { return this->sampled_; }
+  vector<int> fixed_;
+
+ protected:
+  virtual void SampleClasses() {
+    if (fixed_.empty()) {
+      SampledSoftmaxLossLayer<Dtype>::SampleClasses();
+      return;
+    }
+    this->sampled_ = fixed_;
+    this->sampled_log_count_.resize(fixed_.size());
+    for (int s = 0; s < fixed_.size(); ++s) {
+      this->sampled_log_count_[s] = this->LogExpectedCount(fixed_[s]);
+    }
+  }
+};
+
+template <typename TypeParam>
+class SampledSoftmaxLossLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  SampledSoftmaxLossLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(6, 2, 2, 1)),
+        blob_bottom_label_(new Blob<Dtype>(6, 1, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()),
+        blob_top_scores_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    for (int i = 0; i < blob_bottom_label_->count(); ++i) {
+      blob_bottom_label_->mutable_cpu_data()[i] = caffe_rng_rand() % kClasses;
+    }
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+  }
+  virtual ~SampledSoftmaxLossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_loss_;
+    delete blob_top_scores_;
+  }
+
+  void SetLayerParam(LayerParameter* layer_param, int num_sampled) {
+    SampledSoftmaxLossParameter* param =
+        layer_param->mutable_sampled_softmax_loss_param();
+    param->set_num_output(kClasses);
+    param->set_num_sampled(num_sampled);
+    param->mutable_weight_filler()->set_type("gaussian");
+    param->mutable_bias_filler()->set_type("gaussian");
+  }
+
+  static const int kClasses = 8;
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_loss_;
+  Blob<Dtype>* const blob_top_scores_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(SampledSoftmaxLossLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestForwardFullSoftmax) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int num_classes = this->kClasses;
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  // The scores top carries no loss.
+  layer_param.add_loss_weight(1);
+  layer_param.add_loss_weight(0);
+  this->SetLayerParam(&layer_param, 3);
+  this->blob_top_vec_.push_back(this->blob_top_scores_);
+  SampledSoftmaxLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_EQ(6, this->blob_top_scores_->shape(0));
+  ASSERT_EQ(num_classes, this->blob_top_scores_->shape(1));
+  const Dtype* data = this->blob_bottom_data_->cpu_data();
+  const Dtype* label = this->blob_bottom_label_->cpu_data();
+  const Dtype* weight = layer.blobs()[0]->cpu_data();
+  const Dtype* bias = layer.blobs()[1]->cpu_data();
+  const Dtype* scores = this->blob_top_scores_->cpu_data();
+  Dtype loss = 0;
+  for (int i = 0; i < 6; ++i) {
+    Dtype sum = 0;
+    for (int c = 0; c < num_classes; ++c) {
+      Dtype score = bias[c];
+      for (int k = 0; k < 4; ++k) {
+        score += data[i * 4 + k] * weight[c * 4 + k];
+      }
+      EXPECT_NEAR(score, scores[i * num_classes + c], 1e-4);
+      sum += exp(score);
+    }
+    loss -= log(exp(scores[i * num_classes + static_cast<int>(label[i])]) /
+        sum);
+  }
+  EXPECT_NEAR(loss / 6, this->blob_top_loss_->cpu_data()[0], 1e-4);
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.add_loss_weight(3);
+  this->SetLayerParam(&layer_param, 5);
+  FixedSampledSoftmaxLossLayer<Dtype> layer(layer_param);
+  // Includes a repeated class and, most likely, some accidental hits.
+  const int fixed[] = {0, 2, 2, 5, 7};
+  layer.fixed_.assign(fixed, fixed + 5);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestGradientIgnoreLabel) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_loss_param()->set_ignore_label(0);
+  this->SetLayerParam(&layer_param, 4);
+  layer_param.mutable_sampled_softmax_loss_param()->set_bias_term(false);
+  layer_param.mutable_sampled_softmax_loss_param()->set_remove_accidental_hits(
+      false);
+  FixedSampledSoftmaxLossLayer<Dtype> layer(layer_param);
+  const int fixed[] = {1, 3, 4, 6};
+  layer.fixed_.assign(fixed, fixed + 4);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestLogUniformSampler) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int num_classes = this->kClasses;
+  LayerParameter layer_param;
+  this->SetLayerParam(&layer_param, 400);
+  FixedSampledSoftmaxLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<int> counts(num_classes, 0);
+  ASSERT_EQ(400, layer.sampled().size());
+  for (int s = 0; s < layer.sampled().size(); ++s) {
+    ASSERT_GE(layer.sampled()[s], 0);
+    ASSERT_LT(layer.sampled()[s], num_classes);
+    ++counts[layer.sampled()[s]];
+  }
+  // Q(0) = log(2) / log(9) ~ 0.32 and Q(7) = log(9 / 8) / log(9) ~ 0.05.
+  EXPECT_GT(counts[0], 3 * counts[num_classes - 1]);
+  EXPECT_TRUE(std::isfinite(this->blob_top_loss_->cpu_data()[0]));
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestUnigramSampler) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int num_classes = this->kClasses;
+  string filename;
+  MakeTempFilename(&filename);
+  std::ofstream outfile(filename.c_str(), std::ofstream::out);
+  for (int c = 0; c < num_classes; ++c) {
+    outfile << (c == 3 ? 1000 : 1) << " ";
+  }
+  outfile.close();
+  LayerParameter layer_param;
+  this->SetLayerParam(&layer_param, 50);
+  SampledSoftmaxLossParameter* param =
+      layer_param.mutable_sampled_softmax_loss_param();
+  param->set_sampler(SampledSoftmaxLossParameter_Sampler_UNIGRAM);
+  param->set_unigram_source(filename);
+  FixedSampledSoftmaxLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  int hits = 0;
+  for (int s = 0; s < layer.sampled().size(); ++s) {
+    ASSERT_GE(layer.sampled()[s], 0);
+    ASSERT_LT(layer.sampled()[s], num_classes);
+    hits += layer.sampled()[s] == 3;
+  }
+  EXPECT_GT(hits, 40);
+  EXPECT_TRUE(std::isfinite(this->blob_top_loss_->cpu_data()[0]));
+}
+
+}  // namespace caffe
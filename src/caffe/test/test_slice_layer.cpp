@@ -132,6 +132,25 @@ TYPED_TEST(SliceLayerTest, TestSliceAcrossNum) {
   }
 }
 
+TYPED_TEST(SliceLayerTest, TestSliceAcrossNumAliased) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_slice_param()->set_axis(0);
+  SliceLayer<Dtype> layer(layer_param);
+  layer.set_allow_aliasing(true);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  // The tops are views of the bottom, so no data was copied.
+  const int top_count = this->blob_top_0_->count();
+  EXPECT_EQ(this->blob_bottom_->cpu_data(), this->blob_top_0_->cpu_data());
+  EXPECT_EQ(this->blob_bottom_->cpu_data() + top_count,
+      this->blob_top_1_->cpu_data());
+  for (int i = 0; i < top_count; ++i) {
+    EXPECT_EQ(this->blob_bottom_->cpu_data()[i + top_count],
+        this->blob_top_1_->cpu_data()[i]);
+  }
+}
+
 TYPED_TEST(SliceLayerTest, TestSliceAcrossChannels) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -199,6 +218,19 @@ TYPED_TEST(SliceLayerTest, TestGradientAcrossNum) {
     this->blob_top_vec_0_);
 }
 
+TYPED_TEST(SliceLayerTest, TestGradientAcrossNumAliased) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Gradient checks are slow; reduce blob size.
+  this->ReduceBottomBlobSize();
+  LayerParameter layer_param;
+  layer_param.mutable_slice_param()->set_axis(0);
+  SliceLayer<Dtype> layer(layer_param);
+  layer.set_allow_aliasing(true);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+    this->blob_top_vec_0_);
+}
+
 TYPED_TEST(SliceLayerTest, TestGradientAcrossChannels) {
   typedef typename TypeParam::Dtype Dtype;
   // Gradient checks are slow; reduce blob size.
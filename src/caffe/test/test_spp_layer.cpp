@@ -10,7 +10,7 @@
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/layers/split_layer.hpp"
 #include "caffe/layers/spp_layer.hpp"
-
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -43,6 +43,42 @@ class SPPLayerTest : public MultiDeviceTest<TypeParam> {
   }
   virtual ~SPPLayerTest() { delete blob_bottom_; delete blob_top_; }
 
+  // Checks that the fused engine computes what the internal Pooling,
+  // Flatten and Concat layers do, forward and backward.
+  void TestFusedAgainstLayers(SPPParameter_PoolMethod pool,
+      int pyramid_height) {
+    LayerParameter layer_param;
+    layer_param.mutable_spp_param()->set_pyramid_height(pyramid_height);
+    layer_param.mutable_spp_param()->set_pool(pool);
+    SPPLayer<Dtype> fused_layer(layer_param);
+    fused_layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    fused_layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    layer_param.mutable_spp_param()->set_engine(SPPParameter_Engine_CAFFE);
+    SPPLayer<Dtype> layer(layer_param);
+    Blob<Dtype> top;
+    vector<Blob<Dtype>*> top_vec(1, &top);
+    layer.SetUp(blob_bottom_vec_, top_vec);
+    layer.Forward(blob_bottom_vec_, top_vec);
+    ASSERT_EQ(top.shape(), blob_top_->shape());
+    for (int i = 0; i < top.count(); ++i) {
+      EXPECT_NEAR(top.cpu_data()[i], blob_top_->cpu_data()[i], 1e-6);
+    }
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&top);
+    caffe_copy(top.count(), top.cpu_data(), top.mutable_cpu_diff());
+    caffe_copy(top.count(), top.cpu_data(), blob_top_->mutable_cpu_diff());
+    vector<bool> propagate_down(1, true);
+    layer.Backward(top_vec, propagate_down, blob_bottom_vec_);
+    Blob<Dtype> bottom_diff;
+    bottom_diff.CopyFrom(*blob_bottom_, true, true);
+    fused_layer.Backward(blob_top_vec_, propagate_down, blob_bottom_vec_);
+    for (int i = 0; i < bottom_diff.count(); ++i) {
+      EXPECT_NEAR(bottom_diff.cpu_diff()[i], blob_bottom_->cpu_diff()[i],
+          1e-6);
+    }
+  }
+
   Blob<Dtype>* const blob_bottom_;
   Blob<Dtype>* const blob_bottom_2_;
   Blob<Dtype>* const blob_bottom_3_;
@@ -118,6 +154,28 @@ TYPED_TEST(SPPLayerTest, TestForwardBackward) {
                  this->blob_bottom_vec_);
 }
 
+TYPED_TEST(SPPLayerTest, TestFusedMax) {
+  this->TestFusedAgainstLayers(SPPParameter_PoolMethod_MAX, 3);
+  this->TestFusedAgainstLayers(SPPParameter_PoolMethod_MAX, 1);
+}
+
+TYPED_TEST(SPPLayerTest, TestFusedAve) {
+  this->TestFusedAgainstLayers(SPPParameter_PoolMethod_AVE, 3);
+  this->TestFusedAgainstLayers(SPPParameter_PoolMethod_AVE, 1);
+}
+
+TYPED_TEST(SPPLayerTest, TestGradientAve) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  SPPParameter* spp_param = layer_param.mutable_spp_param();
+  spp_param->set_pyramid_height(3);
+  spp_param->set_pool(SPPParameter_PoolMethod_AVE);
+  SPPLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 TYPED_TEST(SPPLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
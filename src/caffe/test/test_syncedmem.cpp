@@ -67,6 +67,21 @@ TEST_F(SyncedMemoryTest, TestCPUWrite) {
   }
 }
 
+TEST_F(SyncedMemoryTest, TestCPUView) {
+  shared_ptr<SyncedMemory> mem(new SyncedMemory(10));
+  SyncedMemory view(mem, 4, 3);
+  EXPECT_TRUE(view.is_view());
+  EXPECT_EQ(view.head(), SyncedMemory::UNINITIALIZED);
+  void* view_data = view.mutable_cpu_data();
+  EXPECT_EQ(mem->head(), SyncedMemory::HEAD_AT_CPU);
+  EXPECT_EQ(static_cast<char*>(mem->mutable_cpu_data()) + 4, view_data);
+  caffe_memset(view.size(), 1, view_data);
+  const char* data = static_cast<const char*>(mem->cpu_data());
+  for (int i = 0; i < mem->size(); ++i) {
+    EXPECT_EQ(data[i], (i >= 4 && i < 7) ? 1 : 0);
+  }
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestGPURead) {
@@ -0,0 +1,119 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/pooling_layer.hpp"
+#include "caffe/layers/upsample_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class UpsampleLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  UpsampleLayerTest()
+      : blob_input_(new Blob<Dtype>(2, 3, 7, 6)),
+        blob_pooled_(new Blob<Dtype>()),
+        blob_mask_(new Blob<Dtype>()),
+        blob_top_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_input_);
+    blob_bottom_vec_.push_back(blob_pooled_);
+    blob_bottom_vec_.push_back(blob_mask_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~UpsampleLayerTest() {
+    delete blob_input_;
+    delete blob_pooled_;
+    delete blob_mask_;
+    delete blob_top_;
+  }
+
+  // Max pools the input with a mask of the given format, then unpools it
+  // back to the input size. Returns the unpooled data and the gradient of
+  // the pooled data for a fixed top gradient.
+  void PoolAndUnpool(PoolingParameter_MaskFormat format,
+      vector<Dtype>* unpooled, vector<Dtype>* pooled_diff) {
+    LayerParameter pool_param;
+    PoolingParameter* pooling = pool_param.mutable_pooling_param();
+    pooling->set_kernel_size(2);
+    pooling->set_stride(2);
+    pooling->set_mask_format(format);
+    vector<Blob<Dtype>*> pool_bottom(1, blob_input_);
+    PoolingLayer<Dtype> pool(pool_param);
+    pool.SetUp(pool_bottom, blob_bottom_vec_);
+    pool.Forward(pool_bottom, blob_bottom_vec_);
+
+    LayerParameter upsample_param;
+    upsample_param.mutable_upsample_param()->set_upsample_h(7);
+    upsample_param.mutable_upsample_param()->set_upsample_w(6);
+    upsample_param.mutable_upsample_param()->mutable_mask_pooling()->CopyFrom(
+        *pooling);
+    UpsampleLayer<Dtype> upsample(upsample_param);
+    upsample.SetUp(blob_bottom_vec_, blob_top_vec_);
+    upsample.Forward(blob_bottom_vec_, blob_top_vec_);
+    unpooled->assign(blob_top_->cpu_data(),
+        blob_top_->cpu_data() + blob_top_->count());
+    for (int i = 0; i < blob_top_->count(); ++i) {
+      blob_top_->mutable_cpu_diff()[i] = i % 11;
+    }
+    vector<bool> propagate_down(2, false);
+    propagate_down[0] = true;
+    upsample.Backward(blob_top_vec_, propagate_down, blob_bottom_vec_);
+    pooled_diff->assign(blob_pooled_->cpu_diff(),
+        blob_pooled_->cpu_diff() + blob_pooled_->count());
+  }
+
+  Blob<Dtype>* const blob_input_;
+  Blob<Dtype>* const blob_pooled_;
+  Blob<Dtype>* const blob_mask_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(UpsampleLayerTest, TestDtypes);
+
+TYPED_TEST(UpsampleLayerTest, TestIndexMask) {
+  vector<TypeParam> unpooled, pooled_diff;
+  this->PoolAndUnpool(PoolingParameter_MaskFormat_INDEX, &unpooled,
+      &pooled_diff);
+  // Every unpooled value is either zero or the input at the same place, and
+  // each 2x2 window keeps exactly its maximum.
+  const TypeParam* input = this->blob_input_->cpu_data();
+  int nonzero = 0;
+  for (int i = 0; i < unpooled.size(); ++i) {
+    if (unpooled[i] != 0) {
+      EXPECT_EQ(input[i], unpooled[i]);
+      ++nonzero;
+    }
+  }
+  EXPECT_EQ(this->blob_pooled_->count(), nonzero);
+}
+
+TYPED_TEST(UpsampleLayerTest, TestOffsetMask) {
+  vector<TypeParam> index_unpooled, index_diff;
+  this->PoolAndUnpool(PoolingParameter_MaskFormat_INDEX, &index_unpooled,
+      &index_diff);
+  vector<TypeParam> offset_unpooled, offset_diff;
+  this->PoolAndUnpool(PoolingParameter_MaskFormat_OFFSET, &offset_unpooled,
+      &offset_diff);
+  EXPECT_EQ(PackedMaskWidth<TypeParam>(4 * 3),
+      this->blob_mask_->count(2));
+  ASSERT_EQ(index_unpooled.size(), offset_unpooled.size());
+  for (int i = 0; i < index_unpooled.size(); ++i) {
+    EXPECT_EQ(index_unpooled[i], offset_unpooled[i]);
+  }
+  ASSERT_EQ(index_diff.size(), offset_diff.size());
+  for (int i = 0; i < index_diff.size(); ++i) {
+    EXPECT_EQ(index_diff[i], offset_diff[i]);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,376 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/util/detection.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void DetectionBoxes<Dtype>::Reserve(int capacity) {
+  x.reserve(capacity);
+  y.reserve(capacity);
+  w.reserve(capacity);
+  h.reserve(capacity);
+  score.reserve(capacity);
+  label.reserve(capacity);
+}
+
+template <typename Dtype>
+void DetectionBoxes<Dtype>::Clear() {
+  x.clear();
+  y.clear();
+  w.clear();
+  h.clear();
+  score.clear();
+  label.clear();
+}
+
+template <typename Dtype>
+void DetectionBoxes<Dtype>::Push(Dtype box_x, Dtype box_y, Dtype box_w,
+    Dtype box_h, Dtype box_score, int box_label) {
+  x.push_back(box_x);
+  y.push_back(box_y);
+  w.push_back(box_w);
+  h.push_back(box_h);
+  score.push_back(box_score);
+  label.push_back(box_label);
+}
+
+INSTANTIATE_CLASS(DetectionBoxes);
+
+int GridSide(int input_dim, int num_class, int num_object) {
+  // outputs: classes, iou, coordinates
+  const int cell_dim = num_class + (1 + 4) * num_object;
+  CHECK_EQ(input_dim % cell_dim, 0)
+      << "Input size does not match num_class and num_object";
+  const int locations = input_dim / cell_dim;
+  const int side = static_cast<int>(sqrt(static_cast<double>(locations)) + 0.5);
+  CHECK_EQ(side * side, locations) << "Detection grid must be square";
+  return side;
+}
+
+template <typename Dtype>
+void DecodeGridBoxes(const Dtype* input, int side, int num_class,
+    int num_object, bool use_sqrt, bool constriant,
+    EvalDetectionParameter_ScoreType score_type, Dtype score_threshold,
+    DetectionBoxes<Dtype>* boxes) {
+  const int locations = side * side;
+  const Dtype* conf = input + num_class * locations;
+  const Dtype* coords = conf + num_object * locations;
+  boxes->Clear();
+  for (int i = 0; i < locations; ++i) {
+    int pred_label = 0;
+    Dtype max_prob = input[i];
+    for (int c = 1; c < num_class; ++c) {
+      if (input[c * locations + i] > max_prob) {
+        pred_label = c;
+        max_prob = input[c * locations + i];
+      }
+    }
+    for (int k = 0; k < num_object; ++k) {
+      const Dtype scale = conf[k * locations + i];
+      Dtype score;
+      switch (score_type) {
+      case EvalDetectionParameter_ScoreType_OBJ:
+        score = scale;
+        break;
+      case EvalDetectionParameter_ScoreType_PROB:
+        score = max_prob;
+        break;
+      default:
+        score = scale * max_prob;
+      }
+      if (score < score_threshold) {
+        continue;
+      }
+      const Dtype* box = coords + k * 4 * locations + i;
+      Dtype x = box[0];
+      Dtype y = box[locations];
+      Dtype w = box[2 * locations];
+      Dtype h = box[3 * locations];
+      if (constriant) {
+        x = (i % side + x) / side;
+        y = (i / side + y) / side;
+      }
+      if (use_sqrt) {
+        w = w * w;
+        h = h * h;
+      }
+      boxes->Push(x, y, w, h, score, pred_label);
+    }
+  }
+}
+
+template void DecodeGridBoxes<float>(const float* input, int side,
+    int num_class, int num_object, bool use_sqrt, bool constriant,
+    EvalDetectionParameter_ScoreType score_type, float score_threshold,
+    DetectionBoxes<float>* boxes);
+template void DecodeGridBoxes<double>(const double* input, int side,
+    int num_class, int num_object, bool use_sqrt, bool constriant,
+    EvalDetectionParameter_ScoreType score_type, double score_threshold,
+    DetectionBoxes<double>* boxes);
+
+template <typename Dtype>
+void BoxIoUs(Dtype x1, Dtype y1, Dtype x2, Dtype y2, Dtype area,
+    const Dtype* xs1, const Dtype* ys1, const Dtype* xs2, const Dtype* ys2,
+    const Dtype* areas, int n, Dtype* iou) {
+  for (int i = 0; i < n; ++i) {
+    const Dtype iw = std::max(std::min(x2, xs2[i]) - std::max(x1, xs1[i]),
+        Dtype(0));
+    const Dtype ih = std::max(std::min(y2, ys2[i]) - std::max(y1, ys1[i]),
+        Dtype(0));
+    const Dtype inter = iw * ih;
+    iou[i] = inter / (area + areas[i] - inter);
+  }
+}
+
+template void BoxIoUs<float>(float x1, float y1, float x2, float y2,
+    float area, const float* xs1, const float* ys1, const float* xs2,
+    const float* ys2, const float* areas, int n, float* iou);
+template void BoxIoUs<double>(double x1, double y1, double x2, double y2,
+    double area, const double* xs1, const double* ys1, const double* xs2,
+    const double* ys2, const double* areas, int n, double* iou);
+
+// Orders box indices by descending score, ties by index.
+template <typename Dtype>
+class ScoreGreater {
+ public:
+  explicit ScoreGreater(const Dtype* score) : score_(score) {}
+  inline bool operator()(int a, int b) const {
+    return score_[a] > score_[b] || (score_[a] == score_[b] && a < b);
+  }
+
+ private:
+  const Dtype* score_;
+};
+
+// Orders box indices by label, then by descending score.
+template <typename Dtype>
+class LabelScoreLess {
+ public:
+  LabelScoreLess(const int* label, const Dtype* score)
+      : label_(label), by_score_(score) {}
+  inline bool operator()(int a, int b) const {
+    return label_[a] < label_[b] ||
+        (label_[a] == label_[b] && by_score_(a, b));
+  }
+
+ private:
+  const int* label_;
+  ScoreGreater<Dtype> by_score_;
+};
+
+// Orders candidate ranks by label, then by rank.
+class LabelRankLess {
+ public:
+  explicit LabelRankLess(const int* label) : label_(label) {}
+  inline bool operator()(int a, int b) const {
+    return label_[a] < label_[b] || (label_[a] == label_[b] && a < b);
+  }
+
+ private:
+  const int* label_;
+};
+
+template <typename Dtype>
+BoxNms<Dtype>::BoxNms(Dtype threshold, bool per_class, int top_k)
+    : threshold_(threshold), per_class_(per_class), top_k_(top_k) {}
+
+template <typename Dtype>
+void BoxNms<Dtype>::Reserve(int capacity) {
+  order_.reserve(capacity);
+  x1_.reserve(capacity);
+  y1_.reserve(capacity);
+  x2_.reserve(capacity);
+  y2_.reserve(capacity);
+  area_.reserve(capacity);
+  label_.reserve(capacity);
+  suppressed_.reserve((capacity + 63) / 64);
+  iou_.reserve(capacity);
+  keep_.reserve(capacity);
+}
+
+template <typename Dtype>
+void BoxNms<Dtype>::Gather(const DetectionBoxes<Dtype>& boxes, int n) {
+  x1_.resize(n);
+  y1_.resize(n);
+  x2_.resize(n);
+  y2_.resize(n);
+  area_.resize(n);
+  label_.resize(n);
+  for (int r = 0; r < n; ++r) {
+    const int b = order_[r];
+    x1_[r] = boxes.x[b] - boxes.w[b] / 2;
+    y1_[r] = boxes.y[b] - boxes.h[b] / 2;
+    x2_[r] = boxes.x[b] + boxes.w[b] / 2;
+    y2_[r] = boxes.y[b] + boxes.h[b] / 2;
+    area_[r] = boxes.w[b] * boxes.h[b];
+    label_[r] = boxes.label[b];
+  }
+}
+
+template <typename Dtype>
+void BoxNms<Dtype>::Apply(const DetectionBoxes<Dtype>& boxes,
+    DetectionBoxes<Dtype>* kept) {
+  kept->Clear();
+  const int count = boxes.size();
+  if (count == 0) {
+    return;
+  }
+  order_.resize(count);
+  for (int i = 0; i < count; ++i) {
+    order_[i] = i;
+  }
+  const int n = top_k_ < 0 ? count : std::min(count, top_k_);
+  const ScoreGreater<Dtype> by_score(&boxes.score[0]);
+  std::partial_sort(order_.begin(), order_.begin() + n, order_.end(),
+      by_score);
+  if (per_class_) {
+    std::sort(order_.begin(), order_.begin() + n,
+        LabelScoreLess<Dtype>(&boxes.label[0], &boxes.score[0]));
+  }
+  Gather(boxes, n);
+  suppressed_.assign((n + 63) / 64, 0);
+  iou_.resize(n);
+  keep_.clear();
+  int group_end = 0;
+  for (int i = 0; i < n; ++i) {
+    // With per_class the candidates of a label are contiguous.
+    if (per_class_ && i == group_end) {
+      while (group_end < n && label_[group_end] == label_[i]) {
+        ++group_end;
+      }
+    }
+    if (suppressed(i)) {
+      continue;
+    }
+    keep_.push_back(i);
+    const int m = (per_class_ ? group_end : n) - i - 1;
+    if (threshold_ < 0 || m <= 0) {
+      continue;
+    }
+    BoxIoUs(x1_[i], y1_[i], x2_[i], y2_[i], area_[i], &x1_[i + 1],
+        &y1_[i + 1], &x2_[i + 1], &y2_[i + 1], &area_[i + 1], m, &iou_[0]);
+    for (int k = 0; k < m; ++k) {
+      const int j = i + 1 + k;
+      suppressed_[j / 64] |=
+          static_cast<uint64_t>(iou_[k] >= threshold_) << (j % 64);
+    }
+  }
+  if (!per_class_) {
+    // Ranks are in score order, so sorting them by label keeps scores
+    // descending within a label.
+    std::sort(keep_.begin(), keep_.end(), LabelRankLess(&label_[0]));
+  }
+  for (int i = 0; i < keep_.size(); ++i) {
+    const int b = order_[keep_[i]];
+    kept->Push(boxes.x[b], boxes.y[b], boxes.w[b], boxes.h[b],
+        boxes.score[b], boxes.label[b]);
+  }
+}
+
+INSTANTIATE_CLASS(BoxNms);
+
+template <typename Dtype>
+DetectionAPAccumulator<Dtype>::DetectionAPAccumulator(int num_class,
+    int num_bins, EvalDetectionParameter_APVersion version)
+    : num_class_(num_class), num_bins_(num_bins), version_(version) {
+  CHECK_GT(num_bins_, 0) << "ap_bins must be positive";
+  Reset();
+}
+
+template <typename Dtype>
+void DetectionAPAccumulator<Dtype>::Reset() {
+  num_gt_.assign(num_class_, 0);
+  tp_.assign(num_class_ * num_bins_, 0);
+  fp_.assign(num_class_ * num_bins_, 0);
+}
+
+template <typename Dtype>
+void DetectionAPAccumulator<Dtype>::Add(const Dtype* rows, int num,
+    int dim) {
+  for (int n = 0; n < num; ++n) {
+    const Dtype* image = rows + n * dim;
+    for (int c = 0; c < num_class_; ++c) {
+      num_gt_[c] += image[c];
+    }
+    for (int r = num_class_; r + 4 <= dim; r += 4) {
+      const Dtype* row = image + r;
+      // Unused rows and detections of difficult objects count as neither.
+      if (row[2] == 0 && row[3] == 0) {
+        continue;
+      }
+      const int c = static_cast<int>(row[0]);
+      CHECK_GE(c, 0);
+      CHECK_LT(c, num_class_);
+      const int bin = std::min(std::max(
+          static_cast<int>(row[1] * num_bins_), 0), num_bins_ - 1);
+      tp_[c * num_bins_ + bin] += row[2];
+      fp_[c * num_bins_ + bin] += row[3];
+    }
+  }
+}
+
+template <typename Dtype>
+Dtype DetectionAPAccumulator<Dtype>::AP(int c) const {
+  if (num_gt_[c] <= 0) {
+    return -1;
+  }
+  // Recall and precision after each non-empty bin, from the highest scores.
+  vector<double> recall;
+  vector<double> precision;
+  double tp = 0;
+  double fp = 0;
+  for (int b = num_bins_ - 1; b >= 0; --b) {
+    const int index = c * num_bins_ + b;
+    if (tp_[index] == 0 && fp_[index] == 0) {
+      continue;
+    }
+    tp += tp_[index];
+    fp += fp_[index];
+    recall.push_back(tp / num_gt_[c]);
+    precision.push_back(tp / (tp + fp));
+  }
+  // Interpolate: the precision at a recall is the best at any higher recall.
+  for (int i = static_cast<int>(precision.size()) - 2; i >= 0; --i) {
+    precision[i] = std::max(precision[i], precision[i + 1]);
+  }
+  double ap = 0;
+  if (version_ == EvalDetectionParameter_APVersion_ELEVEN_POINT) {
+    int i = 0;
+    for (int t = 0; t <= 10; ++t) {
+      while (i < recall.size() && recall[i] < t / 10.) {
+        ++i;
+      }
+      if (i < recall.size()) {
+        ap += precision[i] / 11;
+      }
+    }
+  } else {
+    double previous_recall = 0;
+    for (int i = 0; i < recall.size(); ++i) {
+      ap += (recall[i] - previous_recall) * precision[i];
+      previous_recall = recall[i];
+    }
+  }
+  return ap;
+}
+
+template <typename Dtype>
+Dtype DetectionAPAccumulator<Dtype>::MeanAP() const {
+  Dtype sum = 0;
+  int count = 0;
+  for (int c = 0; c < num_class_; ++c) {
+    const Dtype ap = AP(c);
+    if (ap >= 0) {
+      sum += ap;
+      ++count;
+    }
+  }
+  return count > 0 ? sum / count : 0;
+}
+
+INSTANTIATE_CLASS(DetectionAPAccumulator);
+
+}  // namespace caffe
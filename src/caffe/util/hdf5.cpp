@@ -5,6 +5,11 @@
 
 namespace caffe {
 
+boost::recursive_mutex& hdf5_mutex() {
+  static boost::recursive_mutex mutex;
+  return mutex;
+}
+
 // Verifies format of data stored in HDF5 file and reshapes blob accordingly.
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
@@ -103,6 +108,66 @@ void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
   CHECK_GE(status, 0) << "Failed to read double dataset " << dataset_name_;
 }
 
+hsize_t hdf5_get_num_rows(hid_t file_id, const char* dataset_name_) {
+  CHECK(H5LTfind_dataset(file_id, dataset_name_))
+      << "Failed to find HDF5 dataset " << dataset_name_;
+  int ndims;
+  herr_t status = H5LTget_dataset_ndims(file_id, dataset_name_, &ndims);
+  CHECK_GE(status, 0) << "Failed to get dataset ndims for " << dataset_name_;
+  CHECK_GE(ndims, 1) << "Dataset " << dataset_name_ << " has no axes";
+  std::vector<hsize_t> dims(ndims);
+  status = H5LTget_dataset_info(file_id, dataset_name_, dims.data(), NULL,
+      NULL);
+  CHECK_GE(status, 0) << "Failed to get dataset info for " << dataset_name_;
+  return dims[0];
+}
+
+// Reads a hyperslab of whole rows, converting the data to mem_type.
+template <typename Dtype>
+static void hdf5_load_nd_dataset_rows_helper(
+    hid_t file_id, const char* dataset_name_, hsize_t start, hsize_t num,
+    hid_t mem_type, Blob<Dtype>* blob) {
+  hid_t dataset = H5Dopen2(file_id, dataset_name_, H5P_DEFAULT);
+  CHECK_GE(dataset, 0) << "Failed to open HDF5 dataset " << dataset_name_;
+  hid_t file_space = H5Dget_space(dataset);
+  const int ndims = H5Sget_simple_extent_ndims(file_space);
+  CHECK_GE(ndims, 1) << "Dataset " << dataset_name_ << " has no axes";
+  std::vector<hsize_t> dims(ndims);
+  H5Sget_simple_extent_dims(file_space, dims.data(), NULL);
+  CHECK_LE(start + num, dims[0])
+      << "Rows out of range for HDF5 dataset " << dataset_name_;
+  std::vector<hsize_t> offset(ndims, 0);
+  offset[0] = start;
+  dims[0] = num;
+  herr_t status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET,
+      offset.data(), NULL, dims.data(), NULL);
+  CHECK_GE(status, 0) << "Failed to select rows of " << dataset_name_;
+  hid_t mem_space = H5Screate_simple(ndims, dims.data(), NULL);
+  vector<int> blob_dims(dims.begin(), dims.end());
+  blob->Reshape(blob_dims);
+  status = H5Dread(dataset, mem_type, mem_space, file_space, H5P_DEFAULT,
+      blob->mutable_cpu_data());
+  CHECK_GE(status, 0) << "Failed to read rows of dataset " << dataset_name_;
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+  H5Dclose(dataset);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<float>(hid_t file_id, const char* dataset_name_,
+    hsize_t start, hsize_t num, Blob<float>* blob) {
+  hdf5_load_nd_dataset_rows_helper(file_id, dataset_name_, start, num,
+      H5T_NATIVE_FLOAT, blob);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<double>(hid_t file_id,
+    const char* dataset_name_, hsize_t start, hsize_t num,
+    Blob<double>* blob) {
+  hdf5_load_nd_dataset_rows_helper(file_id, dataset_name_, start, num,
+      H5T_NATIVE_DOUBLE, blob);
+}
+
 template <>
 void hdf5_save_nd_dataset<float>(
     const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
@@ -145,6 +210,76 @@ void hdf5_save_nd_dataset<double>(
   delete[] dims;
 }
 
+template <typename Dtype>
+static void hdf5_append_nd_dataset_helper(hid_t file_id,
+    const string& dataset_name, const Blob<Dtype>& blob, hid_t type) {
+  const int num_axes = blob.num_axes();
+  CHECK_GE(num_axes, 1) << "Cannot append a scalar to " << dataset_name;
+  CHECK_GT(blob.count(), 0) << "Cannot append an empty blob to "
+      << dataset_name;
+  std::vector<hsize_t> dims(num_axes);
+  for (int i = 0; i < num_axes; ++i) {
+    dims[i] = blob.shape(i);
+  }
+  std::vector<hsize_t> offset(num_axes, 0);
+  hid_t dataset;
+  if (H5LTfind_dataset(file_id, dataset_name.c_str())) {
+    dataset = H5Dopen2(file_id, dataset_name.c_str(), H5P_DEFAULT);
+    CHECK_GE(dataset, 0) << "Failed to open dataset " << dataset_name;
+    hid_t space = H5Dget_space(dataset);
+    CHECK_EQ(H5Sget_simple_extent_ndims(space), num_axes)
+        << "Cannot append to " << dataset_name << "; shape mismatch";
+    std::vector<hsize_t> extent(num_axes);
+    H5Sget_simple_extent_dims(space, extent.data(), NULL);
+    H5Sclose(space);
+    for (int i = 1; i < num_axes; ++i) {
+      CHECK_EQ(extent[i], dims[i])
+          << "Cannot append to " << dataset_name << "; shape mismatch";
+    }
+    offset[0] = extent[0];
+    extent[0] += dims[0];
+    herr_t status = H5Dset_extent(dataset, extent.data());
+    CHECK_GE(status, 0) << "Failed to extend dataset " << dataset_name;
+  } else {
+    std::vector<hsize_t> max_dims(dims);
+    max_dims[0] = H5S_UNLIMITED;
+    hid_t space = H5Screate_simple(num_axes, dims.data(), max_dims.data());
+    hid_t properties = H5Pcreate(H5P_DATASET_CREATE);
+    herr_t status = H5Pset_chunk(properties, num_axes, dims.data());
+    CHECK_GE(status, 0) << "Failed to set chunks of " << dataset_name;
+    dataset = H5Dcreate2(file_id, dataset_name.c_str(), type, space,
+        H5P_DEFAULT, properties, H5P_DEFAULT);
+    CHECK_GE(dataset, 0) << "Failed to make dataset " << dataset_name;
+    H5Pclose(properties);
+    H5Sclose(space);
+  }
+  hid_t file_space = H5Dget_space(dataset);
+  herr_t status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET,
+      offset.data(), NULL, dims.data(), NULL);
+  CHECK_GE(status, 0) << "Failed to select rows of " << dataset_name;
+  hid_t mem_space = H5Screate_simple(num_axes, dims.data(), NULL);
+  status = H5Dwrite(dataset, type, mem_space, file_space, H5P_DEFAULT,
+      blob.cpu_data());
+  CHECK_GE(status, 0) << "Failed to append to dataset " << dataset_name;
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+  H5Dclose(dataset);
+}
+
+template <>
+void hdf5_append_nd_dataset<float>(hid_t file_id, const string& dataset_name,
+    const Blob<float>& blob) {
+  hdf5_append_nd_dataset_helper(file_id, dataset_name, blob,
+      H5T_NATIVE_FLOAT);
+}
+
+template <>
+void hdf5_append_nd_dataset<double>(hid_t file_id,
+    const string& dataset_name, const Blob<double>& blob) {
+  hdf5_append_nd_dataset_helper(file_id, dataset_name, blob,
+      H5T_NATIVE_DOUBLE);
+}
+
 string hdf5_load_string(hid_t loc_id, const string& dataset_name) {
   // Get size of dataset
   size_t size;
@@ -0,0 +1,199 @@
+#include <boost/thread.hpp>
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#endif  // USE_OPENCV
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_cache.hpp"
+#include "caffe/util/io.hpp"
+
+namespace caffe {
+
+using boost::weak_ptr;
+
+map<const string, weak_ptr<ImageCache> > ImageCache::caches_;
+static boost::mutex caches_mutex_;
+
+class ImageCache::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+ImageCache::ImageCache(const ImageCacheParameter& param)
+    : param_(param),
+      block_size_(static_cast<size_t>(param.block_kb()) * 1024),
+      num_blocks_(static_cast<uint64_t>(param.capacity_mb()) * 1024 * 1024 /
+          (static_cast<uint64_t>(param.block_kb()) * 1024)),
+      hits_(0), misses_(0), full_logged_(false), sync_(new sync()) {
+  CHECK_GT(param.block_kb(), 0) << "Image cache blocks must not be empty";
+  CHECK_GT(num_blocks_, 0) << "Image cache capacity is smaller than a block";
+  arena_.resize(block_size_ * num_blocks_);
+  free_blocks_.reserve(num_blocks_);
+  for (int i = num_blocks_ - 1; i >= 0; --i) {
+    free_blocks_.push_back(i);
+  }
+  LOG(INFO) << "Image cache of " << param.capacity_mb() << " MB ("
+      << num_blocks_ << " blocks of " << param.block_kb() << " KB), policy "
+      << ImageCacheParameter_Policy_Name(param.policy());
+}
+
+shared_ptr<ImageCache> ImageCache::Get(const string& name,
+    const ImageCacheParameter& param) {
+  boost::mutex::scoped_lock lock(caches_mutex_);
+  // Drop caches whose layers have all been destroyed.
+  for (map<const string, weak_ptr<ImageCache> >::iterator it =
+       caches_.begin(); it != caches_.end();) {
+    if (it->second.expired()) {
+      caches_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  weak_ptr<ImageCache>& weak = caches_[name];
+  shared_ptr<ImageCache> cache = weak.lock();
+  if (!cache) {
+    cache.reset(new ImageCache(param));
+    weak = cache;
+  }
+  return cache;
+}
+
+size_t ImageCache::size() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return entries_.size();
+}
+
+size_t ImageCache::hits() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return hits_;
+}
+
+size_t ImageCache::misses() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return misses_;
+}
+
+void ImageCache::Evict(const string& key) {
+  map<string, Entry>::iterator it = entries_.find(key);
+  CHECK(it != entries_.end());
+  const vector<int>& blocks = it->second.blocks;
+  free_blocks_.insert(free_blocks_.end(), blocks.begin(), blocks.end());
+  lru_.erase(it->second.lru);
+  entries_.erase(it);
+}
+
+bool ImageCache::Reserve(int n) {
+  if (n > num_blocks_) {
+    return false;
+  }
+  if (param_.policy() == ImageCacheParameter_Policy_ALL) {
+    return free_blocks_.size() >= n;
+  }
+  while (free_blocks_.size() < n) {
+    CHECK(!lru_.empty());
+    Evict(lru_.back());
+  }
+  return true;
+}
+
+#ifdef USE_OPENCV
+bool ImageCache::Lookup(const string& key, cv::Mat* img) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  map<string, Entry>::iterator it = entries_.find(key);
+  if (it == entries_.end()) {
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  Entry& entry = it->second;
+  lru_.splice(lru_.begin(), lru_, entry.lru);
+  img->create(entry.rows, entry.cols, entry.type);
+  CHECK(img->isContinuous());
+  uint8_t* dst = img->ptr<uint8_t>(0);
+  size_t remaining = entry.bytes;
+  for (int i = 0; i < entry.blocks.size(); ++i) {
+    const size_t chunk = std::min(remaining, block_size_);
+    memcpy(dst, &arena_[entry.blocks[i] * block_size_],
+        chunk);  // NOLINT(caffe/alt_fn)
+    dst += chunk;
+    remaining -= chunk;
+  }
+  return true;
+}
+
+bool ImageCache::Insert(const string& key, const cv::Mat& img) {
+  CHECK(img.depth() == CV_8U) << "Image cache only holds unsigned bytes";
+  const size_t row_bytes = img.cols * img.elemSize();
+  const size_t bytes = row_bytes * img.rows;
+  const int n = (bytes + block_size_ - 1) / block_size_;
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (entries_.find(key) != entries_.end()) {
+    return true;
+  }
+  if (!Reserve(n)) {
+    if (!full_logged_) {
+      LOG(INFO) << "Image cache is full after " << entries_.size()
+          << " images, further images are decoded on every read";
+      full_logged_ = true;
+    }
+    return false;
+  }
+  Entry& entry = entries_[key];
+  entry.rows = img.rows;
+  entry.cols = img.cols;
+  entry.type = img.type();
+  entry.bytes = bytes;
+  entry.blocks.assign(free_blocks_.end() - n, free_blocks_.end());
+  free_blocks_.resize(free_blocks_.size() - n);
+  lru_.push_front(key);
+  entry.lru = lru_.begin();
+  // Rows may not be contiguous in the source (e.g. an ROI), so copy row by
+  // row into the block chain.
+  int block = 0;
+  size_t block_offset = 0;
+  for (int h = 0; h < img.rows; ++h) {
+    const uint8_t* src = img.ptr<uint8_t>(h);
+    size_t remaining = row_bytes;
+    while (remaining > 0) {
+      const size_t chunk = std::min(remaining, block_size_ - block_offset);
+      memcpy(&arena_[entry.blocks[block] * block_size_ + block_offset],
+          src, chunk);  // NOLINT(caffe/alt_fn)
+      src += chunk;
+      remaining -= chunk;
+      block_offset += chunk;
+      if (block_offset == block_size_) {
+        ++block;
+        block_offset = 0;
+      }
+    }
+  }
+  return true;
+}
+
+cv::Mat ImageCache::ReadImage(const string& filename, const int height,
+    const int width, const bool is_color,
+    const bool nearest_neighbour_interp) {
+  std::ostringstream key;
+  key << filename << "@" << height << "x" << width << (is_color ? "c" : "g")
+      << (nearest_neighbour_interp ? "n" : "l");
+  cv::Mat cv_img;
+  if (Lookup(key.str(), &cv_img)) {
+    return cv_img;
+  }
+  cv_img = ReadImageToCVMat(filename, height, width, is_color,
+      nearest_neighbour_interp);
+  if (cv_img.data) {
+    Insert(key.str(), cv_img);
+  }
+  return cv_img;
+}
+#endif  // USE_OPENCV
+
+}  // namespace caffe
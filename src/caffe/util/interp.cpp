@@ -162,6 +162,108 @@ void caffe_cpu_interp2_backward(const int channels,
   }
 }
 
+template <typename Dtype>
+void Interp2Tables<Dtype>::Setup(const int x1, const int y1, const int height1, const int width1, const int Height1, const int Width1,
+    const int x2, const int y2, const int height2, const int width2, const int Height2, const int Width2) {
+  CHECK(x1 >= 0 && y1 >= 0 && height1 > 0 && width1 > 0 && x2 >= 0 && y2 >= 0 && height2 > 0 && width2 > 0);
+  CHECK(Width1 >= width1 + x1 && Height1 >= height1 + y1 && Width2 >= width2 + x2 && Height2 >= height2 + y2);
+  this->size1 = Height1 * Width1;
+  this->size2 = Height2 * Width2;
+  this->offset2 = y2 * Width2 + x2;
+  this->height2 = height2;
+  this->width2 = width2;
+  this->Width2 = Width2;
+  row0.resize(height2);
+  row1.resize(height2);
+  h0lambda.resize(height2);
+  h1lambda.resize(height2);
+  col0.resize(width2);
+  col1.resize(width2);
+  w0lambda.resize(width2);
+  w1lambda.resize(width2);
+  // Same arithmetic as caffe_cpu_interp2, so that both give the same values.
+  const bool copy = height1 == height2 && width1 == width2;
+  const float rheight = (height2 > 1) ? static_cast<float>(height1 - 1) / (height2 - 1) : 0.f;
+  const float rwidth = (width2 > 1) ? static_cast<float>(width1 - 1) / (width2 - 1) : 0.f;
+  for (int h2 = 0; h2 < height2; ++h2) {
+    const float h1r = copy ? h2 : rheight * h2;
+    const int h1 = h1r;
+    const int h1p = (h1 < height1 - 1) ? 1 : 0;
+    row0[h2] = (y1 + h1) * Width1 + x1;
+    row1[h2] = row0[h2] + h1p * Width1;
+    h1lambda[h2] = h1r - h1;
+    h0lambda[h2] = Dtype(1.) - h1lambda[h2];
+  }
+  for (int w2 = 0; w2 < width2; ++w2) {
+    const float w1r = copy ? w2 : rwidth * w2;
+    const int w1 = w1r;
+    const int w1p = (w1 < width1 - 1) ? 1 : 0;
+    col0[w2] = w1;
+    col1[w2] = w1 + w1p;
+    w1lambda[w2] = w1r - w1;
+    w0lambda[w2] = Dtype(1.) - w1lambda[w2];
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_interp2(const int channels, const Interp2Tables<Dtype>& tables,
+    const Dtype *data1, Dtype *data2) {
+  const int* col0 = &tables.col0[0];
+  const int* col1 = &tables.col1[0];
+  const Dtype* w0lambda = &tables.w0lambda[0];
+  const Dtype* w1lambda = &tables.w1lambda[0];
+  const int width2 = tables.width2;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* plane1 = data1 + c * tables.size1;
+    Dtype* pos2 = data2 + c * tables.size2 + tables.offset2;
+    for (int h2 = 0; h2 < tables.height2; ++h2, pos2 += tables.Width2) {
+      const Dtype* row0 = plane1 + tables.row0[h2];
+      const Dtype* row1 = plane1 + tables.row1[h2];
+      const Dtype h0lambda = tables.h0lambda[h2];
+      const Dtype h1lambda = tables.h1lambda[h2];
+      for (int w2 = 0; w2 < width2; ++w2) {
+	pos2[w2] =
+	  h0lambda * (w0lambda[w2] * row0[col0[w2]] + w1lambda[w2] * row0[col1[w2]]) +
+	  h1lambda * (w0lambda[w2] * row1[col0[w2]] + w1lambda[w2] * row1[col1[w2]]);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_interp2_backward(const int channels, const Interp2Tables<Dtype>& tables,
+    Dtype *data1, const Dtype *data2) {
+  const int* col0 = &tables.col0[0];
+  const int* col1 = &tables.col1[0];
+  const Dtype* w0lambda = &tables.w0lambda[0];
+  const Dtype* w1lambda = &tables.w1lambda[0];
+  const int width2 = tables.width2;
+  // Every channel only accumulates into its own plane of data1, so the
+  // threads never write to the same location.
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int c = 0; c < channels; ++c) {
+    Dtype* plane1 = data1 + c * tables.size1;
+    const Dtype* pos2 = data2 + c * tables.size2 + tables.offset2;
+    for (int h2 = 0; h2 < tables.height2; ++h2, pos2 += tables.Width2) {
+      Dtype* row0 = plane1 + tables.row0[h2];
+      Dtype* row1 = plane1 + tables.row1[h2];
+      const Dtype h0lambda = tables.h0lambda[h2];
+      const Dtype h1lambda = tables.h1lambda[h2];
+      for (int w2 = 0; w2 < width2; ++w2) {
+	row0[col0[w2]] += h0lambda * w0lambda[w2] * pos2[w2];
+	row0[col1[w2]] += h0lambda * w1lambda[w2] * pos2[w2];
+	row1[col0[w2]] += h1lambda * w0lambda[w2] * pos2[w2];
+	row1[col1[w2]] += h1lambda * w1lambda[w2] * pos2[w2];
+      }
+    }
+  }
+}
+
 // Create Gaussian pyramid of an image. Assume output space is pre-allocated.
 // IN : [channels height width]
 template <typename Dtype, bool packed>
@@ -292,6 +394,15 @@ template void caffe_cpu_interp2<double,true>(const int, const double *, const in
 template void caffe_cpu_interp2_backward<float,false>(const int, float *, const int, const int, const int, const int, const int, const int, const float *, const int, const int, const int, const int, const int, const int);
 template void caffe_cpu_interp2_backward<double,false>(const int, double *, const int, const int, const int, const int, const int, const int, const double *, const int, const int, const int, const int, const int, const int);
 
+template struct Interp2Tables<float>;
+template struct Interp2Tables<double>;
+
+template void caffe_cpu_interp2<float>(const int, const Interp2Tables<float>&, const float *, float *);
+template void caffe_cpu_interp2<double>(const int, const Interp2Tables<double>&, const double *, double *);
+
+template void caffe_cpu_interp2_backward<float>(const int, const Interp2Tables<float>&, float *, const float *);
+template void caffe_cpu_interp2_backward<double>(const int, const Interp2Tables<double>&, double *, const double *);
+
 template void caffe_cpu_pyramid2<float,false>(const int, const float *, const int, const int, float *, const int);
 template void caffe_cpu_pyramid2<float,true>(const int, const float *, const int, const int, float *, const int);
 template void caffe_cpu_pyramid2<double,false>(const int, const double *, const int, const int, double *, const int);
@@ -88,35 +88,211 @@ static bool matchExt(const std::string & fn,
   return false;
 } 
 
+#ifdef USE_OPENCV
+// OpenCV >= 3.2 can have libjpeg decode at 1/2, 1/4 or 1/8 of the stored
+// resolution (IMREAD_REDUCED_*), which skips most of the decoding work for
+// images that are downsized right after. OpenCV 2.4 defines
+// CV_VERSION_EPOCH and reuses CV_VERSION_MAJOR for its minor version.
+#if !defined(CV_VERSION_EPOCH) && (CV_VERSION_MAJOR > 3 || \
+    (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 2))
+#define CAFFE_REDUCED_DECODE
+#endif
+
+#ifdef CAFFE_REDUCED_DECODE
+// Reads the stored size and channel count of a JPEG stream from its SOF
+// marker, without decoding it. Returns false for other formats and truncated
+// headers.
+static bool ReadJPEGSize(const std::vector<char>& buffer, int* height,
+    int* width, int* channels) {
+  const size_t size = buffer.size();
+  if (size < 4) {
+    return false;
+  }
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(&buffer[0]);
+  if (p[0] != 0xFF || p[1] != 0xD8) {
+    return false;
+  }
+  size_t i = 2;
+  while (i + 3 < size) {
+    if (p[i] != 0xFF) {
+      return false;
+    }
+    const unsigned char marker = p[i + 1];
+    if (marker == 0xFF) {
+      // Fill byte.
+      ++i;
+      continue;
+    }
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+      // Markers without a payload.
+      i += 2;
+      continue;
+    }
+    if (marker == 0xD9 || marker == 0xDA) {
+      // End of image or start of scan before any frame header.
+      return false;
+    }
+    // SOF0-SOF15, except DHT (C4), JPG (C8) and DAC (CC).
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+        marker != 0xC8 && marker != 0xCC) {
+      if (i + 9 >= size) {
+        return false;
+      }
+      *height = (p[i + 5] << 8) | p[i + 6];
+      *width = (p[i + 7] << 8) | p[i + 8];
+      *channels = p[i + 9];
+      return *height > 0 && *width > 0;
+    }
+    i += 2 + ((p[i + 2] << 8) | p[i + 3]);
+  }
+  return false;
+}
+#endif  // CAFFE_REDUCED_DECODE
+
+// Returns the imdecode flag for an image that needs at least height x width
+// pixels: the strongest JPEG reduction (1/8, 1/4, 1/2) that still yields the
+// target size, or cv_read_flag for a full resolution decode. A native
+// (negative) cv_read_flag keeps gray and color JPEGs as they are stored.
+static int ReducedDecodeFlag(const std::vector<char>& buffer,
+    const int height, const int width, const int cv_read_flag) {
+#ifdef CAFFE_REDUCED_DECODE
+  static const int kFactors[] = {8, 4, 2};
+  static const int kColorFlags[] = {cv::IMREAD_REDUCED_COLOR_8,
+      cv::IMREAD_REDUCED_COLOR_4, cv::IMREAD_REDUCED_COLOR_2};
+  static const int kGrayFlags[] = {cv::IMREAD_REDUCED_GRAYSCALE_8,
+      cv::IMREAD_REDUCED_GRAYSCALE_4, cv::IMREAD_REDUCED_GRAYSCALE_2};
+  int src_height, src_width, src_channels;
+  if (height > 0 && width > 0 &&
+      ReadJPEGSize(buffer, &src_height, &src_width, &src_channels)) {
+    if (cv_read_flag < 0 && src_channels != 1 && src_channels != 3) {
+      return cv_read_flag;
+    }
+    const bool is_color = cv_read_flag < 0 ? src_channels == 3 :
+        cv_read_flag != CV_LOAD_IMAGE_GRAYSCALE;
+    for (int i = 0; i < 3; ++i) {
+      // libjpeg rounds reduced sizes up, so flooring here is conservative.
+      if (src_height / kFactors[i] >= height &&
+          src_width / kFactors[i] >= width) {
+        return is_color ? kColorFlags[i] : kGrayFlags[i];
+      }
+    }
+  }
+#endif  // CAFFE_REDUCED_DECODE
+  return cv_read_flag;
+}
+
+static bool ReadFileToBuffer(const string& filename,
+    std::vector<char>* buffer) {
+  fstream file(filename.c_str(), ios::in|ios::binary|ios::ate);
+  if (!file.is_open()) {
+    return false;
+  }
+  buffer->resize(file.tellg());
+  file.seekg(0, ios::beg);
+  return buffer->size() && file.read(&(*buffer)[0], buffer->size());
+}
+
+// Loads an image that is about to be resized to height x width. JPEGs are
+// decoded at reduced resolution when the target is at least 2x smaller;
+// everything else goes through a regular imread.
+static cv::Mat ReadImageForResize(const string& filename, const int height,
+    const int width, const bool is_color) {
+#ifdef CAFFE_REDUCED_DECODE
+  std::vector<char> buffer;
+  if (height > 0 && width > 0 && ReadFileToBuffer(filename, &buffer)) {
+    return cv::imdecode(buffer, ReducedDecodeFlag(buffer, height, width,
+        is_color ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE));
+  }
+#endif  // CAFFE_REDUCED_DECODE
+  return cv::imread(filename,
+      is_color ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE);
+}
+#endif  // USE_OPENCV
+
 #ifdef USE_OPENCV
 bool ReadBoxDataToDatum(const string& filename, const string& annoname,
     const map<string, int>& label_map, const int height, const int width, 
     const bool is_color, const std::string & encoding, Datum* datum) {
-  int ori_w, ori_h;
-  cv::Mat cv_img = ReadImageToCVMat(filename, height, width, is_color);
-  ori_w = cv_img.cols;
-  ori_h = cv_img.rows;
-  if (cv_img.data) {
-    if (encoding.size()) {
-      if ( (cv_img.channels() == 3) == is_color && !height && !width &&
-          matchExt(filename, encoding) )
-        return ReadFileToDatum(filename, annoname, label_map, ori_w, ori_h, datum);
-      std::vector<uchar> buf;
-      cv::imencode("."+encoding, cv_img, buf);
-      datum->set_data(std::string(reinterpret_cast<char*>(&buf[0]),
-                      buf.size()));
-      datum->set_encoded(true);
-      // read xml anno data
-      ParseXmlToDatum(annoname, label_map, ori_w, ori_h, datum);
-      return true;
+  return ReadBoxDataToDatum(filename, annoname, label_map, height, width, 0,
+      is_color, encoding, datum);
+}
+
+bool ReadBoxDataToDatum(const string& filename, const string& annoname,
+    const map<string, int>& label_map, const int height, const int width,
+    const int max_side, const bool is_color, const std::string& encoding,
+    Datum* datum) {
+  std::vector<char> buffer;
+  if (!ReadFileToBuffer(filename, &buffer)) {
+    LOG(ERROR) << "Could not open or find file " << filename;
+    return false;
+  }
+  const int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
+      CV_LOAD_IMAGE_GRAYSCALE);
+  // Boxes are checked against and normalized by the original image size.
+  // JPEGs store it in their header, so they are only decoded once the target
+  // size is known; other images are decoded at full size right away.
+  int ori_w = 0;
+  int ori_h = 0;
+  cv::Mat cv_img;
+#ifdef CAFFE_REDUCED_DECODE
+  int ori_channels;
+  const bool has_size = ReadJPEGSize(buffer, &ori_h, &ori_w, &ori_channels);
+#else
+  const bool has_size = false;
+#endif  // CAFFE_REDUCED_DECODE
+  if (!has_size) {
+    cv_img = cv::imdecode(buffer, cv_read_flag);
+    if (!cv_img.data) {
+      LOG(ERROR) << "Could not decode file " << filename;
+      return false;
     }
-    CVMatToDatum(cv_img, datum);
+    ori_w = cv_img.cols;
+    ori_h = cv_img.rows;
+  }
+  int resize_height = 0;
+  int resize_width = 0;
+  int interpolation = cv::INTER_LINEAR;
+  if (height > 0 && width > 0) {
+    resize_height = height;
+    resize_width = width;
+  } else if (max_side > 0 && std::max(ori_w, ori_h) > max_side) {
+    const float scale = static_cast<float>(max_side) / std::max(ori_w, ori_h);
+    resize_height = std::max(1, static_cast<int>(ori_h * scale + 0.5));
+    resize_width = std::max(1, static_cast<int>(ori_w * scale + 0.5));
+    interpolation = cv::INTER_AREA;
+  }
+  const bool resized = resize_height > 0;
+  if (!cv_img.data) {
+    // At reduced resolution when the target is at least 2x smaller.
+    cv_img = cv::imdecode(buffer, ReducedDecodeFlag(buffer, resize_height,
+        resize_width, cv_read_flag));
+    if (!cv_img.data) {
+      LOG(ERROR) << "Could not decode file " << filename;
+      return false;
+    }
+  }
+  if (resized && (cv_img.rows != resize_height ||
+      cv_img.cols != resize_width)) {
+    cv::resize(cv_img, cv_img, cv::Size(resize_width, resize_height), 0, 0,
+        interpolation);
+  }
+  if (encoding.size()) {
+    if ( (cv_img.channels() == 3) == is_color && !resized &&
+        matchExt(filename, encoding) )
+      return ReadFileToDatum(filename, annoname, label_map, ori_w, ori_h, datum);
+    std::vector<uchar> buf;
+    cv::imencode("."+encoding, cv_img, buf);
+    datum->set_data(std::string(reinterpret_cast<char*>(&buf[0]),
+                    buf.size()));
+    datum->set_encoded(true);
     // read xml anno data
     ParseXmlToDatum(annoname, label_map, ori_w, ori_h, datum);
     return true;
-  } else {
-    return false;
   }
+  CVMatToDatum(cv_img, datum);
+  // read xml anno data
+  ParseXmlToDatum(annoname, label_map, ori_w, ori_h, datum);
+  return true;
 }
 
 cv::Mat ReadImageToCVMat(const string& filename, const int height,
@@ -163,7 +339,10 @@ cv::Mat ReadImageToCVMat(const string& filename,
   cv::Mat cv_img;
   int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
     CV_LOAD_IMAGE_GRAYSCALE);
-  cv::Mat cv_img_origin = cv::imread(filename, cv_read_flag);
+  // Reduced decoding averages pixels, which would corrupt label images.
+  cv::Mat cv_img_origin = nearest_neighbour_interp ?
+      cv::imread(filename, cv_read_flag) :
+      ReadImageForResize(filename, height, width, is_color);
   if (!cv_img_origin.data) {
     LOG(ERROR) << "Could not open or find file " << filename;
     return cv_img_origin;
@@ -186,9 +365,8 @@ cv::Mat ReadImageToCVMat(const string& filename, const int height,
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color) {
   cv::Mat cv_img;
-  int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
-    CV_LOAD_IMAGE_GRAYSCALE);
-  cv::Mat cv_img_origin = cv::imread(filename, cv_read_flag);
+  cv::Mat cv_img_origin =
+      ReadImageForResize(filename, height, width, is_color);
   if (!cv_img_origin.data) {
     LOG(ERROR) << "Could not open or find file " << filename;
     return cv_img_origin;
@@ -287,6 +465,29 @@ cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color) {
   return cv_img;
 }
 
+static cv::Mat DecodeDatumToCVMatReduced(const Datum& datum,
+    const int min_height, const int min_width, const int cv_read_flag) {
+  cv::Mat cv_img;
+  CHECK(datum.encoded()) << "Datum not encoded";
+  const string& data = datum.data();
+  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
+  cv_img = cv::imdecode(vec_data,
+      ReducedDecodeFlag(vec_data, min_height, min_width, cv_read_flag));
+  if (!cv_img.data) {
+    LOG(ERROR) << "Could not decode datum ";
+  }
+  return cv_img;
+}
+cv::Mat DecodeDatumToCVMatNative(const Datum& datum, const int min_height,
+    const int min_width) {
+  return DecodeDatumToCVMatReduced(datum, min_height, min_width, -1);
+}
+cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color,
+    const int min_height, const int min_width) {
+  return DecodeDatumToCVMatReduced(datum, min_height, min_width,
+      is_color ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE);
+}
+
 // If Datum is encoded will decoded using DecodeDatumToCVMat and CVMatToDatum
 // If Datum is not encoded will do nothing
 bool DecodeDatumNative(Datum* datum) {
@@ -7,6 +7,9 @@
 // should be a list of files as well as their labels, in the format as
 //   subfolder1/file1.JPEG 7
 //   ....
+//
+// Images are read, parsed and encoded by --threads workers and written in
+// transactions of --txn_size images; --max_side stores them pre-shrunk.
 
 #include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
@@ -14,7 +17,9 @@
 #include <utility>
 #include <vector>
 
+#include "boost/bind.hpp"
 #include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 
@@ -44,6 +49,55 @@ DEFINE_string(encode_type, "jpg",
     "Optional: What type should we encode the image as ('png','jpg',...).");
 DEFINE_string(label_file, "",
     "a map from name to label");
+DEFINE_int32(max_side, 0, "Optional: shrink images so that their longer side "
+    "is at most max_side, keeping the aspect ratio");
+DEFINE_int32(threads, 0, "Number of threads reading, parsing and encoding "
+    "images, 0 for one per core");
+DEFINE_int32(txn_size, 1000, "Number of images per DB transaction");
+
+// A converted image, ready to be written.
+struct Entry {
+  bool status;
+  int data_size;
+  string key;
+  string value;
+};
+
+// Converts lines [begin, end) with a stride of num_threads, starting at
+// begin + thread_id, into entries[line_id - begin].
+void ConvertLines(const std::vector<std::pair<std::string, std::string> >&
+    lines, const std::map<std::string, int>& label_map,
+    const string& root_folder, const int begin, const int end,
+    const int thread_id, const int num_threads, std::vector<Entry>* entries) {
+  const bool is_color = !FLAGS_gray;
+  const int resize_height = std::max<int>(0, FLAGS_resize_height);
+  const int resize_width = std::max<int>(0, FLAGS_resize_width);
+  Datum datum;
+  for (int line_id = begin + thread_id; line_id < end;
+       line_id += num_threads) {
+    Entry& entry = (*entries)[line_id - begin];
+    std::string enc = FLAGS_encode_type;
+    if (FLAGS_encoded && !enc.size()) {
+      // Guess the encoding type from the file name
+      string fn = lines[line_id].first;
+      size_t p = fn.rfind('.');
+      if ( p == fn.npos )
+        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
+      enc = fn.substr(p);
+      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+    }
+    entry.status = ReadBoxDataToDatum(root_folder + lines[line_id].first,
+        root_folder + lines[line_id].second, label_map,
+        resize_height, resize_width, FLAGS_max_side, is_color, enc, &datum);
+    if (!entry.status) {
+      continue;
+    }
+    entry.data_size = datum.data().size();
+    // sequential
+    entry.key = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
+    CHECK(datum.SerializeToString(&entry.value));
+  }
+}
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -68,7 +122,6 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  const bool is_color = !FLAGS_gray;
   const bool check_size = FLAGS_check_size;
   const bool encoded = FLAGS_encoded;
   const string encode_type = FLAGS_encode_type;
@@ -104,66 +157,68 @@ int main(int argc, char** argv) {
   if (encode_type.size() && !encoded)
     LOG(INFO) << "encode_type specified, assuming encoded=true.";
 
-  int resize_height = std::max<int>(0, FLAGS_resize_height);
-  int resize_width = std::max<int>(0, FLAGS_resize_width);
+  const int num_threads = FLAGS_threads > 0 ? FLAGS_threads :
+      std::max<int>(1, boost::thread::hardware_concurrency());
+  const int txn_size = std::max<int>(1, FLAGS_txn_size);
+  LOG(INFO) << "Converting with " << num_threads << " threads";
 
   // Create new DB
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
   db->Open(argv[3], db::NEW);
-  scoped_ptr<db::Transaction> txn(db->NewTransaction());
 
   // Storing to db
   std::string root_folder(argv[1]);
-  Datum datum;
   int count = 0;
   int data_size = 0;
   bool data_size_initialized = false;
 
-  for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    bool status;
-    std::string enc = encode_type;
-    if (encoded && !enc.size()) {
-      // Guess the encoding type from the file name
-      string fn = lines[line_id].first;
-      size_t p = fn.rfind('.');
-      if ( p == fn.npos )
-        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
-      enc = fn.substr(p);
-      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
-    }
-    status = ReadBoxDataToDatum(root_folder + lines[line_id].first,
-        root_folder + lines[line_id].second, label_map,
-        resize_height, resize_width, is_color, enc, &datum);
-    if (status == false) continue;
-    if (check_size) {
-      if (!data_size_initialized) {
-        data_size = datum.channels() * datum.height() * datum.width();
-        data_size_initialized = true;
-      } else {
-        const std::string& data = datum.data();
-        CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
-            << data.size();
+  // Lines are converted in blocks of txn_size. While the workers convert a
+  // block, the previous one is written to the DB in a single transaction.
+  std::vector<Entry> entries[2];
+  for (int block = 0; ; ++block) {
+    const int begin = std::min<int>(block * txn_size, lines.size());
+    const int end = std::min<int>(begin + txn_size, lines.size());
+    std::vector<Entry>& converting = entries[block % 2];
+    std::vector<Entry>& writing = entries[(block + 1) % 2];
+    boost::thread_group workers;
+    if (begin < end) {
+      converting.assign(end - begin, Entry());
+      for (int i = 0; i < num_threads; ++i) {
+        workers.create_thread(boost::bind(&ConvertLines, boost::cref(lines),
+            boost::cref(label_map), boost::cref(root_folder), begin, end, i,
+            num_threads, &converting));
       }
+    } else {
+      converting.clear();
     }
-    // sequential
-    string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
-
-    // Put in db
-    string out;
-    CHECK(datum.SerializeToString(&out));
-    txn->Put(key_str, out);
-
-    if (++count % 1000 == 0) {
+    if (writing.size()) {
+      scoped_ptr<db::Transaction> txn(db->NewTransaction());
+      for (int i = 0; i < writing.size(); ++i) {
+        if (!writing[i].status) {
+          continue;
+        }
+        if (check_size) {
+          if (!data_size_initialized) {
+            data_size = writing[i].data_size;
+            data_size_initialized = true;
+          } else {
+            CHECK_EQ(writing[i].data_size, data_size)
+                << "Incorrect data field size " << writing[i].data_size;
+          }
+        }
+        // Put in db
+        txn->Put(writing[i].key, writing[i].value);
+        ++count;
+      }
       // Commit db
       txn->Commit();
-      txn.reset(db->NewTransaction());
       LOG(INFO) << "Processed " << count << " files.";
+      writing.clear();
+    }
+    workers.join_all();
+    if (begin >= end) {
+      break;
     }
-  }
-  // write the last batch
-  if (count % 1000 != 0) {
-    txn->Commit();
-    LOG(INFO) << "Processed " << count << " files.";
   }
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";